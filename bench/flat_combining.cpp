@@ -0,0 +1,109 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Compares the throughput of an ordered_set behind a mutex with combining_ordered_set, for a mix of 25% inserts, 25%
+ * erases and 50% order_of_key on random keys.
+ *
+ *     flat_combining [threads = 32] [operations per thread = 1000000] [keys = 1000000]
+ */
+
+#include <jp/ordered_set.hpp>
+#include <jp/combining_ordered_set.hpp>
+
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+namespace {
+
+struct locked_set
+{
+    bool insert(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return set.insert(key).second;
+    }
+
+    void erase(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        set.erase(key);
+    }
+
+    size_t order_of_key(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        return set.order_of_key(key);
+    }
+
+    std::mutex mutex;
+    jp::ordered_set<std::uint64_t> set;
+};
+
+template<typename Set>
+void run(const char* name, Set& set, size_t threads, size_t operations, size_t keys)
+{
+    for (size_t key = 0; key < keys; key += 2)
+        set.insert(key);
+
+    std::vector<std::thread> workers;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&set, t, operations, keys] {
+            std::mt19937_64 rng{t};
+            for (size_t i = 0; i < operations; i++) {
+                std::uint64_t key = rng() % keys;
+                switch (i % 4) {
+                case 0: set.insert(key); break;
+                case 1: set.erase(key); break;
+                default: set.order_of_key(key); break;
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    std::printf("%-24s %10.2f Mops/s\n", name, static_cast<double>(threads * operations) / elapsed.count() / 1e6);
+}
+
+} //!namespace
+
+int main(int argc, char** argv)
+{
+    size_t threads = argc > 1 ? std::stoull(argv[1]) : 32;
+    size_t operations = argc > 2 ? std::stoull(argv[2]) : 1000000;
+    size_t keys = argc > 3 ? std::stoull(argv[3]) : 1000000;
+
+    locked_set locked;
+    run("mutex", locked, threads, operations, keys);
+    jp::combining_ordered_set<std::uint64_t> combining;
+    run("flat combining", combining, threads, operations, keys);
+}
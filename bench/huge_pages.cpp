@@ -0,0 +1,158 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Compares the dTLB load misses and the time of random lookups in an ordered_set with nodes from std::allocator and
+ * from huge_page_allocator, backed by the transparent huge pages or, with --hugetlbfs, by the hugetlbfs pool.
+ *
+ *     huge_pages [keys = 10000000] [lookups = 10000000] [--hugetlbfs]
+ *
+ * The misses are read with perf_event_open, which may require lowering /proc/sys/kernel/perf_event_paranoid; without
+ * it only the times are reported.
+ */
+
+#include <jp/ordered_set.hpp>
+#include <jp/huge_page_allocator.hpp>
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+namespace {
+
+class dtlb_counter
+{
+public:
+    dtlb_counter()
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~dtlb_counter()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    bool available() const { return m_fd >= 0; }
+
+    void start()
+    {
+        if (m_fd < 0)
+            return;
+        ::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    std::uint64_t stop()
+    {
+        std::uint64_t value = 0;
+        if (m_fd < 0)
+            return value;
+        ::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (::read(m_fd, &value, sizeof(value)) != sizeof(value))
+            value = 0;
+        return value;
+    }
+
+private:
+    int m_fd;
+};
+
+template<typename Set>
+void run(const char* name, Set set, const std::vector<std::uint64_t>& keys, const std::vector<std::uint64_t>& queries)
+{
+    for (std::uint64_t key : keys)
+        set.insert(key);
+
+    dtlb_counter counter;
+    auto begin = std::chrono::steady_clock::now();
+    counter.start();
+    size_t found = 0;
+    for (std::uint64_t key : queries)
+        found += set.find(key) != set.end();
+    std::uint64_t misses = counter.stop();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
+
+    std::printf("%-24s %10.1f ms", name, elapsed.count());
+    if (counter.available())
+        std::printf("  %14llu dTLB misses  %6.3f per lookup", static_cast<unsigned long long>(misses),
+                    static_cast<double>(misses) / static_cast<double>(queries.size()));
+    std::printf("  (found %zu)\n", found);
+}
+
+} //!namespace
+
+int main(int argc, char** argv)
+{
+    size_t n = 10000000;
+    size_t lookups = 10000000;
+    bool hugetlbfs = false;
+    std::vector<size_t*> positional{&n, &lookups};
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--hugetlbfs")
+            hugetlbfs = true;
+        else if (!positional.empty()) {
+            *positional.front() = std::stoull(argv[i]);
+            positional.erase(positional.begin());
+        }
+    }
+
+    // keys inserted in random order, so that neighbours in the tree are not neighbours in memory
+    std::mt19937_64 rng{2020};
+    std::vector<std::uint64_t> keys(n);
+    std::iota(keys.begin(), keys.end(), std::uint64_t{0});
+    std::shuffle(keys.begin(), keys.end(), rng);
+    std::vector<std::uint64_t> queries(lookups);
+    for (std::uint64_t& key : queries)
+        key = rng() % (2 * n + 1);
+
+    using alloc = jp::huge_page_allocator<std::uint64_t>;
+    run("std::allocator", jp::ordered_set<std::uint64_t>{}, keys, queries);
+    alloc huge{hugetlbfs};
+    run(hugetlbfs ? "huge_page_allocator (hugetlbfs)" : "huge_page_allocator",
+        jp::ordered_set<std::uint64_t, std::less<std::uint64_t>, alloc>{huge}, keys, queries);
+    std::printf("arena: %zu MB mapped, %zu MB from hugetlbfs\n", huge.arena().reserved() >> 20,
+                huge.arena().hugetlbfs_bytes() >> 20);
+}
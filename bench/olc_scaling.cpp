@@ -0,0 +1,129 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Measures how olc_ordered_set and an ordered_set behind a shared mutex scale from 1 to 64 threads, for a read-mostly
+ * mix (90% order_of_key and find, 10% insert and erase) and a write-heavy one (50% updates).
+ *
+ *     olc_scaling [operations per thread = 1000000] [keys = 1000000]
+ */
+
+#include <jp/ordered_set.hpp>
+#include <jp/olc_ordered_set.hpp>
+
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <shared_mutex>
+
+namespace {
+
+struct locked_set
+{
+    bool insert(std::uint64_t key)
+    {
+        std::unique_lock<std::shared_mutex> lock{mutex};
+        return set.insert(key).second;
+    }
+
+    size_t erase(std::uint64_t key)
+    {
+        std::unique_lock<std::shared_mutex> lock{mutex};
+        size_t before = set.size();
+        set.erase(key);
+        return before - set.size();
+    }
+
+    bool contains(std::uint64_t key)
+    {
+        std::shared_lock<std::shared_mutex> lock{mutex};
+        return set.contains(key);
+    }
+
+    size_t order_of_key(std::uint64_t key)
+    {
+        std::shared_lock<std::shared_mutex> lock{mutex};
+        return set.order_of_key(key);
+    }
+
+    std::shared_mutex mutex;
+    jp::ordered_set<std::uint64_t> set;
+};
+
+template<typename Set>
+double run(size_t threads, unsigned update_percent, size_t operations, size_t keys)
+{
+    Set set;
+    for (size_t key = 0; key < keys; key += 2)
+        set.insert(key);
+
+    std::vector<std::thread> workers;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&set, t, update_percent, operations, keys] {
+            std::mt19937_64 rng{t};
+            size_t sink = 0;
+            for (size_t i = 0; i < operations; i++) {
+                std::uint64_t key = rng() % keys;
+                unsigned dice = static_cast<unsigned>(rng() % 100);
+                if (dice < update_percent / 2)
+                    sink += set.insert(key);
+                else if (dice < update_percent)
+                    sink += set.erase(key);
+                else if (dice % 2 == 0)
+                    sink += set.contains(key);
+                else
+                    sink += set.order_of_key(key);
+            }
+            if (sink == SIZE_MAX)
+                std::printf("\n");
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    return static_cast<double>(threads * operations) / elapsed.count() / 1e6;
+}
+
+} //!namespace
+
+int main(int argc, char** argv)
+{
+    size_t operations = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    size_t keys = argc > 2 ? std::stoull(argv[2]) : 1000000;
+
+    std::printf("%8s %8s %16s %16s\n", "threads", "updates", "mutex Mops/s", "olc Mops/s");
+    for (unsigned updates : {10u, 50u}) {
+        for (size_t threads = 1; threads <= 64; threads *= 2) {
+            double locked = run<locked_set>(threads, updates, operations, keys);
+            double olc = run<jp::olc_ordered_set<std::uint64_t>>(threads, updates, operations, keys);
+            std::printf("%8zu %7u%% %16.2f %16.2f\n", threads, updates, locked, olc);
+        }
+    }
+}
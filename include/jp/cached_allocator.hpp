@@ -0,0 +1,84 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <type_traits>
+
+#include "detail/node_cache.hpp"
+
+namespace jp {
+
+/**
+ * A stateless allocator drawing single objects from the per-thread caches of detail::node_cache, shared by all
+ * containers with nodes of the same size class. Meant for the node based containers, e.g.
+ * 'ordered_set<Key, std::less<Key>, cached_allocator<Key>>', whose construction and destruction then mostly pops and
+ * pushes thread-local free lists. Arrays and over-aligned types go to std::allocator.
+ */
+template<typename T>
+class cached_allocator
+{
+public:
+    using value_type = T;
+    using is_always_equal = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    cached_allocator() noexcept = default;
+    template<typename U>
+    cached_allocator(const cached_allocator<U>&) noexcept { }
+
+    T* allocate(size_t n);
+    void deallocate(T* p, size_t n) noexcept;
+
+    template<typename U>
+    bool operator==(const cached_allocator<U>&) const noexcept { return true; }
+    template<typename U>
+    bool operator!=(const cached_allocator<U>&) const noexcept { return false; }
+
+private:
+    static constexpr bool CACHED = detail::node_cache::cacheable(sizeof(T), alignof(T));
+};
+
+
+template<typename T> inline
+T* cached_allocator<T>::allocate(size_t n)
+{
+    if (CACHED && n == 1)
+        return static_cast<T*>(detail::node_cache::allocate(sizeof(T)));
+    return std::allocator<T>{}.allocate(n);
+}
+
+template<typename T> inline
+void cached_allocator<T>::deallocate(T* p, size_t n) noexcept
+{
+    if (CACHED && n == 1)
+        detail::node_cache::deallocate(p, sizeof(T));
+    else
+        std::allocator<T>{}.deallocate(p, n);
+}
+
+} //!jp
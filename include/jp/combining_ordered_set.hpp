@@ -0,0 +1,265 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <functional>
+
+#include "ordered_set.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A thread-safe ordered set built on flat combining, see 'Flat Combining and the Synchronization-Parallelism
+ * Tradeoff' by D. Hendler, I. Incze, N. Shavit and M. Tzafrir. Instead of every thread taking a lock around its own
+ * operation, a thread posts the operation to a slot of the publication array and whichever thread gets the combiner
+ * lock applies all pending operations at once, while the others spin on their own slot. The lock and the tree stay
+ * in the cache of one core for a whole batch instead of bouncing between cores on every operation.
+ *
+ * Pending operations are concurrent, so they may be applied in any order. The combiner sorts them by key, so a batch
+ * is one sweep through the tree and consecutive descents share their upper levels in the cache.
+ *
+ * Slots are not owned by threads, a thread claims any free slot per operation starting from a thread-local hint, so
+ * any number of threads may use the set, but at most slot_count() operations are pending at a time.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class combining_ordered_set
+{
+    enum class operation : std::uint8_t { INSERT, ERASE, CONTAINS, ORDER_OF_KEY };
+
+    enum : std::uint32_t { EMPTY, CLAIMED, PENDING, DONE };
+
+    struct alignas(64) slot
+    {
+        std::atomic<std::uint32_t> state{EMPTY};
+        operation op;
+        const Key* key;
+        size_t result;
+        std::exception_ptr error;
+    };
+
+public:
+    explicit combining_ordered_set(size_t slots = 0);
+    combining_ordered_set(const combining_ordered_set&) = delete;
+    combining_ordered_set& operator=(const combining_ordered_set&) = delete;
+    ~combining_ordered_set() = default;
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    bool contains(const Key& key) const;
+    size_t order_of_key(const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+    size_t slot_count() const;
+
+private:
+    size_t apply(operation op, const Key& key) const;
+    slot& claim() const;
+    void collect() const noexcept;
+    void combine() const noexcept;
+
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    static constexpr size_t MIN_SLOTS = 64;
+    const size_t m_slot_count;
+    const std::unique_ptr<slot[]> m_slots;
+    mutable std::mutex m_combiner;
+    mutable std::vector<slot*> m_batch;
+    mutable ordered_set<Key, Cmp_Fn> m_set;
+    mutable std::atomic<size_t> m_size;
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+/**
+ * Creates the given number of slots, by default twice the number of hardware threads but at least MIN_SLOTS.
+ */
+template<typename Key, typename CmpFn> inline
+combining_ordered_set<Key, CmpFn>::combining_ordered_set(size_t slots)
+    : m_slot_count{slots != 0 ? slots : std::max<size_t>(MIN_SLOTS, 2 * std::thread::hardware_concurrency())}
+    , m_slots{new slot[m_slot_count]}
+    , m_combiner{}
+    , m_batch{}
+    , m_set{}
+    , m_size{0}
+{
+    m_batch.reserve(m_slot_count);
+}
+
+template<typename Key, typename CmpFn> inline
+bool combining_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    return apply(operation::INSERT, key) != 0;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t combining_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    return apply(operation::ERASE, key);
+}
+
+template<typename Key, typename CmpFn> inline
+bool combining_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    return apply(operation::CONTAINS, key) != 0;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t combining_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    return apply(operation::ORDER_OF_KEY, key);
+}
+
+/**
+ * Returns the size after the last applied batch.
+ */
+template<typename Key, typename CmpFn> inline
+size_t combining_ordered_set<Key, CmpFn>::size() const
+{
+    return m_size.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename CmpFn> inline
+bool combining_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t combining_ordered_set<Key, CmpFn>::slot_count() const
+{
+    return m_slot_count;
+}
+
+/**
+ * Posts the operation and waits until some combiner, possibly this thread, has applied it. The key is only
+ * referenced by the slot, it stays alive since the caller waits.
+ */
+template<typename Key, typename CmpFn>
+size_t combining_ordered_set<Key, CmpFn>::apply(operation op, const Key& key) const
+{
+    slot& s = claim();
+    s.op = op;
+    s.key = &key;
+    s.state.store(PENDING, std::memory_order_release);
+    for (unsigned spins = 0; s.state.load(std::memory_order_acquire) != DONE; spins++) {
+        std::unique_lock<std::mutex> lock{m_combiner, std::try_to_lock};
+        if (lock.owns_lock())
+            combine();
+        else if (spins % 64 == 63)
+            std::this_thread::yield();
+    }
+    size_t result = s.result;
+    std::exception_ptr error = std::move(s.error);
+    s.error = nullptr;
+    s.state.store(EMPTY, std::memory_order_release);
+    if (error)
+        std::rethrow_exception(error);
+    return result;
+}
+
+template<typename Key, typename CmpFn>
+typename combining_ordered_set<Key, CmpFn>::slot& combining_ordered_set<Key, CmpFn>::claim() const
+{
+    static thread_local size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (size_t n = 1, i = hint % m_slot_count;; n++, i = (i + 1) % m_slot_count) {
+        std::uint32_t expected = EMPTY;
+        if (m_slots[i].state.load(std::memory_order_relaxed) == EMPTY
+                && m_slots[i].state.compare_exchange_strong(expected, CLAIMED, std::memory_order_acquire)) {
+            hint = i;
+            return m_slots[i];
+        }
+        if (n % m_slot_count == 0)
+            std::this_thread::yield();
+    }
+}
+
+/**
+ * Gathers the pending slots into the batch, whose capacity is reserved for all of them.
+ */
+template<typename Key, typename CmpFn> inline
+void combining_ordered_set<Key, CmpFn>::collect() const noexcept
+{
+    m_batch.clear();
+    for (size_t i = 0; i < m_slot_count; i++)
+        if (m_slots[i].state.load(std::memory_order_acquire) == PENDING)
+            m_batch.push_back(&m_slots[i]);
+}
+
+/**
+ * Applies all pending operations in key order, must be called with the combiner lock held. Never throws: an exception
+ * thrown by an operation is stored in its slot and rethrown by the thread waiting on it. If the comparator throws while
+ * the batch is sorted, the batch is applied in slot order instead.
+ */
+template<typename Key, typename CmpFn>
+void combining_ordered_set<Key, CmpFn>::combine() const noexcept
+{
+    collect();
+    try {
+        std::sort(m_batch.begin(), m_batch.end(), [](const slot* a, const slot* b) { return CMP(*a->key, *b->key); });
+    } catch (...) {
+        // a throwing comparator leaves the batch in an unspecified order, possibly with duplicates
+        collect();
+    }
+    for (slot* s : m_batch) {
+        try {
+            switch (s->op) {
+            case operation::INSERT:
+                s->result = m_set.insert(*s->key).second;
+                break;
+            case operation::ERASE: {
+                size_t before = m_set.size();
+                m_set.erase(*s->key);
+                s->result = before - m_set.size();
+                break;
+            }
+            case operation::CONTAINS:
+                s->result = m_set.contains(*s->key);
+                break;
+            case operation::ORDER_OF_KEY:
+                s->result = m_set.order_of_key(*s->key);
+                break;
+            }
+        } catch (...) {
+            s->error = std::current_exception();
+        }
+    }
+    m_size.store(m_set.size(), std::memory_order_release);
+    for (slot* s : m_batch)
+        s->state.store(DONE, std::memory_order_release);
+}
+
+} //!jp
@@ -0,0 +1,219 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cmath>
+#include <cassert>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+namespace jp {
+namespace detail {
+
+/**
+ * Counters describing the work done by a filter.
+ */
+struct filter_stats
+{
+    size_t queries;         // lookups that consulted the filter
+    size_t negatives;       // lookups answered by the filter alone
+    size_t false_positives; // lookups passed on to the tree that found nothing
+    size_t keys;            // keys currently counted in the filter
+    size_t capacity;        // keys the filter was sized for
+    size_t counters;
+    size_t hashes;
+    size_t bytes;
+    double expected_fpr;    // false positive rate expected for the current number of keys
+};
+
+/**
+ * A counting Bloom filter with 8 bit counters, so keys can be removed as well as added. A counter that reaches 255
+ * sticks there, which can only cause false positives, never false negatives. The number of counters is derived from
+ * the requested false positive rate at the given capacity and then capped by the memory budget, the number of hash
+ * functions is chosen for the resulting number of counters per key. The hashes are generated from a single std::hash
+ * call by double hashing.
+ */
+template<
+        typename Key,
+        typename Hash = std::hash<Key>
+        >
+class counting_filter
+{
+public:
+    counting_filter(size_t capacity, double fpr, size_t max_bytes);
+    void reset(size_t capacity);
+    bool may_contain(const Key& key) const;
+    void insert(const Key& key);
+    void erase(const Key& key);
+    void clear();
+    void record_false_positive() const;
+    size_t count() const;
+    size_t capacity() const;
+    double fpr() const;
+    size_t max_bytes() const;
+    filter_stats stats() const;
+
+private:
+    template<typename Fn>
+    bool for_each_counter(const Key& key, Fn fn) const;
+
+    static constexpr size_t MIN_COUNTERS = 64;
+    static constexpr size_t MAX_HASHES = 16;
+    static constexpr std::uint8_t SATURATED = 255;
+    std::vector<std::uint8_t> m_counters;
+    double m_fpr;
+    size_t m_max_bytes;
+    size_t m_hashes;
+    size_t m_capacity;
+    size_t m_count;
+    mutable size_t m_queries;
+    mutable size_t m_negatives;
+    mutable size_t m_false_positives;
+};
+
+
+template<typename Key, typename Hash>
+counting_filter<Key, Hash>::counting_filter(size_t capacity, double fpr, size_t max_bytes)
+    : m_fpr{fpr}
+    , m_max_bytes{max_bytes}
+    , m_hashes{1}
+    , m_capacity{0}
+    , m_count{0}
+    , m_queries{0}
+    , m_negatives{0}
+    , m_false_positives{0}
+{
+    assert(0 < fpr && fpr < 1);
+    reset(capacity);
+}
+
+/**
+ * Sizes the filter for the given number of keys and empties it, the statistics are kept.
+ */
+template<typename Key, typename Hash>
+void counting_filter<Key, Hash>::reset(size_t capacity)
+{
+    const double ln2 = std::log(2.0);
+    m_capacity = std::max<size_t>(capacity, 1);
+    double wanted = std::ceil(-static_cast<double>(m_capacity) * std::log(m_fpr) / (ln2 * ln2));
+    size_t counters = std::max(MIN_COUNTERS, std::min(static_cast<size_t>(wanted), m_max_bytes));
+    double per_key = static_cast<double>(counters) / static_cast<double>(m_capacity);
+    m_hashes = std::clamp<size_t>(static_cast<size_t>(std::lround(per_key * ln2)), 1, MAX_HASHES);
+    m_counters.assign(counters, 0);
+    m_count = 0;
+}
+
+template<typename Key, typename Hash> inline
+bool counting_filter<Key, Hash>::may_contain(const Key& key) const
+{
+    m_queries++;
+    bool present = for_each_counter(key, [this](size_t i) { return m_counters[i] != 0; });
+    if (!present)
+        m_negatives++;
+    return present;
+}
+
+template<typename Key, typename Hash> inline
+void counting_filter<Key, Hash>::insert(const Key& key)
+{
+    for_each_counter(key, [this](size_t i) { m_counters[i] += (m_counters[i] != SATURATED); return true; });
+    m_count++;
+}
+
+template<typename Key, typename Hash> inline
+void counting_filter<Key, Hash>::erase(const Key& key)
+{
+    for_each_counter(key, [this](size_t i) { m_counters[i] -= (m_counters[i] != SATURATED); return true; });
+    m_count--;
+}
+
+template<typename Key, typename Hash> inline
+void counting_filter<Key, Hash>::clear()
+{
+    std::fill(m_counters.begin(), m_counters.end(), 0);
+    m_count = 0;
+}
+
+template<typename Key, typename Hash> inline
+void counting_filter<Key, Hash>::record_false_positive() const
+{
+    m_false_positives++;
+}
+
+template<typename Key, typename Hash> inline
+size_t counting_filter<Key, Hash>::count() const
+{
+    return m_count;
+}
+
+template<typename Key, typename Hash> inline
+size_t counting_filter<Key, Hash>::capacity() const
+{
+    return m_capacity;
+}
+
+template<typename Key, typename Hash> inline
+double counting_filter<Key, Hash>::fpr() const
+{
+    return m_fpr;
+}
+
+template<typename Key, typename Hash> inline
+size_t counting_filter<Key, Hash>::max_bytes() const
+{
+    return m_max_bytes;
+}
+
+template<typename Key, typename Hash>
+filter_stats counting_filter<Key, Hash>::stats() const
+{
+    double m = static_cast<double>(m_counters.size());
+    double k = static_cast<double>(m_hashes);
+    double fpr = std::pow(1 - std::exp(-k * static_cast<double>(m_count) / m), k);
+    return filter_stats{m_queries, m_negatives, m_false_positives, m_count, m_capacity, m_counters.size(), m_hashes,
+                        m_counters.size() * sizeof(std::uint8_t), fpr};
+}
+
+template<typename Key, typename Hash>
+template<typename Fn> inline
+bool counting_filter<Key, Hash>::for_each_counter(const Key& key, Fn fn) const
+{
+    // stops as soon as fn returns false, so a miss usually reads only a couple of counters
+    // the i-th hash is h1 + i * h2, see 'Less Hashing, Same Performance' by A. Kirsch and M. Mitzenmacher
+    std::uint64_t h = static_cast<std::uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+    std::uint64_t h1 = h ^ (h >> 29);
+    std::uint64_t h2 = (h >> 32) | 1;
+    const std::uint64_t m = m_counters.size();
+    for (size_t i = 0; i < m_hashes; i++)
+        if (!fn(static_cast<size_t>((h1 + i * h2) % m)))
+            return false;
+    return true;
+}
+
+} //!detail
+} //!jp
@@ -0,0 +1,218 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace jp {
+namespace detail {
+
+/**
+ * Continues the 64-bit FNV-1a hash of the bytes from the given state, used to detect torn and corrupted records.
+ */
+inline std::uint64_t checksum(const void* data, size_t size, std::uint64_t state = 0xcbf29ce484222325ull)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        state ^= p[i];
+        state *= 0x100000001b3ull;
+    }
+    return state;
+}
+
+/**
+ * An owned file descriptor with the few operations the write-ahead log and the checkpoints need. Errors throw
+ * std::system_error.
+ */
+class durable_file
+{
+public:
+    durable_file();
+    durable_file(const std::string& path, int flags);
+    durable_file(const durable_file&) = delete;
+    durable_file(durable_file&& other);
+    durable_file& operator=(const durable_file&) = delete;
+    durable_file& operator=(durable_file&& other);
+    ~durable_file();
+
+    bool is_open() const;
+    void write(const void* data, size_t size);
+    size_t read(void* data, size_t size);
+    void sync();
+    void truncate(std::uint64_t size);
+    std::uint64_t size() const;
+
+    static bool exists(const std::string& path);
+    static void make_directory(const std::string& path);
+    static void sync_directory(const std::string& path);
+    static void replace(const std::string& from, const std::string& to, const std::string& directory);
+
+private:
+    int m_fd;
+};
+
+
+inline durable_file::durable_file()
+    : m_fd{-1}
+{ }
+
+inline durable_file::durable_file(const std::string& path, int flags)
+    : m_fd{::open(path.c_str(), flags | O_CLOEXEC, 0644)}
+{
+    if (m_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::open " + path);
+}
+
+inline durable_file::durable_file(durable_file&& other)
+    : m_fd{std::exchange(other.m_fd, -1)}
+{ }
+
+inline durable_file& durable_file::operator=(durable_file&& other)
+{
+    if (this != &other) {
+        if (m_fd >= 0)
+            ::close(m_fd);
+        m_fd = std::exchange(other.m_fd, -1);
+    }
+    return *this;
+}
+
+inline durable_file::~durable_file()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+inline bool durable_file::is_open() const
+{
+    return m_fd >= 0;
+}
+
+inline void durable_file::write(const void* data, size_t size)
+{
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(m_fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "jp::durable_file::write");
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+/**
+ * Reads up to size bytes, fewer only at the end of the file.
+ */
+inline size_t durable_file::read(void* data, size_t size)
+{
+    char* p = static_cast<char*>(data);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(m_fd, p + done, size - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "jp::durable_file::read");
+        if (n == 0)
+            break;
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+inline void durable_file::sync()
+{
+    if (::fdatasync(m_fd) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::sync");
+}
+
+inline void durable_file::truncate(std::uint64_t size)
+{
+    if (::ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::truncate");
+}
+
+inline std::uint64_t durable_file::size() const
+{
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::size");
+    return static_cast<std::uint64_t>(st.st_size);
+}
+
+inline bool durable_file::exists(const std::string& path)
+{
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+}
+
+/**
+ * Creates the directory unless it exists and makes its entry durable by syncing the parent directory. The parent is
+ * synced also if the directory exists, a crash may have come between an earlier mkdir and its sync.
+ */
+inline void durable_file::make_directory(const std::string& path)
+{
+    if (::mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::make_directory " + path);
+    std::string::size_type end = path.find_last_not_of('/');
+    if (end == std::string::npos)
+        return; // the root
+    std::string::size_type slash = path.rfind('/', end);
+    sync_directory(slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash));
+}
+
+/**
+ * Makes the entries of the directory durable, i.e. files created, renamed or removed in it.
+ */
+inline void durable_file::sync_directory(const std::string& path)
+{
+    durable_file dir{path, O_RDONLY | O_DIRECTORY};
+    if (::fsync(dir.m_fd) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::sync_directory " + path);
+}
+
+/**
+ * Atomically replaces the file to by the file from and makes the rename itself durable.
+ */
+inline void durable_file::replace(const std::string& from, const std::string& to, const std::string& directory)
+{
+    if (::rename(from.c_str(), to.c_str()) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::durable_file::replace " + to);
+    sync_directory(directory);
+}
+
+} //!detail
+} //!jp
@@ -0,0 +1,174 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+namespace jp {
+namespace detail {
+
+template<typename T, typename = void>
+struct is_hashable : std::false_type { };
+
+template<typename T>
+struct is_hashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T&>()))>> : std::true_type { };
+
+/**
+ * An open-addressing hash table mapping keys to the tree nodes holding them. Uses linear probing with backward shift
+ * deletion, so there are no tombstones, and keeps the load factor at most 1/2. Keys are compared for equivalence
+ * with Cmp_Fn, like in the tree, so Hash has to be consistent with it.
+ */
+template<
+        typename Node,
+        typename Key,
+        typename Cmp_Fn,
+        typename Hash = std::hash<Key>
+        >
+class hash_index
+{
+    struct slot
+    {
+        size_t hash;
+        Node* node;
+    };
+
+public:
+    hash_index();
+    Node* find(const Key& key) const;
+    void insert(Node* x);
+    void erase(Node* x);
+    size_t size() const;
+    void clear();
+
+private:
+    static size_t hash(const Key& key);
+    void grow();
+
+    static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    std::vector<slot> m_slots;
+    size_t m_count;
+};
+
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+hash_index<Node, Key, CmpFn, Hash>::hash_index()
+    : m_slots(MIN_CAPACITY, slot{0, nullptr})
+    , m_count{0}
+{ }
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+Node* hash_index<Node, Key, CmpFn, Hash>::find(const Key& key) const
+{
+    const size_t mask = m_slots.size() - 1;
+    const size_t h = hash(key);
+    for (size_t i = h & mask; m_slots[i].node != nullptr; i = (i + 1) & mask) {
+        const slot& s = m_slots[i];
+        if (s.hash == h && !CMP(s.node->key, key) && !CMP(key, s.node->key))
+            return s.node;
+    }
+    return nullptr;
+}
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+void hash_index<Node, Key, CmpFn, Hash>::insert(Node* x)
+{
+    if (2 * (m_count + 1) > m_slots.size())
+        grow();
+    const size_t mask = m_slots.size() - 1;
+    const size_t h = hash(x->key);
+    size_t i = h & mask;
+    while (m_slots[i].node != nullptr)
+        i = (i + 1) & mask;
+    m_slots[i] = slot{h, x};
+    m_count++;
+}
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+void hash_index<Node, Key, CmpFn, Hash>::erase(Node* x)
+{
+    const size_t mask = m_slots.size() - 1;
+    size_t i = hash(x->key) & mask;
+    while (m_slots[i].node != x) {
+        if (m_slots[i].node == nullptr)
+            return;
+        i = (i + 1) & mask;
+    }
+    // shift back the following entries of the cluster which would not be reachable through the hole otherwise
+    for (size_t j = (i + 1) & mask; m_slots[j].node != nullptr; j = (j + 1) & mask) {
+        size_t home = m_slots[j].hash & mask;
+        bool reachable = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (!reachable) {
+            m_slots[i] = m_slots[j];
+            i = j;
+        }
+    }
+    m_slots[i] = slot{0, nullptr};
+    m_count--;
+}
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+size_t hash_index<Node, Key, CmpFn, Hash>::size() const
+{
+    return m_count;
+}
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+void hash_index<Node, Key, CmpFn, Hash>::clear()
+{
+    m_slots.assign(MIN_CAPACITY, slot{0, nullptr});
+    m_count = 0;
+}
+
+template<typename Node, typename Key, typename CmpFn, typename Hash> inline
+size_t hash_index<Node, Key, CmpFn, Hash>::hash(const Key& key)
+{
+    // std::hash of integers is the identity, mix the bits before taking the low ones as the slot
+    std::uint64_t h = static_cast<std::uint64_t>(Hash{}(key)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(h ^ (h >> 32));
+}
+
+template<typename Node, typename Key, typename CmpFn, typename Hash>
+void hash_index<Node, Key, CmpFn, Hash>::grow()
+{
+    std::vector<slot> old(2 * m_slots.size(), slot{0, nullptr});
+    old.swap(m_slots);
+    const size_t mask = m_slots.size() - 1;
+    for (const slot& s : old) {
+        if (s.node == nullptr)
+            continue;
+        size_t i = s.hash & mask;
+        while (m_slots[i].node != nullptr)
+            i = (i + 1) & mask;
+        m_slots[i] = s;
+    }
+}
+
+} //!detail
+} //!jp
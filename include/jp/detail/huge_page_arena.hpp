@@ -0,0 +1,243 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <new>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include "numa.hpp"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace jp {
+namespace detail {
+
+/**
+ * A bump allocator over chunks of memory aligned to HUGE_PAGE, so that the nodes of a large tree are packed into as
+ * few TLB entries as possible. On Linux the chunks are mapped anonymously and marked with MADV_HUGEPAGE for the
+ * transparent huge pages, or, if requested, mapped with MAP_HUGETLB from the preallocated hugetlbfs pool, falling
+ * back to the transparent huge pages when the pool is exhausted. Elsewhere the chunks come from the aligned operator
+ * new. Chunks start at HUGE_PAGE and double up to MAX_CHUNK, so small sets do not reserve much. Given a NUMA node,
+ * the chunks are bound to it before they are touched, so the nodes stay local to the threads running on that node.
+ *
+ * Freed blocks are kept in free lists segregated by size, as in node_cache, and the memory is returned to the system
+ * only when the arena is destroyed. The arena is not thread-safe.
+ */
+class huge_page_arena
+{
+public:
+    static constexpr size_t HUGE_PAGE = size_t{2} << 20;
+    static constexpr size_t MAX_CHUNK = size_t{256} << 20;
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_SIZE = 512;
+
+    explicit huge_page_arena(bool hugetlbfs = false, int numa_node = -1);
+    huge_page_arena(const huge_page_arena&) = delete;
+    huge_page_arena& operator=(const huge_page_arena&) = delete;
+    ~huge_page_arena();
+
+    static constexpr bool cacheable(size_t size, size_t alignment);
+    void* allocate(size_t size);
+    void deallocate(void* p, size_t size);
+    size_t reserved() const;
+    size_t hugetlbfs_bytes() const;
+    int numa_node() const;
+
+private:
+    static constexpr size_t CLASSES = MAX_SIZE / GRANULARITY;
+
+    struct block
+    {
+        block* next;
+    };
+
+    struct chunk
+    {
+        void* data;
+        size_t size;
+        bool hugetlbfs;
+    };
+
+    static size_t size_class(size_t size);
+    void grow(size_t min_size);
+    chunk map(size_t size);
+    static void unmap(const chunk& c);
+
+    std::array<block*, CLASSES> m_free;
+    std::vector<chunk> m_chunks;
+    char* m_next;
+    char* m_end;
+    bool m_hugetlbfs;
+    int m_numa_node;
+};
+
+
+inline huge_page_arena::huge_page_arena(bool hugetlbfs, int numa_node)
+    : m_free{}
+    , m_chunks{}
+    , m_next{nullptr}
+    , m_end{nullptr}
+    , m_hugetlbfs{hugetlbfs}
+    , m_numa_node{numa_node}
+{ }
+
+inline huge_page_arena::~huge_page_arena()
+{
+    for (const chunk& c : m_chunks)
+        unmap(c);
+}
+
+constexpr bool huge_page_arena::cacheable(size_t size, size_t alignment)
+{
+    return size <= MAX_SIZE && alignment <= GRANULARITY;
+}
+
+inline void* huge_page_arena::allocate(size_t size)
+{
+    size_t c = size_class(size);
+    if (block* b = m_free[c]) {
+        m_free[c] = b->next;
+        return b;
+    }
+    size_t bytes = (c + 1) * GRANULARITY;
+    if (static_cast<size_t>(m_end - m_next) < bytes)
+        grow(bytes);
+    void* p = m_next;
+    m_next += bytes;
+    return p;
+}
+
+inline void huge_page_arena::deallocate(void* p, size_t size)
+{
+    size_t c = size_class(size);
+    block* b = static_cast<block*>(p);
+    b->next = m_free[c];
+    m_free[c] = b;
+}
+
+/**
+ * Returns the number of bytes mapped by the arena.
+ */
+inline size_t huge_page_arena::reserved() const
+{
+    size_t total = 0;
+    for (const chunk& c : m_chunks)
+        total += c.size;
+    return total;
+}
+
+/**
+ * Returns the number of bytes mapped from the hugetlbfs pool, the rest relies on the transparent huge pages.
+ */
+inline size_t huge_page_arena::hugetlbfs_bytes() const
+{
+    size_t total = 0;
+    for (const chunk& c : m_chunks)
+        if (c.hugetlbfs)
+            total += c.size;
+    return total;
+}
+
+/**
+ * Returns the NUMA node the chunks are bound to, or -1 if they are placed by the first touch.
+ */
+inline int huge_page_arena::numa_node() const
+{
+    return m_numa_node;
+}
+
+inline size_t huge_page_arena::size_class(size_t size)
+{
+    return size == 0 ? 0 : (size - 1) / GRANULARITY;
+}
+
+/**
+ * The unused tail of the current chunk is abandoned, it is smaller than MAX_SIZE.
+ */
+inline void huge_page_arena::grow(size_t min_size)
+{
+    size_t size = m_chunks.empty() ? HUGE_PAGE : std::min(2 * m_chunks.back().size, MAX_CHUNK);
+    size = std::max(size, (min_size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE);
+    m_chunks.reserve(m_chunks.size() + 1);
+    m_chunks.push_back(map(size));
+    if (m_numa_node >= 0)
+        numa_bind(m_chunks.back().data, size, m_numa_node);
+    m_next = static_cast<char*>(m_chunks.back().data);
+    m_end = m_next + size;
+}
+
+#if defined(__linux__)
+
+inline huge_page_arena::chunk huge_page_arena::map(size_t size)
+{
+    if (m_hugetlbfs) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED)
+            return chunk{p, size, true};
+    }
+    // over-map by a huge page and trim both ends, so the kernel can back the whole chunk with huge pages
+    size_t mapped = size + HUGE_PAGE;
+    void* p = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        throw std::bad_alloc{};
+    char* begin = static_cast<char*>(p);
+    char* aligned = reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(begin) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    if (aligned != begin)
+        ::munmap(begin, static_cast<size_t>(aligned - begin));
+    if (aligned + size != begin + mapped)
+        ::munmap(aligned + size, static_cast<size_t>(begin + mapped - aligned - size));
+#if defined(MADV_HUGEPAGE)
+    ::madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    return chunk{aligned, size, false};
+}
+
+inline void huge_page_arena::unmap(const chunk& c)
+{
+    ::munmap(c.data, c.size);
+}
+
+#else
+
+inline huge_page_arena::chunk huge_page_arena::map(size_t size)
+{
+    return chunk{::operator new(size, std::align_val_t{HUGE_PAGE}), size, false};
+}
+
+inline void huge_page_arena::unmap(const chunk& c)
+{
+    ::operator delete(c.data, std::align_val_t{HUGE_PAGE});
+}
+
+#endif
+
+} //!detail
+} //!jp
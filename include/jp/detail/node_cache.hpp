@@ -0,0 +1,214 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <mutex>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace jp {
+namespace detail {
+
+/**
+ * Per-thread free lists of memory blocks segregated by size, rounded up to multiples of GRANULARITY. Blocks come from
+ * the global operator new, so a block freed by another thread than the one which allocated it simply joins the free
+ * list of the freeing thread. To keep a thread which only frees (e.g. the consumer of a queue of sets) from hoarding
+ * blocks, a free list longer than 2 * BATCH hands BATCH blocks over to a global pool, from which threads with an empty
+ * list take whole batches before falling back to operator new. A thread returns its lists to the pool when it exits,
+ * blocks allocated or freed by it later on (e.g. by the destructors of other thread_local objects) bypass the cache.
+ *
+ * Blocks larger than MAX_SIZE or with an alignment stricter than the one of operator new are not cached.
+ */
+class node_cache
+{
+public:
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_SIZE = 512;
+    static constexpr size_t BATCH = 64;
+
+    static constexpr bool cacheable(size_t size, size_t alignment);
+    static void* allocate(size_t size);
+    static void deallocate(void* p, size_t size);
+
+private:
+    static constexpr size_t CLASSES = MAX_SIZE / GRANULARITY;
+
+    struct block
+    {
+        block* next;
+    };
+
+    struct free_list
+    {
+        block* head = nullptr;
+        size_t count = 0;
+    };
+
+    class global_pool
+    {
+    public:
+        bool take(size_t size_class, free_list& list);
+        void give(size_t size_class, block* head, size_t count) noexcept;
+    private:
+        std::mutex m_mutex;
+        std::array<std::vector<std::pair<block*, size_t>>, CLASSES> m_batches;
+    };
+
+    struct local_cache
+    {
+        std::array<free_list, CLASSES> lists;
+        ~local_cache();
+    };
+
+    static size_t size_class(size_t size);
+    static global_pool& pool();
+    static local_cache& local();
+    static bool& local_destroyed();
+    static void release(block* head) noexcept;
+};
+
+
+constexpr bool node_cache::cacheable(size_t size, size_t alignment)
+{
+    return size <= MAX_SIZE && alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+}
+
+inline void* node_cache::allocate(size_t size)
+{
+    size_t c = size_class(size);
+    if (local_destroyed())
+        return ::operator new((c + 1) * GRANULARITY);
+    free_list& list = local().lists[c];
+    if (list.head == nullptr && !pool().take(c, list))
+        return ::operator new((c + 1) * GRANULARITY);
+    block* b = list.head;
+    list.head = b->next;
+    list.count--;
+    return b;
+}
+
+inline void node_cache::deallocate(void* p, size_t size)
+{
+    size_t c = size_class(size);
+    if (local_destroyed()) {
+        ::operator delete(p);
+        return;
+    }
+    free_list& list = local().lists[c];
+    block* b = static_cast<block*>(p);
+    b->next = list.head;
+    list.head = b;
+    if (++list.count > 2 * BATCH) {
+        block* last = list.head;
+        for (size_t i = 1; i < BATCH; i++)
+            last = last->next;
+        block* head = list.head;
+        list.head = last->next;
+        list.count -= BATCH;
+        last->next = nullptr;
+        pool().give(c, head, BATCH);
+    }
+}
+
+inline size_t node_cache::size_class(size_t size)
+{
+    return size == 0 ? 0 : (size - 1) / GRANULARITY;
+}
+
+/**
+ * The pool is never destroyed, as threads may still return their lists to it during static destruction.
+ */
+inline node_cache::global_pool& node_cache::pool()
+{
+    static global_pool* instance = new global_pool{};
+    return *instance;
+}
+
+inline node_cache::local_cache& node_cache::local()
+{
+    thread_local local_cache instance{};
+    return instance;
+}
+
+/**
+ * Set by the destructor of the thread's local_cache. Being trivially destructible the flag itself stays readable until
+ * the thread is gone.
+ */
+inline bool& node_cache::local_destroyed()
+{
+    thread_local bool destroyed = false;
+    return destroyed;
+}
+
+inline void node_cache::release(block* head) noexcept
+{
+    while (head != nullptr) {
+        block* next = head->next;
+        ::operator delete(head);
+        head = next;
+    }
+}
+
+inline bool node_cache::global_pool::take(size_t size_class, free_list& list)
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto& batches = m_batches[size_class];
+    if (batches.empty())
+        return false;
+    list.head = batches.back().first;
+    list.count = batches.back().second;
+    batches.pop_back();
+    return true;
+}
+
+/**
+ * Takes a null-terminated batch. Called from deallocate and thread exit, so it must not throw: if the batch cannot be
+ * stored its blocks go back to operator delete.
+ */
+inline void node_cache::global_pool::give(size_t size_class, block* head, size_t count) noexcept
+{
+    try {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        m_batches[size_class].emplace_back(head, count);
+        return;
+    } catch (...) { }
+    release(head);
+}
+
+inline node_cache::local_cache::~local_cache()
+{
+    for (size_t c = 0; c < CLASSES; c++) {
+        if (lists[c].head != nullptr)
+            pool().give(c, lists[c].head, lists[c].count);
+        lists[c] = free_list{};
+    }
+    local_destroyed() = true;
+}
+
+} //!detail
+} //!jp
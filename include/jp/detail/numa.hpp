@@ -0,0 +1,88 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <fstream>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+namespace jp {
+namespace detail {
+
+/**
+ * Returns the number of NUMA nodes, i.e. one more than the highest online node, or 1 where it cannot be determined.
+ */
+inline size_t numa_node_count()
+{
+    static const size_t count = [] {
+        std::ifstream in("/sys/devices/system/node/online");
+        std::string ranges;
+        if (!(in >> ranges))
+            return size_t{1};
+        size_t highest = 0;
+        size_t value = 0;
+        for (char c : ranges) {
+            if (c >= '0' && c <= '9') {
+                value = 10 * value + static_cast<size_t>(c - '0');
+            } else {
+                highest = std::max(highest, value);
+                value = 0;
+            }
+        }
+        return std::max(highest, value) + 1;
+    }();
+    return count;
+}
+
+/**
+ * Asks for the pages of the given range, which must be page aligned and not yet touched, to be placed on the given
+ * node. The policy is only a preference, so the allocation still succeeds when the node runs out of memory.
+ */
+inline bool numa_bind(void* p, size_t size, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    constexpr size_t BITS = 8 * sizeof(unsigned long);
+    if (node < 0 || static_cast<size_t>(node) >= 4 * BITS)
+        return false;
+    unsigned long mask[4] = {};
+    mask[static_cast<size_t>(node) / BITS] = 1ul << (static_cast<size_t>(node) % BITS);
+    return ::syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, 4 * BITS, 0) == 0;
+#else
+    (void)p;
+    (void)size;
+    (void)node;
+    return false;
+#endif
+}
+
+} //!detail
+} //!jp
@@ -0,0 +1,337 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace jp {
+namespace detail {
+
+/**
+ * A bounded cache of the fixed size pages of a file. Pages are pinned while a page_ref to them exists, the unpinned
+ * ones are evicted in the CLOCK order and written back if dirty. All I/O is done with pread and pwrite, errors throw
+ * std::system_error. The cache is not thread-safe.
+ */
+class page_cache
+{
+    struct frame
+    {
+        std::uint64_t id;
+        unsigned pins;
+        bool used;
+        bool dirty;
+        bool referenced;
+    };
+
+public:
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    /**
+     * Keeps a page pinned in the cache, the data stays valid until the reference is destroyed.
+     */
+    class page_ref
+    {
+        friend class page_cache;
+        page_ref(page_cache* cache, size_t frame);
+    public:
+        page_ref(const page_ref&) = delete;
+        page_ref(page_ref&& other);
+        page_ref& operator=(const page_ref&) = delete;
+        page_ref& operator=(page_ref&&) = delete;
+        ~page_ref();
+        char* data() const;
+        void mark_dirty();
+    private:
+        page_cache* m_cache;
+        size_t m_frame;
+    };
+
+    page_cache(const std::string& path, size_t capacity);
+    page_cache(const page_cache&) = delete;
+    page_cache& operator=(const page_cache&) = delete;
+    ~page_cache();
+
+    page_ref fetch(std::uint64_t id);
+    page_ref create(std::uint64_t id);
+    std::uint64_t file_pages() const;
+    void flush();
+    void sync();
+    void truncate();
+    size_t capacity() const;
+    size_t reads() const;
+    size_t writes() const;
+
+private:
+    size_t acquire(std::uint64_t id);
+    void read_page(std::uint64_t id, char* data);
+    void write_page(std::uint64_t id, const char* data);
+    char* frame_data(size_t frame);
+
+    int m_fd;
+    std::vector<frame> m_frames;
+    std::vector<std::uint64_t> m_memory;
+    std::unordered_map<std::uint64_t, size_t> m_lookup;
+    size_t m_hand;
+    size_t m_reads;
+    size_t m_writes;
+};
+
+
+inline page_cache::page_ref::page_ref(page_cache* cache, size_t frame)
+    : m_cache{cache}
+    , m_frame{frame}
+{
+    m_cache->m_frames[m_frame].pins++;
+}
+
+inline page_cache::page_ref::page_ref(page_ref&& other)
+    : m_cache{other.m_cache}
+    , m_frame{other.m_frame}
+{
+    other.m_cache = nullptr;
+}
+
+inline page_cache::page_ref::~page_ref()
+{
+    if (m_cache != nullptr)
+        m_cache->m_frames[m_frame].pins--;
+}
+
+inline char* page_cache::page_ref::data() const
+{
+    return m_cache->frame_data(m_frame);
+}
+
+inline void page_cache::page_ref::mark_dirty()
+{
+    m_cache->m_frames[m_frame].dirty = true;
+}
+
+/**
+ * Opens or creates the file, capacity is the number of cached pages.
+ */
+inline page_cache::page_cache(const std::string& path, size_t capacity)
+    : m_fd{-1}
+    , m_frames(std::max<size_t>(capacity, 1), frame{0, 0, false, false, false})
+    , m_memory(std::max<size_t>(capacity, 1) * PAGE_SIZE / sizeof(std::uint64_t))
+    , m_lookup{}
+    , m_hand{0}
+    , m_reads{0}
+    , m_writes{0}
+{
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "jp::page_cache::open " + path);
+}
+
+/**
+ * Writes back the dirty pages, errors are ignored here, call flush or sync before to see them.
+ */
+inline page_cache::~page_cache()
+{
+    try {
+        flush();
+    } catch (...) {
+    }
+    ::close(m_fd);
+}
+
+/**
+ * Returns the page, reading it from the file if it is not cached.
+ */
+inline page_cache::page_ref page_cache::fetch(std::uint64_t id)
+{
+    auto it = m_lookup.find(id);
+    if (it != m_lookup.end()) {
+        m_frames[it->second].referenced = true;
+        return page_ref{this, it->second};
+    }
+    size_t f = acquire(id);
+    try {
+        read_page(id, frame_data(f));
+    } catch (...) {
+        m_lookup.erase(id);
+        m_frames[f].used = false;
+        throw;
+    }
+    return page_ref{this, f};
+}
+
+/**
+ * Returns the page zeroed and dirty without reading it, for pages being (re)initialized.
+ */
+inline page_cache::page_ref page_cache::create(std::uint64_t id)
+{
+    auto it = m_lookup.find(id);
+    size_t f = it != m_lookup.end() ? it->second : acquire(id);
+    std::memset(frame_data(f), 0, PAGE_SIZE);
+    m_frames[f].dirty = true;
+    m_frames[f].referenced = true;
+    return page_ref{this, f};
+}
+
+/**
+ * Returns the number of whole pages in the file, not counting the ones only in the cache yet.
+ */
+inline std::uint64_t page_cache::file_pages() const
+{
+    off_t end = ::lseek(m_fd, 0, SEEK_END);
+    if (end < 0)
+        throw std::system_error(errno, std::generic_category(), "jp::page_cache::file_pages");
+    return static_cast<std::uint64_t>(end) / PAGE_SIZE;
+}
+
+/**
+ * Writes back all dirty pages in the order of the file.
+ */
+inline void page_cache::flush()
+{
+    std::vector<std::pair<std::uint64_t, size_t>> dirty;
+    for (size_t f = 0; f < m_frames.size(); f++)
+        if (m_frames[f].used && m_frames[f].dirty)
+            dirty.emplace_back(m_frames[f].id, f);
+    std::sort(dirty.begin(), dirty.end());
+    for (const auto& [id, f] : dirty) {
+        write_page(id, frame_data(f));
+        m_frames[f].dirty = false;
+    }
+}
+
+/**
+ * Writes back all dirty pages and waits until the file is on the device.
+ */
+inline void page_cache::sync()
+{
+    flush();
+    if (::fsync(m_fd) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::page_cache::sync");
+}
+
+/**
+ * Drops all cached pages without writing them and empties the file. No page may be pinned.
+ */
+inline void page_cache::truncate()
+{
+    for (frame& f : m_frames)
+        f = frame{0, 0, false, false, false};
+    m_lookup.clear();
+    if (::ftruncate(m_fd, 0) != 0)
+        throw std::system_error(errno, std::generic_category(), "jp::page_cache::truncate");
+}
+
+inline size_t page_cache::capacity() const
+{
+    return m_frames.size();
+}
+
+inline size_t page_cache::reads() const
+{
+    return m_reads;
+}
+
+inline size_t page_cache::writes() const
+{
+    return m_writes;
+}
+
+/**
+ * Assigns a frame to the page, evicting the first unpinned frame not referenced since the last pass of the hand.
+ */
+inline size_t page_cache::acquire(std::uint64_t id)
+{
+    for (size_t step = 0; step < 2 * m_frames.size() + 1; step++) {
+        size_t f = m_hand;
+        m_hand = (m_hand + 1) % m_frames.size();
+        frame& fr = m_frames[f];
+        if (fr.pins > 0)
+            continue;
+        if (fr.used && fr.referenced) {
+            fr.referenced = false;
+            continue;
+        }
+        if (fr.used) {
+            if (fr.dirty)
+                write_page(fr.id, frame_data(f));
+            m_lookup.erase(fr.id);
+        }
+        fr = frame{id, 0, true, false, true};
+        m_lookup.emplace(id, f);
+        return f;
+    }
+    throw std::length_error("jp::page_cache: all pages pinned");
+}
+
+inline void page_cache::read_page(std::uint64_t id, char* data)
+{
+    size_t done = 0;
+    while (done < PAGE_SIZE) {
+        ssize_t n = ::pread(m_fd, data + done, PAGE_SIZE - done, static_cast<off_t>(id * PAGE_SIZE + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "jp::page_cache::read");
+        if (n == 0)
+            break;
+        done += static_cast<size_t>(n);
+    }
+    // pages past the end of the file read as zeros
+    std::memset(data + done, 0, PAGE_SIZE - done);
+    m_reads++;
+}
+
+inline void page_cache::write_page(std::uint64_t id, const char* data)
+{
+    size_t done = 0;
+    while (done < PAGE_SIZE) {
+        ssize_t n = ::pwrite(m_fd, data + done, PAGE_SIZE - done, static_cast<off_t>(id * PAGE_SIZE + done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "jp::page_cache::write");
+        done += static_cast<size_t>(n);
+    }
+    m_writes++;
+}
+
+inline char* page_cache::frame_data(size_t frame)
+{
+    return reinterpret_cast<char*>(m_memory.data()) + frame * PAGE_SIZE;
+}
+
+} //!detail
+} //!jp
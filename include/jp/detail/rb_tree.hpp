@@ -0,0 +1,559 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+namespace jp {
+namespace detail {
+
+/**
+ * Key independent part of a red-black tree augmented with subtree sizes. The functions operate on rb_node headers
+ * embedded in the nodes of the containers, leaves are represented by nullptr and the root is passed by reference.
+ * Nothing here is a template, so the rebalancing code is shared by all key types and only the comparisons and the key
+ * storage are instantiated per container.
+ *
+ * Red-black tree implementation according to 'Introduction to Algorithms, Third Edition' by T. H. Cormen.
+ */
+struct rb_node
+{
+    size_t size;
+    rb_node* left;
+    rb_node* right;
+    rb_node* parent;
+    bool color;
+};
+
+constexpr bool RB_RED = 0;
+constexpr bool RB_BLACK = 1;
+
+/**
+ * Called with the two nodes of every rotation, x and its child y, before the rotation is done. Lets containers keeping
+ * lazy tags in the nodes push them below the rotated pair first. The functions modifying a tree take an optional hook
+ * after the journal.
+ */
+struct rb_hook
+{
+    void (*before_rotate)(const void* context, rb_node* x, rb_node* y);
+    const void* context;
+};
+
+/**
+ * An undo log of field writes. The functions modifying a tree take an optional journal and, when given one, record the
+ * old value of every field before overwriting it, so that rb_restore can bring the tree back. The fields of a node
+ * being inserted are not recorded, as the node is not reachable before the insertion.
+ *
+ * A journal with record unset and atomic set records nothing but turns every write into an atomic release store. It is
+ * meant for containers whose readers descend, loading the fields atomically, while the writer modifies the tree: the
+ * readers then neither race with the writer nor reach a node before the writes initializing it.
+ */
+struct rb_journal
+{
+    std::vector<std::pair<rb_node**, rb_node*>> links;
+    std::vector<std::pair<size_t*, size_t>> sizes;
+    std::vector<std::pair<bool*, bool>> colors;
+    bool record = true;
+    bool atomic = false;
+};
+
+template<typename T>
+inline void rb_store(rb_journal* log, T& field, T value)
+{
+    if (log != nullptr && log->atomic)
+        __atomic_store_n(&field, value, __ATOMIC_RELEASE);
+    else
+        field = value;
+}
+
+inline void rb_write(rb_journal* log, rb_node*& field, rb_node* value)
+{
+    if (log != nullptr && log->record)
+        log->links.emplace_back(&field, field);
+    rb_store(log, field, value);
+}
+
+inline void rb_write(rb_journal* log, size_t& field, size_t value)
+{
+    if (log != nullptr && log->record)
+        log->sizes.emplace_back(&field, field);
+    rb_store(log, field, value);
+}
+
+inline void rb_write(rb_journal* log, bool& field, bool value)
+{
+    if (log != nullptr && log->record)
+        log->colors.emplace_back(&field, field);
+    rb_store(log, field, value);
+}
+
+/**
+ * Undoes the writes recorded after the given lengths of the logs and truncates them.
+ */
+inline void rb_restore(rb_journal& log, size_t links, size_t sizes, size_t colors)
+{
+    // every kind of field is restored independently, as the logs never share an address
+    for (size_t i = log.links.size(); i-- > links; )
+        *log.links[i].first = log.links[i].second;
+    for (size_t i = log.sizes.size(); i-- > sizes; )
+        *log.sizes[i].first = log.sizes[i].second;
+    for (size_t i = log.colors.size(); i-- > colors; )
+        *log.colors[i].first = log.colors[i].second;
+    log.links.resize(links);
+    log.sizes.resize(sizes);
+    log.colors.resize(colors);
+}
+
+inline size_t rb_size(const rb_node* x)
+{
+    return x != nullptr ? x->size : 0;
+}
+
+inline bool rb_color(const rb_node* x)
+{
+    return x != nullptr ? x->color : RB_BLACK;
+}
+
+inline rb_node* rb_min(rb_node* x)
+{
+    if (x != nullptr)
+        while (x->left != nullptr)
+            x = x->left;
+    return x;
+}
+
+inline rb_node* rb_max(rb_node* x)
+{
+    if (x != nullptr)
+        while (x->right != nullptr)
+            x = x->right;
+    return x;
+}
+
+inline rb_node* rb_successor(rb_node* x)
+{
+    if (x->right != nullptr)
+        return rb_min(x->right);
+    while (x->parent != nullptr && x == x->parent->right)
+        x = x->parent;
+    return x->parent;
+}
+
+inline rb_node* rb_predecessor(rb_node* x)
+{
+    if (x->left != nullptr)
+        return rb_max(x->left);
+    while (x->parent != nullptr && x == x->parent->left)
+        x = x->parent;
+    return x->parent;
+}
+
+/**
+ * Returns the node of the given order or nullptr if there is no such node.
+ */
+inline rb_node* rb_select(rb_node* root, size_t order)
+{
+    if (order >= rb_size(root))
+        return nullptr;
+    rb_node* x = root;
+    size_t current = rb_size(x->left);
+    while (current != order) {
+        if (current > order) {
+            x = x->left;
+            current -= 1 + rb_size(x->right);
+        } else {
+            x = x->right;
+            current += 1 + rb_size(x->left);
+        }
+    }
+    return x;
+}
+
+/**
+ * Returns the order of x, climbing from x to the root.
+ */
+inline size_t rb_rank(const rb_node* x)
+{
+    size_t order = rb_size(x->left);
+    for (; x->parent != nullptr; x = x->parent)
+        if (x == x->parent->right)
+            order += rb_size(x->parent->left) + 1;
+    return order;
+}
+
+inline size_t rb_black_height(const rb_node* x)
+{
+    size_t bh = 0;
+    for (; x != nullptr; x = x->left)
+        bh += x->color == RB_BLACK;
+    return bh;
+}
+
+inline void rb_update_size(rb_node* start, rb_node* end, size_t value, rb_journal* log = nullptr)
+{
+    while (start != end) {
+        rb_write(log, start->size, start->size + value);
+        start = start->parent;
+    }
+}
+
+inline void rb_rotate_left(rb_node*& root, rb_node* x, rb_journal* log = nullptr, const rb_hook* hook = nullptr)
+{
+    rb_node* y = x->right;
+    if (hook != nullptr)
+        hook->before_rotate(hook->context, x, y);
+    rb_write(log, x->right, y->left);
+    if (y->left != nullptr)
+        rb_write(log, y->left->parent, x);
+    rb_write(log, y->parent, x->parent);
+    if (x->parent == nullptr)
+        rb_write(log, root, y);
+    else if (x == x->parent->left)
+        rb_write(log, x->parent->left, y);
+    else
+        rb_write(log, x->parent->right, y);
+    rb_write(log, y->left, x);
+    rb_write(log, x->parent, y);
+    rb_write(log, y->size, x->size);
+    rb_write(log, x->size, rb_size(x->left) + rb_size(x->right) + 1);
+}
+
+inline void rb_rotate_right(rb_node*& root, rb_node* x, rb_journal* log = nullptr, const rb_hook* hook = nullptr)
+{
+    rb_node* y = x->left;
+    if (hook != nullptr)
+        hook->before_rotate(hook->context, x, y);
+    rb_write(log, x->left, y->right);
+    if (y->right != nullptr)
+        rb_write(log, y->right->parent, x);
+    rb_write(log, y->parent, x->parent);
+    if (x->parent == nullptr)
+        rb_write(log, root, y);
+    else if (x == x->parent->left)
+        rb_write(log, x->parent->left, y);
+    else
+        rb_write(log, x->parent->right, y);
+    rb_write(log, y->right, x);
+    rb_write(log, x->parent, y);
+    rb_write(log, y->size, x->size);
+    rb_write(log, x->size, rb_size(x->left) + rb_size(x->right) + 1);
+}
+
+inline void rb_transplant(rb_node*& root, rb_node* u, rb_node* v, rb_journal* log = nullptr)
+{
+    if (u->parent == nullptr)
+        rb_write(log, root, v);
+    else if (u == u->parent->left)
+        rb_write(log, u->parent->left, v);
+    else
+        rb_write(log, u->parent->right, v);
+    if (v != nullptr)
+        rb_write(log, v->parent, u->parent);
+}
+
+/**
+ * Restores the red-black properties after z was linked as a red leaf. Leaves the root red if the fixup reaches it and
+ * returns true in such a case, callers decide whether the black height grows.
+ */
+inline bool rb_fixup_insert(rb_node*& root, rb_node* z, rb_journal* log = nullptr, const rb_hook* hook = nullptr)
+{
+    while (rb_color(z->parent) == RB_RED) {
+        rb_node* p = z->parent;
+        rb_node* g = p->parent;
+        if (p == g->left) {
+            rb_node* y = g->right;
+            if (rb_color(y) == RB_RED) {
+                rb_write(log, p->color, RB_BLACK);
+                rb_write(log, y->color, RB_BLACK);
+                rb_write(log, g->color, RB_RED);
+                z = g;
+            } else {
+                if (z == p->right) {
+                    z = p;
+                    rb_rotate_left(root, z, log, hook);
+                }
+                rb_write(log, z->parent->color, RB_BLACK);
+                rb_write(log, g->color, RB_RED);
+                rb_rotate_right(root, g, log, hook);
+            }
+        } else {
+            rb_node* y = g->left;
+            if (rb_color(y) == RB_RED) {
+                rb_write(log, p->color, RB_BLACK);
+                rb_write(log, y->color, RB_BLACK);
+                rb_write(log, g->color, RB_RED);
+                z = g;
+            } else {
+                if (z == p->left) {
+                    z = p;
+                    rb_rotate_right(root, z, log, hook);
+                }
+                rb_write(log, z->parent->color, RB_BLACK);
+                rb_write(log, g->color, RB_RED);
+                rb_rotate_left(root, g, log, hook);
+            }
+        }
+    }
+    return root->color == RB_RED;
+}
+
+/**
+ * Links z as the left or right child of parent (as the root if parent is nullptr) and rebalances the tree.
+ */
+inline void rb_insert(rb_node*& root, rb_node* parent, bool left, rb_node* z, rb_journal* log = nullptr,
+                      const rb_hook* hook = nullptr)
+{
+    z->size = 1;
+    z->left = nullptr;
+    z->right = nullptr;
+    z->parent = parent;
+    z->color = RB_RED;
+    if (parent == nullptr)
+        rb_write(log, root, z);
+    else if (left)
+        rb_write(log, parent->left, z);
+    else
+        rb_write(log, parent->right, z);
+    rb_update_size(parent, nullptr, 1, log);
+    if (rb_fixup_insert(root, z, log, hook))
+        rb_write(log, root->color, RB_BLACK);
+}
+
+inline void rb_fixup_erase(rb_node*& root, rb_node* x, rb_node* x_parent, rb_journal* log = nullptr,
+                           const rb_hook* hook = nullptr)
+{
+    while (x != root && rb_color(x) == RB_BLACK) {
+        if (x == x_parent->left) {
+            rb_node* w = x_parent->right;
+            if (rb_color(w) == RB_RED) {
+                rb_write(log, w->color, RB_BLACK);
+                rb_write(log, x_parent->color, RB_RED);
+                rb_rotate_left(root, x_parent, log, hook);
+                w = x_parent->right;
+            }
+            if (rb_color(w->left) == RB_BLACK && rb_color(w->right) == RB_BLACK) {
+                rb_write(log, w->color, RB_RED);
+                x = x_parent;
+                x_parent = x_parent->parent;
+            } else {
+                if (rb_color(w->right) == RB_BLACK) {
+                    rb_write(log, w->left->color, RB_BLACK);
+                    rb_write(log, w->color, RB_RED);
+                    rb_rotate_right(root, w, log, hook);
+                    w = x_parent->right;
+                }
+                rb_write(log, w->color, x_parent->color);
+                rb_write(log, x_parent->color, RB_BLACK);
+                rb_write(log, w->right->color, RB_BLACK);
+                rb_rotate_left(root, x_parent, log, hook);
+                x = root;
+            }
+        } else {
+            rb_node* w = x_parent->left;
+            if (rb_color(w) == RB_RED) {
+                rb_write(log, w->color, RB_BLACK);
+                rb_write(log, x_parent->color, RB_RED);
+                rb_rotate_right(root, x_parent, log, hook);
+                w = x_parent->left;
+            }
+            if (rb_color(w->right) == RB_BLACK && rb_color(w->left) == RB_BLACK) {
+                rb_write(log, w->color, RB_RED);
+                x = x_parent;
+                x_parent = x_parent->parent;
+            } else {
+                if (rb_color(w->left) == RB_BLACK) {
+                    rb_write(log, w->right->color, RB_BLACK);
+                    rb_write(log, w->color, RB_RED);
+                    rb_rotate_left(root, w, log, hook);
+                    w = x_parent->left;
+                }
+                rb_write(log, w->color, x_parent->color);
+                rb_write(log, x_parent->color, RB_BLACK);
+                rb_write(log, w->left->color, RB_BLACK);
+                rb_rotate_right(root, x_parent, log, hook);
+                x = root;
+            }
+        }
+    }
+    if (x != nullptr && x->color != RB_BLACK)
+        rb_write(log, x->color, RB_BLACK);
+}
+
+/**
+ * Unlinks z from the tree and rebalances it. The sizes of all ancestors of z have to be already decremented, z itself
+ * is not deallocated.
+ */
+inline void rb_unlink(rb_node*& root, rb_node* z, rb_journal* log = nullptr, const rb_hook* hook = nullptr)
+{
+    rb_node* y = z;
+    rb_node* x = nullptr;
+    rb_node* x_parent = nullptr;
+    bool y_original_color = y->color;
+    if (z->left == nullptr) {
+        x = z->right;
+        x_parent = z->parent;
+        rb_transplant(root, z, z->right, log);
+    } else if (z->right == nullptr) {
+        x = z->left;
+        x_parent = z->parent;
+        rb_transplant(root, z, z->left, log);
+    } else {
+        y = rb_min(z->right);
+        y_original_color = y->color;
+        x = y->right;
+        if (y->parent == z) {
+            x_parent = y;
+        } else {
+            x_parent = y->parent;
+            rb_update_size(y->parent, z, -1, log);
+            rb_transplant(root, y, y->right, log);
+            rb_write(log, y->right, z->right);
+            rb_write(log, y->right->parent, y);
+        }
+        rb_transplant(root, z, y, log);
+        rb_write(log, y->left, z->left);
+        rb_write(log, y->left->parent, y);
+        rb_write(log, y->color, z->color);
+        rb_write(log, y->size, z->size - 1);
+    }
+    if (y_original_color == RB_BLACK)
+        rb_fixup_erase(root, x, x_parent, log, hook);
+}
+
+/**
+ * Unlinks z from the tree and rebalances it, z itself is not deallocated.
+ */
+inline void rb_erase(rb_node*& root, rb_node* z, rb_journal* log = nullptr, const rb_hook* hook = nullptr)
+{
+    rb_update_size(z->parent, nullptr, -1, log);
+    rb_unlink(root, z, log, hook);
+}
+
+/**
+ * Joins two detached trees, all nodes of lhs preceding k and all nodes of rhs following it, by black height as
+ * described in 'Parallel Ordered Sets Using Join' by G. E. Blelloch, D. Ferizovic and Y. Sun. Runs in
+ * O(|lhs_bh - rhs_bh| + 1). Stores the result in root, which is also used while rebalancing, and its black height in
+ * bh. The root of the result is black.
+ */
+inline void rb_join(rb_node*& root, rb_node* lhs, size_t lhs_bh, rb_node* k, rb_node* rhs, size_t rhs_bh, size_t& bh,
+                    rb_journal* log = nullptr)
+{
+    if (rb_color(lhs) == RB_RED) {
+        rb_write(log, lhs->color, RB_BLACK);
+        lhs_bh++;
+    }
+    if (rb_color(rhs) == RB_RED) {
+        rb_write(log, rhs->color, RB_BLACK);
+        rhs_bh++;
+    }
+    if (lhs_bh == rhs_bh) {
+        rb_write(log, k->left, lhs);
+        rb_write(log, k->right, rhs);
+        rb_write(log, k->parent, nullptr);
+        rb_write(log, k->size, rb_size(lhs) + rb_size(rhs) + 1);
+        rb_write(log, k->color, RB_BLACK);
+        if (lhs != nullptr)
+            rb_write(log, lhs->parent, k);
+        if (rhs != nullptr)
+            rb_write(log, rhs->parent, k);
+        rb_write(log, root, k);
+        bh = lhs_bh + 1;
+        return;
+    }
+
+    rb_node* x = nullptr;
+    rb_node* y = nullptr;
+    rb_write(log, k->color, RB_RED);
+    if (lhs_bh > rhs_bh) {
+        rb_write(log, root, lhs);
+        x = lhs;
+        for (size_t h = lhs_bh; !(h == rhs_bh && rb_color(x) == RB_BLACK); x = x->right) {
+            h -= rb_color(x) == RB_BLACK;
+            y = x;
+        }
+        rb_write(log, k->left, x);
+        rb_write(log, k->right, rhs);
+        rb_write(log, y->right, k);
+        bh = lhs_bh;
+    } else {
+        rb_write(log, root, rhs);
+        x = rhs;
+        for (size_t h = rhs_bh; !(h == lhs_bh && rb_color(x) == RB_BLACK); x = x->left) {
+            h -= rb_color(x) == RB_BLACK;
+            y = x;
+        }
+        rb_write(log, k->left, lhs);
+        rb_write(log, k->right, x);
+        rb_write(log, y->left, k);
+        bh = rhs_bh;
+    }
+    rb_write(log, root->parent, nullptr);
+    rb_write(log, k->parent, y);
+    if (k->left != nullptr)
+        rb_write(log, k->left->parent, k);
+    if (k->right != nullptr)
+        rb_write(log, k->right->parent, k);
+    rb_write(log, k->size, rb_size(k->left) + rb_size(k->right) + 1);
+    rb_update_size(y, nullptr, rb_size(lhs_bh > rhs_bh ? rhs : lhs) + 1, log);
+    if (rb_fixup_insert(root, k, log)) {
+        rb_write(log, root->color, RB_BLACK);
+        bh++;
+    }
+}
+
+/**
+ * Splits the detached tree rooted at x into its first index nodes and the rest, reusing the nodes on the search path
+ * as the middle nodes of joins. Runs in O(log n). Not journaled, as the intermediate roots live in local variables.
+ */
+inline void rb_split(rb_node* x, size_t bh, size_t index, rb_node*& lhs, size_t& lhs_bh, rb_node*& rhs,
+                     size_t& rhs_bh)
+{
+    if (x == nullptr) {
+        lhs = rhs = nullptr;
+        lhs_bh = rhs_bh = 0;
+        return;
+    }
+    size_t child_bh = bh - (x->color == RB_BLACK);
+    rb_node* left = x->left;
+    rb_node* right = x->right;
+    if (left != nullptr)
+        left->parent = nullptr;
+    if (right != nullptr)
+        right->parent = nullptr;
+    rb_node* rest = nullptr;
+    size_t rest_bh = 0;
+    if (index <= rb_size(left)) {
+        rb_split(left, child_bh, index, lhs, lhs_bh, rest, rest_bh);
+        rb_join(rhs, rest, rest_bh, x, right, child_bh, rhs_bh);
+    } else {
+        rb_split(right, child_bh, index - rb_size(left) - 1, rest, rest_bh, rhs, rhs_bh);
+        rb_join(lhs, left, child_bh, x, rest, rest_bh, lhs_bh);
+    }
+}
+
+} //!detail
+} //!jp
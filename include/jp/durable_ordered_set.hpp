@@ -0,0 +1,577 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#include "ordered_set.hpp"
+#include "detail/durable_file.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A thread-safe ordered set kept in memory and made durable by a write-ahead log and checkpoints in a directory, so
+ * after a crash it is recovered locally instead of being rebuilt from its source.
+ *
+ * Every change is applied to the set and appended, with a sequence number and a checksum, to an in-memory log buffer
+ * under the lock of the set. Writers that need durability then take part in group commit: one of them writes and
+ * syncs everything buffered so far with a single fdatasync, while the others arriving meanwhile wait and are covered
+ * by the next sync, so the cost of a sync is shared by all concurrent writers. With sync_each_write false the writes
+ * return at once and the log is synced by commit, by a checkpoint or when the buffer grows to GROUP_BYTES.
+ *
+ * A checkpoint writes all keys in order to a snapshot file, replaces the previous one atomically and empties the log.
+ * It runs when the log exceeds checkpoint_bytes or on request and blocks the other calls while it lasts. The snapshot
+ * format is {magic, key size, count, sequence number, keys..., checksum}. Recovery streams the keys of the last
+ * snapshot into ordered_set::build_from_stream and replays the records of the log newer than the snapshot, up to the
+ * first torn or corrupted one, where the log is cut. A gap in the sequence numbers means lost records and throws
+ * std::runtime_error.
+ *
+ * Keys are written as bytes, hence they have to be trivially copyable. The set has to be opened with the same key
+ * type and Cmp_Fn. I/O errors throw std::system_error, the changes not yet synced are then of unknown durability. The
+ * records of a failed sync stay in memory and are written again, before any newer ones, by the next sync.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>,
+        typename Allocator = std::allocator<Key>
+        >
+class durable_ordered_set
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_default_constructible<Key>::value,
+                  "keys are written to the log and the snapshots as bytes");
+
+    enum operation : std::uint8_t
+    {
+        INSERT = 1,
+        ERASE = 2,
+        CLEAR = 3
+    };
+
+    struct snapshot_header
+    {
+        char magic[8];
+        std::uint64_t key_size;
+        std::uint64_t count;
+        std::uint64_t lsn;
+    };
+
+public:
+    using set_type = ordered_set<Key, Cmp_Fn, Allocator>;
+
+    static constexpr size_t GROUP_BYTES = size_t{1} << 16;
+    static constexpr size_t DEFAULT_CHECKPOINT_BYTES = size_t{64} << 20;
+
+    explicit durable_ordered_set(const std::string& directory, bool sync_each_write = true,
+                                 size_t checkpoint_bytes = DEFAULT_CHECKPOINT_BYTES);
+    durable_ordered_set(const durable_ordered_set&) = delete;
+    durable_ordered_set& operator=(const durable_ordered_set&) = delete;
+    ~durable_ordered_set();
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    void clear();
+    bool contains(const Key& key) const;
+    size_t order_of_key(const Key& key) const;
+    std::optional<Key> find_by_order(size_t order) const;
+    size_t size() const;
+    bool empty() const;
+    template<typename Fn>
+    auto read(Fn&& fn) const;
+    void commit();
+    void checkpoint();
+    std::uint64_t log_bytes() const;
+
+private:
+    std::uint64_t append(operation op, const Key& key);
+    void persist(std::uint64_t lsn, bool group_full);
+    void sync_to(std::uint64_t lsn);
+    bool acquire_sync(std::uint64_t lsn);
+    void release_sync(std::uint64_t durable);
+    void write_checkpoint(bool only_if_due);
+    void write_snapshot();
+    std::uint64_t load_snapshot();
+    void replay_log(std::uint64_t snapshot_lsn);
+
+    static constexpr char SNAPSHOT_MAGIC[8] = {'j', 'p', 's', 'n', 'a', 'p', '0', '1'};
+    static constexpr size_t RECORD_SIZE = 8 + 1 + sizeof(Key) + 8;
+    static constexpr size_t IO_CHUNK = size_t{1} << 20;
+
+    const std::string m_directory;
+    const bool m_sync_each_write;
+    const size_t m_checkpoint_bytes;
+    set_type m_set;
+    detail::durable_file m_log;
+    mutable std::mutex m_mutex;
+    std::vector<char> m_buffer;
+    std::vector<char> m_batch;
+    std::uint64_t m_lsn;
+    std::mutex m_sync_mutex;
+    std::condition_variable m_synced;
+    std::uint64_t m_durable_lsn;
+    bool m_syncing;
+    std::atomic<std::uint64_t> m_log_bytes;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+/**
+ * Opens the set stored in the directory, creating it if needed, and recovers it from the snapshot and the log.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+durable_ordered_set<Key, CmpFn, Alloc>::durable_ordered_set(const std::string& directory, bool sync_each_write,
+                                                            size_t checkpoint_bytes)
+    : m_directory{directory}
+    , m_sync_each_write{sync_each_write}
+    , m_checkpoint_bytes{checkpoint_bytes}
+    , m_set{}
+    , m_log{}
+    , m_mutex{}
+    , m_buffer{}
+    , m_batch{}
+    , m_lsn{0}
+    , m_sync_mutex{}
+    , m_synced{}
+    , m_durable_lsn{0}
+    , m_syncing{false}
+    , m_log_bytes{0}
+{
+    detail::durable_file::make_directory(m_directory);
+    std::uint64_t snapshot_lsn = load_snapshot();
+    m_lsn = snapshot_lsn;
+    replay_log(snapshot_lsn);
+    m_durable_lsn = m_lsn;
+}
+
+/**
+ * Syncs the log, errors are ignored here, call commit before to see them.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+durable_ordered_set<Key, CmpFn, Alloc>::~durable_ordered_set()
+{
+    try {
+        commit();
+    } catch (...) {
+    }
+}
+
+/**
+ * Returns true if the key was not in the set. Returns once the change is durable if sync_each_write.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+bool durable_ordered_set<Key, CmpFn, Alloc>::insert(const Key& key)
+{
+    std::uint64_t lsn;
+    bool group_full;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_set.insert(key).second)
+            return false;
+        try {
+            lsn = append(INSERT, key);
+        } catch (...) {
+            m_set.erase(key);
+            throw;
+        }
+        group_full = m_buffer.size() >= GROUP_BYTES;
+    }
+    persist(lsn, group_full);
+    return true;
+}
+
+/**
+ * Returns the number of erased keys, 0 or 1. Returns once the change is durable if sync_each_write.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+size_t durable_ordered_set<Key, CmpFn, Alloc>::erase(const Key& key)
+{
+    std::uint64_t lsn;
+    bool group_full;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!m_set.contains(key))
+            return 0;
+        lsn = append(ERASE, key);
+        m_set.erase(key);
+        group_full = m_buffer.size() >= GROUP_BYTES;
+    }
+    persist(lsn, group_full);
+    return 1;
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::clear()
+{
+    std::uint64_t lsn;
+    bool group_full;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        lsn = append(CLEAR, Key{});
+        m_set.clear();
+        group_full = m_buffer.size() >= GROUP_BYTES;
+    }
+    persist(lsn, group_full);
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+bool durable_ordered_set<Key, CmpFn, Alloc>::contains(const Key& key) const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_set.contains(key);
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+size_t durable_ordered_set<Key, CmpFn, Alloc>::order_of_key(const Key& key) const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_set.order_of_key(key);
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+std::optional<Key> durable_ordered_set<Key, CmpFn, Alloc>::find_by_order(size_t order) const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    auto it = m_set.find_by_order(order);
+    if (it == m_set.end())
+        return std::nullopt;
+    return *it;
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+size_t durable_ordered_set<Key, CmpFn, Alloc>::size() const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return m_set.size();
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+bool durable_ordered_set<Key, CmpFn, Alloc>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+ * Calls fn with the underlying set under the lock and returns its result, e.g. to iterate over a range.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename Fn>
+auto durable_ordered_set<Key, CmpFn, Alloc>::read(Fn&& fn) const
+{
+    std::lock_guard<std::mutex> lock{m_mutex};
+    return std::forward<Fn>(fn)(static_cast<const set_type&>(m_set));
+}
+
+/**
+ * Makes all changes done before the call durable.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::commit()
+{
+    std::uint64_t lsn;
+    {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        lsn = m_lsn;
+    }
+    sync_to(lsn);
+}
+
+/**
+ * Writes a snapshot of the set and empties the log.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::checkpoint()
+{
+    write_checkpoint(false);
+}
+
+/**
+ * Returns the size of the log written since the last checkpoint.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::uint64_t durable_ordered_set<Key, CmpFn, Alloc>::log_bytes() const
+{
+    return m_log_bytes.load();
+}
+
+/**
+ * Appends the record {lsn, op, key, checksum} to the buffer and returns its lsn, called under the lock.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::uint64_t durable_ordered_set<Key, CmpFn, Alloc>::append(operation op, const Key& key)
+{
+    const std::uint64_t lsn = m_lsn + 1;
+    char record[RECORD_SIZE];
+    std::memcpy(record, &lsn, 8);
+    record[8] = static_cast<char>(op);
+    std::memcpy(record + 9, &key, sizeof(Key));
+    const std::uint64_t sum = detail::checksum(record, RECORD_SIZE - 8);
+    std::memcpy(record + RECORD_SIZE - 8, &sum, 8);
+    m_buffer.insert(m_buffer.end(), record, record + RECORD_SIZE);
+    m_lsn = lsn;
+    return lsn;
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::persist(std::uint64_t lsn, bool group_full)
+{
+    if (m_sync_each_write || group_full)
+        sync_to(lsn);
+    if (m_log_bytes.load() >= m_checkpoint_bytes)
+        write_checkpoint(true);
+}
+
+/**
+ * Returns once the record lsn is durable. The first waiting writer becomes the leader and syncs all records buffered
+ * so far, the writers arriving during its sync are served together by the next leader. A batch which failed to sync
+ * is kept, only leaders touch it, and is synced again ahead of the records buffered since.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::sync_to(std::uint64_t lsn)
+{
+    if (!acquire_sync(lsn))
+        return;
+    std::uint64_t last;
+    try {
+        // cut whatever part of a failed batch reached the log, it is written again as a whole
+        if (!m_batch.empty())
+            m_log.truncate(m_log_bytes.load());
+        {
+            std::lock_guard<std::mutex> lock{m_mutex};
+            if (m_batch.empty()) {
+                m_batch.swap(m_buffer);
+            } else {
+                m_batch.insert(m_batch.end(), m_buffer.begin(), m_buffer.end());
+                m_buffer.clear();
+            }
+            last = m_lsn;
+        }
+        m_log.write(m_batch.data(), m_batch.size());
+        m_log.sync();
+    } catch (...) {
+        // cut a partly written batch, so that the records synced later are not hidden behind a torn one
+        try {
+            m_log.truncate(m_log_bytes.load());
+        } catch (...) {
+        }
+        release_sync(0);
+        throw;
+    }
+    m_log_bytes += m_batch.size();
+    m_batch.clear();
+    release_sync(last);
+}
+
+/**
+ * Waits until lsn is durable, returning false, or until no sync is running, taking the role of the leader.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+bool durable_ordered_set<Key, CmpFn, Alloc>::acquire_sync(std::uint64_t lsn)
+{
+    std::unique_lock<std::mutex> lock{m_sync_mutex};
+    m_synced.wait(lock, [&] { return m_durable_lsn >= lsn || !m_syncing; });
+    if (m_durable_lsn >= lsn)
+        return false;
+    m_syncing = true;
+    return true;
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::release_sync(std::uint64_t durable)
+{
+    {
+        std::lock_guard<std::mutex> lock{m_sync_mutex};
+        m_durable_lsn = std::max(m_durable_lsn, durable);
+        m_syncing = false;
+    }
+    m_synced.notify_all();
+}
+
+/**
+ * Takes the role of the leader, so that no batch is written to the log meanwhile, and writes the snapshot holding the
+ * buffered records too under the lock. Then the log and the buffer are emptied.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::write_checkpoint(bool only_if_due)
+{
+    if (!acquire_sync(std::numeric_limits<std::uint64_t>::max()))
+        return;
+    std::uint64_t last = 0;
+    try {
+        std::lock_guard<std::mutex> lock{m_mutex};
+        if (!only_if_due || m_log_bytes.load() >= m_checkpoint_bytes) {
+            write_snapshot();
+            // records older than the snapshot are skipped by the recovery, so a lost truncation does no harm
+            m_log.truncate(0);
+            m_buffer.clear();
+            m_batch.clear();
+            m_log_bytes = 0;
+            last = m_lsn;
+        }
+    } catch (...) {
+        release_sync(0);
+        throw;
+    }
+    release_sync(last);
+}
+
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::write_snapshot()
+{
+    const std::string path = m_directory + "/snapshot";
+    const std::string temporary = path + ".tmp";
+    detail::durable_file file{temporary, O_WRONLY | O_CREAT | O_TRUNC};
+    snapshot_header header{{}, sizeof(Key), m_set.size(), m_lsn};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    std::uint64_t sum = detail::checksum(&header, sizeof(header));
+    file.write(&header, sizeof(header));
+    std::vector<Key> chunk;
+    chunk.reserve(IO_CHUNK / sizeof(Key) + 1);
+    auto write_chunk = [&] {
+        sum = detail::checksum(chunk.data(), chunk.size() * sizeof(Key), sum);
+        file.write(chunk.data(), chunk.size() * sizeof(Key));
+        chunk.clear();
+    };
+    for (const Key& key : m_set) {
+        chunk.push_back(key);
+        if (chunk.size() * sizeof(Key) >= IO_CHUNK)
+            write_chunk();
+    }
+    write_chunk();
+    file.write(&sum, sizeof(sum));
+    file.sync();
+    detail::durable_file::replace(temporary, path, m_directory);
+}
+
+/**
+ * Builds the set from the snapshot if there is one and returns the lsn it covers. The keys are read in chunks and
+ * streamed into the tree, so a large snapshot is never held in memory at once.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::uint64_t durable_ordered_set<Key, CmpFn, Alloc>::load_snapshot()
+{
+    const std::string path = m_directory + "/snapshot";
+    if (!detail::durable_file::exists(path))
+        return 0;
+    // snapshots are complete when renamed into place, a bad one is not a torn write but a wrong or damaged file
+    const std::string error = "jp::durable_ordered_set: " + path + " is not a valid snapshot of this key type";
+    detail::durable_file file{path, O_RDONLY};
+    snapshot_header header;
+    if (file.read(&header, sizeof(header)) != sizeof(header)
+            || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+            || header.key_size != sizeof(Key)
+            || file.size() != sizeof(header) + header.count * sizeof(Key) + sizeof(std::uint64_t))
+        throw std::runtime_error(error);
+    std::uint64_t sum = detail::checksum(&header, sizeof(header));
+    std::uint64_t remaining = header.count;
+    std::vector<Key> chunk(std::max<size_t>(IO_CHUNK / sizeof(Key), 1));
+    size_t position = 0;
+    size_t filled = 0;
+    try {
+        m_set.build_from_stream([&]() -> std::optional<Key> {
+            if (position == filled) {
+                if (remaining == 0)
+                    return std::nullopt;
+                filled = static_cast<size_t>(std::min<std::uint64_t>(chunk.size(), remaining));
+                if (file.read(chunk.data(), filled * sizeof(Key)) != filled * sizeof(Key))
+                    throw std::runtime_error(error);
+                sum = detail::checksum(chunk.data(), filled * sizeof(Key), sum);
+                remaining -= filled;
+                position = 0;
+            }
+            return chunk[position++];
+        });
+    } catch (const std::invalid_argument&) {
+        // keys out of order mean damage the checksum would only report at the end
+        throw std::runtime_error(error);
+    }
+    std::uint64_t stored;
+    if (file.read(&stored, sizeof(stored)) != sizeof(stored) || stored != sum || m_set.size() != header.count)
+        throw std::runtime_error(error);
+    return header.lsn;
+}
+
+/**
+ * Applies the records of the log newer than the snapshot and cuts the log after the last valid one. The records newer
+ * than the snapshot must continue its sequence numbers without a gap. The directory is synced after opening, so the
+ * entry of a just created log is durable before the first commit relies on it.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void durable_ordered_set<Key, CmpFn, Alloc>::replay_log(std::uint64_t snapshot_lsn)
+{
+    m_log = detail::durable_file{m_directory + "/log", O_RDWR | O_CREAT | O_APPEND};
+    detail::durable_file::sync_directory(m_directory);
+    std::vector<char> data(m_log.size());
+    data.resize(m_log.read(data.data(), data.size()));
+    size_t valid = 0;
+    for (; valid + RECORD_SIZE <= data.size(); valid += RECORD_SIZE) {
+        const char* record = data.data() + valid;
+        std::uint64_t lsn;
+        std::uint64_t sum;
+        Key key;
+        std::memcpy(&lsn, record, 8);
+        std::memcpy(&key, record + 9, sizeof(Key));
+        std::memcpy(&sum, record + RECORD_SIZE - 8, 8);
+        if (sum != detail::checksum(record, RECORD_SIZE - 8))
+            break;
+        if (lsn <= snapshot_lsn)
+            continue;
+        if (lsn != m_lsn + 1)
+            throw std::runtime_error("jp::durable_ordered_set: " + m_directory + "/log has a gap in its sequence "
+                                     "numbers before record " + std::to_string(lsn));
+        switch (record[8]) {
+        case INSERT:
+            m_set.insert(key);
+            break;
+        case ERASE:
+            m_set.erase(key);
+            break;
+        case CLEAR:
+            m_set.clear();
+            break;
+        }
+        m_lsn = lsn;
+    }
+    if (valid < data.size()) {
+        m_log.truncate(valid);
+        m_log.sync();
+    }
+    m_log_bytes = valid;
+}
+
+} //!jp
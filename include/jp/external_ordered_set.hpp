@@ -0,0 +1,811 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+
+#include "ordered_set.hpp"
+#include "detail/page_cache.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An ordered set stored in a file, for sets larger than the memory. The keys are kept in a B+-tree of 4KB pages whose
+ * inner pages keep the number of keys below each child, so order_of_key and find_by_order take one page per level.
+ * Only a bounded number of pages is cached in memory, see detail::page_cache.
+ *
+ * Writes are batched as in a buffer tree: insert and erase only check the presence of the key, which reads the pages
+ * of one path, and record the change in an in-memory buffer, counted so that contains, order_of_key and size stay
+ * exact. A full buffer is applied in key order, so the changes falling into the same leaf dirty it only once and the
+ * leaves are written back in one sweep instead of once per random change. Operations needing a position in the tree,
+ * find, find_by_order and begin, apply the buffer first. Iterators are forward only and invalidated by any change.
+ *
+ * Empty pages are unlinked from the tree and reused, partly filled pages are not merged. The file is reopened by the
+ * constructor if it exists, the same key type and Cmp_Fn have to be used. The buffer and the cached pages reach the
+ * file on flush, sync and destruction. I/O errors throw std::system_error and leave the file in an unspecified state.
+ * Keys are stored as bytes, hence they have to be trivially copyable.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class external_ordered_set
+{
+    static_assert(std::is_trivially_copyable<Key>::value, "keys are stored in the pages as bytes");
+    static_assert(alignof(Key) <= alignof(std::uint64_t), "keys are stored at 8 byte aligned offsets");
+
+    struct file_header
+    {
+        char magic[8];
+        std::uint64_t page_size;
+        std::uint64_t key_size;
+        std::uint64_t root;
+        std::uint64_t height;
+        std::uint64_t size;
+        std::uint64_t page_count;
+        std::uint64_t free_head;
+    };
+
+    struct page_header
+    {
+        std::uint32_t leaf;
+        std::uint32_t count;
+    };
+
+    struct split
+    {
+        Key separator;
+        std::uint64_t right;
+        std::uint64_t left_size;
+        std::uint64_t right_size;
+    };
+
+    using page_ref = detail::page_cache::page_ref;
+
+public:
+    static constexpr size_t DEFAULT_CACHE_PAGES = 1024;
+    static constexpr size_t DEFAULT_BUFFER_KEYS = 4096;
+
+    class const_iterator : public std::iterator<std::forward_iterator_tag, Key>
+    {
+        friend class external_ordered_set<Key, Cmp_Fn>;
+        const_iterator(const external_ordered_set* set, std::uint64_t page, size_t index);
+    public:
+        const_iterator() = delete;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+        const Key* operator->() const;
+        const Key& operator*() const;
+    private:
+        void load();
+
+        const external_ordered_set* m_set;
+        std::uint64_t m_page;
+        size_t m_index;
+        std::optional<Key> m_key;
+    };
+
+    explicit external_ordered_set(const std::string& path, size_t cache_pages = DEFAULT_CACHE_PAGES,
+                                  size_t buffer_keys = DEFAULT_BUFFER_KEYS);
+    external_ordered_set(const external_ordered_set&) = delete;
+    external_ordered_set& operator=(const external_ordered_set&) = delete;
+    ~external_ordered_set();
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    size_t order_of_key(const Key& key) const;
+    const_iterator find(const Key& key) const;
+    bool contains(const Key& key) const;
+    const_iterator find_by_order(size_t order) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void flush();
+    void sync();
+    size_t page_reads() const;
+    size_t page_writes() const;
+
+private:
+    static page_header& header(char* p);
+    static std::uint64_t& next_leaf(char* p);
+    static std::uint64_t& prev_leaf(char* p);
+    static Key* leaf_keys(char* p);
+    static std::uint64_t* children(char* p);
+    static std::uint64_t* sizes(char* p);
+    static Key* separators(char* p);
+    static size_t child_index(char* p, const Key& key);
+    void reset();
+    void write_header() const;
+    void apply_pending() const;
+    bool tree_contains(const Key& key) const;
+    size_t tree_rank(const Key& key) const;
+    void tree_insert(const Key& key) const;
+    void tree_erase(const Key& key) const;
+    std::optional<split> insert_into(std::uint64_t id, const Key& key) const;
+    split split_leaf(std::uint64_t id, char* p) const;
+    split split_inner(char* p) const;
+    bool erase_from(std::uint64_t id, const Key& key) const;
+    void remove_child(char* p, size_t i) const;
+    std::uint64_t allocate_page() const;
+    void free_page(std::uint64_t id) const;
+
+    static constexpr char MAGIC[8] = {'j', 'p', 'e', 'x', 't', 'o', 's', '1'};
+    static constexpr size_t PAGE_SIZE = detail::page_cache::PAGE_SIZE;
+    static constexpr size_t LEAF_OFFSET = 24;
+    static constexpr size_t LEAF_CAPACITY = (PAGE_SIZE - LEAF_OFFSET) / sizeof(Key);
+    static constexpr size_t INNER_CAPACITY = (PAGE_SIZE - 8 + sizeof(Key)) / (16 + sizeof(Key));
+    static constexpr size_t MIN_CACHE_PAGES = 16;
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    static_assert(LEAF_CAPACITY >= 4 && INNER_CAPACITY >= 4, "keys too large for the pages");
+
+    // reads move pages through the cache and apply the buffer, so the whole state changes in const calls
+    mutable detail::page_cache m_cache;
+    mutable file_header m_header;
+    mutable ordered_set<Key, Cmp_Fn> m_inserted;
+    mutable ordered_set<Key, Cmp_Fn> m_erased;
+    size_t m_buffer_keys;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+external_ordered_set<Key, CmpFn>::const_iterator::const_iterator(const external_ordered_set* set, std::uint64_t page,
+                                                                  size_t index)
+    : m_set{set}
+    , m_page{page}
+    , m_index{index}
+    , m_key{}
+{
+    load();
+}
+
+template<typename Key, typename CmpFn> inline
+typename external_ordered_set<Key, CmpFn>::const_iterator& external_ordered_set<Key, CmpFn>::const_iterator::operator++()
+{
+    m_index++;
+    load();
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename external_ordered_set<Key, CmpFn>::const_iterator
+external_ordered_set<Key, CmpFn>::const_iterator::operator++(int)
+{
+    const_iterator tmp{*this};
+    operator++();
+    return tmp;
+}
+
+template<typename Key, typename CmpFn> inline
+bool external_ordered_set<Key, CmpFn>::const_iterator::operator==(const const_iterator& other) const
+{
+    return m_page == other.m_page && (m_page == 0 || m_index == other.m_index);
+}
+
+template<typename Key, typename CmpFn> inline
+bool external_ordered_set<Key, CmpFn>::const_iterator::operator!=(const const_iterator& other) const
+{
+    return !(*this == other);
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* external_ordered_set<Key, CmpFn>::const_iterator::operator->() const
+{
+    return &*m_key;
+}
+
+template<typename Key, typename CmpFn> inline
+const Key& external_ordered_set<Key, CmpFn>::const_iterator::operator*() const
+{
+    return *m_key;
+}
+
+/**
+ * Moves past the ends of the leaves to the next key and copies it out of the page, page 0 marks the end.
+ */
+template<typename Key, typename CmpFn> inline
+void external_ordered_set<Key, CmpFn>::const_iterator::load()
+{
+    while (m_page != 0) {
+        page_ref page = m_set->m_cache.fetch(m_page);
+        char* p = page.data();
+        if (m_index < header(p).count) {
+            m_key = leaf_keys(p)[m_index];
+            return;
+        }
+        m_page = next_leaf(p);
+        m_index = 0;
+    }
+    m_key.reset();
+}
+
+/**
+ * Opens the set stored in the file at path or creates an empty one. cache_pages bounds the memory used for the pages,
+ * buffer_keys the number of changes batched before they are applied to the tree, 0 applies them at once.
+ */
+template<typename Key, typename CmpFn>
+external_ordered_set<Key, CmpFn>::external_ordered_set(const std::string& path, size_t cache_pages,
+                                                       size_t buffer_keys)
+    : m_cache{path, std::max(cache_pages, MIN_CACHE_PAGES)}
+    , m_header{}
+    , m_inserted{}
+    , m_erased{}
+    , m_buffer_keys{buffer_keys}
+{
+    if (m_cache.file_pages() == 0) {
+        reset();
+        return;
+    }
+    page_ref page = m_cache.fetch(0);
+    std::memcpy(&m_header, page.data(), sizeof(file_header));
+    if (std::memcmp(m_header.magic, MAGIC, sizeof(MAGIC)) != 0 || m_header.page_size != PAGE_SIZE
+            || m_header.key_size != sizeof(Key))
+        throw std::runtime_error("jp::external_ordered_set: " + path + " does not hold a set of this key type");
+}
+
+/**
+ * Writes the buffer and the dirty pages to the file, errors are ignored here, call flush or sync before to see them.
+ */
+template<typename Key, typename CmpFn>
+external_ordered_set<Key, CmpFn>::~external_ordered_set()
+{
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+/**
+ * Returns true if the key was not in the set.
+ */
+template<typename Key, typename CmpFn>
+bool external_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    if (m_erased.contains(key)) {
+        m_erased.erase(key);
+        return true;
+    }
+    if (m_inserted.contains(key) || tree_contains(key))
+        return false;
+    m_inserted.insert(key);
+    if (m_inserted.size() + m_erased.size() >= m_buffer_keys)
+        apply_pending();
+    return true;
+}
+
+/**
+ * Returns the number of erased keys, 0 or 1.
+ */
+template<typename Key, typename CmpFn>
+size_t external_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    if (m_inserted.contains(key)) {
+        m_inserted.erase(key);
+        return 1;
+    }
+    if (m_erased.contains(key) || !tree_contains(key))
+        return 0;
+    m_erased.insert(key);
+    if (m_inserted.size() + m_erased.size() >= m_buffer_keys)
+        apply_pending();
+    return 1;
+}
+
+/**
+ * Returns the number of keys less than the given one, the buffer is accounted for without applying it.
+ */
+template<typename Key, typename CmpFn>
+size_t external_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    return tree_rank(key) + m_inserted.order_of_key(key) - m_erased.order_of_key(key);
+}
+
+template<typename Key, typename CmpFn>
+typename external_ordered_set<Key, CmpFn>::const_iterator external_ordered_set<Key, CmpFn>::find(const Key& key) const
+{
+    apply_pending();
+    std::uint64_t id = m_header.root;
+    for (;;) {
+        page_ref page = m_cache.fetch(id);
+        char* p = page.data();
+        if (header(p).leaf) {
+            Key* keys = leaf_keys(p);
+            Key* pos = std::lower_bound(keys, keys + header(p).count, key, CMP);
+            if (pos == keys + header(p).count || CMP(key, *pos))
+                return end();
+            return const_iterator{this, id, static_cast<size_t>(pos - keys)};
+        }
+        id = children(p)[child_index(p, key)];
+    }
+}
+
+template<typename Key, typename CmpFn>
+bool external_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    if (m_inserted.contains(key))
+        return true;
+    return !m_erased.contains(key) && tree_contains(key);
+}
+
+template<typename Key, typename CmpFn>
+typename external_ordered_set<Key, CmpFn>::const_iterator
+external_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    apply_pending();
+    if (order >= m_header.size)
+        return end();
+    std::uint64_t id = m_header.root;
+    for (;;) {
+        page_ref page = m_cache.fetch(id);
+        char* p = page.data();
+        if (header(p).leaf)
+            return const_iterator{this, id, order};
+        size_t i = 0;
+        while (order >= sizes(p)[i])
+            order -= sizes(p)[i++];
+        id = children(p)[i];
+    }
+}
+
+template<typename Key, typename CmpFn>
+typename external_ordered_set<Key, CmpFn>::const_iterator external_ordered_set<Key, CmpFn>::begin() const
+{
+    apply_pending();
+    std::uint64_t id = m_header.root;
+    for (;;) {
+        page_ref page = m_cache.fetch(id);
+        char* p = page.data();
+        if (header(p).leaf)
+            return const_iterator{this, id, 0};
+        id = children(p)[0];
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+typename external_ordered_set<Key, CmpFn>::const_iterator external_ordered_set<Key, CmpFn>::end() const
+{
+    return const_iterator{this, 0, 0};
+}
+
+template<typename Key, typename CmpFn> inline
+size_t external_ordered_set<Key, CmpFn>::size() const
+{
+    return m_header.size + m_inserted.size() - m_erased.size();
+}
+
+template<typename Key, typename CmpFn> inline
+bool external_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+ * Empties the set and truncates the file.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::clear()
+{
+    m_inserted.clear();
+    m_erased.clear();
+    reset();
+}
+
+/**
+ * Applies the buffer and writes all dirty pages to the file.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::flush()
+{
+    apply_pending();
+    write_header();
+    m_cache.flush();
+}
+
+/**
+ * Flushes the set and waits until the file is on the device.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::sync()
+{
+    flush();
+    m_cache.sync();
+}
+
+template<typename Key, typename CmpFn> inline
+size_t external_ordered_set<Key, CmpFn>::page_reads() const
+{
+    return m_cache.reads();
+}
+
+template<typename Key, typename CmpFn> inline
+size_t external_ordered_set<Key, CmpFn>::page_writes() const
+{
+    return m_cache.writes();
+}
+
+/**
+ * Leaves are laid out as {header, next, prev, keys}, inner pages as {header, children, sizes, separators}, where the
+ * keys of child i are not less than separator i - 1 and less than separator i.
+ */
+template<typename Key, typename CmpFn> inline
+typename external_ordered_set<Key, CmpFn>::page_header& external_ordered_set<Key, CmpFn>::header(char* p)
+{
+    return *reinterpret_cast<page_header*>(p);
+}
+
+template<typename Key, typename CmpFn> inline
+std::uint64_t& external_ordered_set<Key, CmpFn>::next_leaf(char* p)
+{
+    return *reinterpret_cast<std::uint64_t*>(p + 8);
+}
+
+template<typename Key, typename CmpFn> inline
+std::uint64_t& external_ordered_set<Key, CmpFn>::prev_leaf(char* p)
+{
+    return *reinterpret_cast<std::uint64_t*>(p + 16);
+}
+
+template<typename Key, typename CmpFn> inline
+Key* external_ordered_set<Key, CmpFn>::leaf_keys(char* p)
+{
+    return reinterpret_cast<Key*>(p + LEAF_OFFSET);
+}
+
+template<typename Key, typename CmpFn> inline
+std::uint64_t* external_ordered_set<Key, CmpFn>::children(char* p)
+{
+    return reinterpret_cast<std::uint64_t*>(p + 8);
+}
+
+template<typename Key, typename CmpFn> inline
+std::uint64_t* external_ordered_set<Key, CmpFn>::sizes(char* p)
+{
+    return children(p) + INNER_CAPACITY;
+}
+
+template<typename Key, typename CmpFn> inline
+Key* external_ordered_set<Key, CmpFn>::separators(char* p)
+{
+    return reinterpret_cast<Key*>(p + 8 + 16 * INNER_CAPACITY);
+}
+
+template<typename Key, typename CmpFn> inline
+size_t external_ordered_set<Key, CmpFn>::child_index(char* p, const Key& key)
+{
+    Key* seps = separators(p);
+    return static_cast<size_t>(std::upper_bound(seps, seps + header(p).count - 1, key, CMP) - seps);
+}
+
+/**
+ * Truncates the file to the header and an empty root leaf.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::reset()
+{
+    m_cache.truncate();
+    m_header = file_header{{}, PAGE_SIZE, sizeof(Key), 1, 1, 0, 2, 0};
+    std::memcpy(m_header.magic, MAGIC, sizeof(MAGIC));
+    {
+        page_ref root = m_cache.create(1);
+        header(root.data()) = page_header{1, 0};
+    }
+    write_header();
+}
+
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::write_header() const
+{
+    page_ref page = m_cache.create(0);
+    std::memcpy(page.data(), &m_header, sizeof(file_header));
+}
+
+/**
+ * Applies the buffered changes to the tree in key order.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::apply_pending() const
+{
+    for (const Key& key : m_erased)
+        tree_erase(key);
+    m_erased.clear();
+    for (const Key& key : m_inserted)
+        tree_insert(key);
+    m_inserted.clear();
+}
+
+template<typename Key, typename CmpFn>
+bool external_ordered_set<Key, CmpFn>::tree_contains(const Key& key) const
+{
+    std::uint64_t id = m_header.root;
+    for (;;) {
+        page_ref page = m_cache.fetch(id);
+        char* p = page.data();
+        if (header(p).leaf) {
+            Key* keys = leaf_keys(p);
+            Key* pos = std::lower_bound(keys, keys + header(p).count, key, CMP);
+            return pos != keys + header(p).count && !CMP(key, *pos);
+        }
+        id = children(p)[child_index(p, key)];
+    }
+}
+
+template<typename Key, typename CmpFn>
+size_t external_ordered_set<Key, CmpFn>::tree_rank(const Key& key) const
+{
+    size_t rank = 0;
+    std::uint64_t id = m_header.root;
+    for (;;) {
+        page_ref page = m_cache.fetch(id);
+        char* p = page.data();
+        if (header(p).leaf) {
+            Key* keys = leaf_keys(p);
+            return rank + static_cast<size_t>(std::lower_bound(keys, keys + header(p).count, key, CMP) - keys);
+        }
+        size_t i = child_index(p, key);
+        for (size_t j = 0; j < i; j++)
+            rank += sizes(p)[j];
+        id = children(p)[i];
+    }
+}
+
+/**
+ * Inserts a key known not to be in the tree, growing a new root if the old one splits.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::tree_insert(const Key& key) const
+{
+    std::optional<split> s = insert_into(m_header.root, key);
+    m_header.size++;
+    if (!s)
+        return;
+    std::uint64_t id = allocate_page();
+    page_ref page = m_cache.create(id);
+    char* p = page.data();
+    header(p) = page_header{0, 2};
+    children(p)[0] = m_header.root;
+    children(p)[1] = s->right;
+    sizes(p)[0] = s->left_size;
+    sizes(p)[1] = s->right_size;
+    separators(p)[0] = s->separator;
+    m_header.root = id;
+    m_header.height++;
+}
+
+/**
+ * Erases a key known to be in the tree and replaces the root by its only child while it has one.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::tree_erase(const Key& key) const
+{
+    erase_from(m_header.root, key);
+    m_header.size--;
+    while (m_header.height > 1) {
+        std::uint64_t child;
+        {
+            page_ref page = m_cache.fetch(m_header.root);
+            if (header(page.data()).count != 1)
+                break;
+            child = children(page.data())[0];
+        }
+        free_page(m_header.root);
+        m_header.root = child;
+        m_header.height--;
+    }
+}
+
+/**
+ * Inserts the key into the subtree, the counts on the path are incremented on the way down. Returns the split of the
+ * page if it became full.
+ */
+template<typename Key, typename CmpFn>
+std::optional<typename external_ordered_set<Key, CmpFn>::split>
+external_ordered_set<Key, CmpFn>::insert_into(std::uint64_t id, const Key& key) const
+{
+    page_ref page = m_cache.fetch(id);
+    page.mark_dirty();
+    char* p = page.data();
+    page_header& h = header(p);
+    if (h.leaf) {
+        Key* keys = leaf_keys(p);
+        Key* pos = std::lower_bound(keys, keys + h.count, key, CMP);
+        std::memmove(pos + 1, pos, static_cast<size_t>(keys + h.count - pos) * sizeof(Key));
+        *pos = key;
+        if (++h.count < LEAF_CAPACITY)
+            return std::nullopt;
+        return split_leaf(id, p);
+    }
+    size_t i = child_index(p, key);
+    sizes(p)[i]++;
+    std::optional<split> s = insert_into(children(p)[i], key);
+    if (!s)
+        return std::nullopt;
+    std::uint64_t* c = children(p);
+    std::uint64_t* z = sizes(p);
+    Key* k = separators(p);
+    std::memmove(c + i + 2, c + i + 1, (h.count - i - 1) * sizeof(std::uint64_t));
+    std::memmove(z + i + 2, z + i + 1, (h.count - i - 1) * sizeof(std::uint64_t));
+    std::memmove(k + i + 1, k + i, (h.count - i - 1) * sizeof(Key));
+    c[i + 1] = s->right;
+    z[i] = s->left_size;
+    z[i + 1] = s->right_size;
+    k[i] = s->separator;
+    if (++h.count < INNER_CAPACITY)
+        return std::nullopt;
+    return split_inner(p);
+}
+
+/**
+ * Moves the upper half of the full leaf to a new leaf linked after it.
+ */
+template<typename Key, typename CmpFn>
+typename external_ordered_set<Key, CmpFn>::split
+external_ordered_set<Key, CmpFn>::split_leaf(std::uint64_t id, char* p) const
+{
+    std::uint64_t r = allocate_page();
+    page_ref right = m_cache.create(r);
+    char* q = right.data();
+    const size_t count = header(p).count;
+    const size_t half = count / 2;
+    header(q) = page_header{1, static_cast<std::uint32_t>(count - half)};
+    std::memcpy(leaf_keys(q), leaf_keys(p) + half, (count - half) * sizeof(Key));
+    header(p).count = static_cast<std::uint32_t>(half);
+    next_leaf(q) = next_leaf(p);
+    prev_leaf(q) = id;
+    if (next_leaf(p) != 0) {
+        page_ref next = m_cache.fetch(next_leaf(p));
+        next.mark_dirty();
+        prev_leaf(next.data()) = r;
+    }
+    next_leaf(p) = r;
+    return split{leaf_keys(q)[0], r, half, count - half};
+}
+
+/**
+ * Moves the upper half of the children of the full inner page to a new page, the separator between the halves goes up.
+ */
+template<typename Key, typename CmpFn>
+typename external_ordered_set<Key, CmpFn>::split external_ordered_set<Key, CmpFn>::split_inner(char* p) const
+{
+    std::uint64_t r = allocate_page();
+    page_ref right = m_cache.create(r);
+    char* q = right.data();
+    const size_t count = header(p).count;
+    const size_t half = count / 2;
+    header(q) = page_header{0, static_cast<std::uint32_t>(count - half)};
+    std::memcpy(children(q), children(p) + half, (count - half) * sizeof(std::uint64_t));
+    std::memcpy(sizes(q), sizes(p) + half, (count - half) * sizeof(std::uint64_t));
+    std::memcpy(separators(q), separators(p) + half, (count - half - 1) * sizeof(Key));
+    header(p).count = static_cast<std::uint32_t>(half);
+    std::uint64_t left_size = 0;
+    std::uint64_t right_size = 0;
+    for (size_t i = 0; i < half; i++)
+        left_size += sizes(p)[i];
+    for (size_t i = 0; i < count - half; i++)
+        right_size += sizes(q)[i];
+    return split{separators(p)[half - 1], r, left_size, right_size};
+}
+
+/**
+ * Erases the key from the subtree, the counts on the path are decremented on the way down. Children left empty are
+ * removed, returns true if the page itself became empty.
+ */
+template<typename Key, typename CmpFn>
+bool external_ordered_set<Key, CmpFn>::erase_from(std::uint64_t id, const Key& key) const
+{
+    page_ref page = m_cache.fetch(id);
+    page.mark_dirty();
+    char* p = page.data();
+    page_header& h = header(p);
+    if (h.leaf) {
+        Key* keys = leaf_keys(p);
+        Key* pos = std::lower_bound(keys, keys + h.count, key, CMP);
+        std::memmove(pos, pos + 1, static_cast<size_t>(keys + h.count - pos - 1) * sizeof(Key));
+        return --h.count == 0;
+    }
+    size_t i = child_index(p, key);
+    sizes(p)[i]--;
+    if (!erase_from(children(p)[i], key))
+        return false;
+    remove_child(p, i);
+    return h.count == 0;
+}
+
+/**
+ * Frees the empty child i of the inner page, unlinking it from the list of leaves if it is a leaf.
+ */
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::remove_child(char* p, size_t i) const
+{
+    const std::uint64_t id = children(p)[i];
+    std::uint64_t prev = 0;
+    std::uint64_t next = 0;
+    {
+        page_ref child = m_cache.fetch(id);
+        if (header(child.data()).leaf) {
+            prev = prev_leaf(child.data());
+            next = next_leaf(child.data());
+        }
+    }
+    if (prev != 0) {
+        page_ref page = m_cache.fetch(prev);
+        page.mark_dirty();
+        next_leaf(page.data()) = next;
+    }
+    if (next != 0) {
+        page_ref page = m_cache.fetch(next);
+        page.mark_dirty();
+        prev_leaf(page.data()) = prev;
+    }
+    free_page(id);
+
+    const size_t count = header(p).count;
+    std::memmove(children(p) + i, children(p) + i + 1, (count - i - 1) * sizeof(std::uint64_t));
+    std::memmove(sizes(p) + i, sizes(p) + i + 1, (count - i - 1) * sizeof(std::uint64_t));
+    if (count > 1) {
+        // the child loses its lower bound, the first child the bound of its right sibling
+        const size_t j = i > 0 ? i - 1 : 0;
+        std::memmove(separators(p) + j, separators(p) + j + 1, (count - 2 - j) * sizeof(Key));
+    }
+    header(p).count = static_cast<std::uint32_t>(count - 1);
+}
+
+/**
+ * Returns a page from the free list or else a new page at the end of the file.
+ */
+template<typename Key, typename CmpFn>
+std::uint64_t external_ordered_set<Key, CmpFn>::allocate_page() const
+{
+    if (m_header.free_head == 0)
+        return m_header.page_count++;
+    std::uint64_t id = m_header.free_head;
+    page_ref page = m_cache.fetch(id);
+    std::memcpy(&m_header.free_head, page.data(), sizeof(std::uint64_t));
+    return id;
+}
+
+template<typename Key, typename CmpFn>
+void external_ordered_set<Key, CmpFn>::free_page(std::uint64_t id) const
+{
+    page_ref page = m_cache.create(id);
+    std::memcpy(page.data(), &m_header.free_head, sizeof(std::uint64_t));
+    m_header.free_head = id;
+}
+
+} //!jp
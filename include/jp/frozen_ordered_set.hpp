@@ -0,0 +1,331 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <functional>
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An immutable ordered set built in linear time from a sorted range. Keys are kept once, in the Eytzinger (BFS) order
+ * of a complete binary search tree. The first levels of the layout share a few cache lines and the children of a node
+ * are adjacent, so the search prefetches the great-grandchildren while it compares and is branch free, see 'Array
+ * Layouts for Comparison-Based Searching' by P. Khuong and P. Morin.
+ *
+ * The tree has all levels full but the deepest one, which is filled from the left. Placing it in a perfect tree, the
+ * in-order position of a node follows from its level and its offset within the level, and the absent deepest nodes
+ * take every second position from some point on. Ranks and the nodes of ranks are therefore computed in constant
+ * time instead of being stored.
+ *
+ * All queries only read, so any number of threads may query the same set without synchronization.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class frozen_ordered_set
+{
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        const_iterator() = default;
+        reference operator*() const;
+        pointer operator->() const;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+
+    private:
+        friend class frozen_ordered_set;
+        const_iterator(const frozen_ordered_set* set, size_t order);
+
+        const frozen_ordered_set* m_set = nullptr;
+        size_t m_order = 0;
+    };
+
+    frozen_ordered_set() = default;
+    template<typename Iterator>
+    frozen_ordered_set(Iterator first, Iterator last);
+    template<typename Iterator>
+    void assign(Iterator first, Iterator last);
+    size_t order_of_key(const Key& key) const;
+    const_iterator find(const Key& key) const;
+    bool contains(const Key& key) const;
+    const_iterator find_by_order(size_t order) const;
+    const_iterator lower_bound(const Key& key) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    static size_t log2(size_t x);
+    size_t lower_bound_node(const Key& key) const;
+    size_t order_of_node(size_t k) const;
+    size_t node_of_order(size_t order) const;
+
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    std::vector<Key> m_tree; // 1-based, m_tree[0] is unused
+    size_t m_size = 0;
+    size_t m_height = 0;     // depth of the deepest level
+    size_t m_deepest = 0;    // number of nodes on the deepest level
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+frozen_ordered_set<Key, CmpFn>::const_iterator::const_iterator(const frozen_ordered_set* set, size_t order)
+    : m_set{set}
+    , m_order{order}
+{ }
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator::reference
+frozen_ordered_set<Key, CmpFn>::const_iterator::operator*() const
+{
+    return m_set->m_tree[m_set->node_of_order(m_order)];
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator::pointer
+frozen_ordered_set<Key, CmpFn>::const_iterator::operator->() const
+{
+    return &**this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator& frozen_ordered_set<Key, CmpFn>::const_iterator::operator++()
+{
+    m_order++;
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::const_iterator::operator++(int)
+{
+    const_iterator it = *this;
+    ++*this;
+    return it;
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator& frozen_ordered_set<Key, CmpFn>::const_iterator::operator--()
+{
+    m_order--;
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::const_iterator::operator--(int)
+{
+    const_iterator it = *this;
+    --*this;
+    return it;
+}
+
+template<typename Key, typename CmpFn> inline
+bool frozen_ordered_set<Key, CmpFn>::const_iterator::operator==(const const_iterator& other) const
+{
+    return m_order == other.m_order && m_set == other.m_set;
+}
+
+template<typename Key, typename CmpFn> inline
+bool frozen_ordered_set<Key, CmpFn>::const_iterator::operator!=(const const_iterator& other) const
+{
+    return !(*this == other);
+}
+
+template<typename Key, typename CmpFn>
+template<typename Iterator> inline
+frozen_ordered_set<Key, CmpFn>::frozen_ordered_set(Iterator first, Iterator last)
+{
+    assign(first, last);
+}
+
+/**
+ * Replaces the content by the keys of the range, which have to be strictly increasing. Every key is moved straight to
+ * its node. Reuses the memory of the previous content where possible.
+ */
+template<typename Key, typename CmpFn>
+template<typename Iterator>
+void frozen_ordered_set<Key, CmpFn>::assign(Iterator first, Iterator last)
+{
+    const size_t n = static_cast<size_t>(std::distance(first, last));
+    m_tree.resize(n + 1);
+    m_size = n;
+    m_height = n == 0 ? 0 : log2(n);
+    m_deepest = n - ((size_t{1} << m_height) - 1);
+    for (size_t order = 0; first != last; ++first, order++) {
+        size_t k = node_of_order(order);
+        m_tree[k] = *first;
+        assert(order == 0 || CMP(m_tree[node_of_order(order - 1)], m_tree[k]));
+    }
+}
+
+/**
+ * Returns the number of keys less than the given one.
+ */
+template<typename Key, typename CmpFn> inline
+size_t frozen_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    size_t k = lower_bound_node(key);
+    return k == 0 ? m_size : order_of_node(k);
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::find(const Key& key) const
+{
+    size_t k = lower_bound_node(key);
+    return k != 0 && !CMP(key, m_tree[k]) ? const_iterator{this, order_of_node(k)} : end();
+}
+
+template<typename Key, typename CmpFn> inline
+bool frozen_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    size_t k = lower_bound_node(key);
+    return k != 0 && !CMP(key, m_tree[k]);
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    return order < m_size ? const_iterator{this, order} : end();
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::lower_bound(const Key& key) const
+{
+    return const_iterator{this, order_of_key(key)};
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::begin() const
+{
+    return const_iterator{this, 0};
+}
+
+template<typename Key, typename CmpFn> inline
+typename frozen_ordered_set<Key, CmpFn>::const_iterator frozen_ordered_set<Key, CmpFn>::end() const
+{
+    return const_iterator{this, m_size};
+}
+
+template<typename Key, typename CmpFn> inline
+size_t frozen_ordered_set<Key, CmpFn>::size() const
+{
+    return m_size;
+}
+
+template<typename Key, typename CmpFn> inline
+bool frozen_ordered_set<Key, CmpFn>::empty() const
+{
+    return m_size == 0;
+}
+
+/**
+ * Returns the index of the highest set bit, x must not be zero.
+ */
+template<typename Key, typename CmpFn> inline
+size_t frozen_ordered_set<Key, CmpFn>::log2(size_t x)
+{
+#if defined(__GNUC__)
+    return static_cast<size_t>(8 * sizeof(unsigned long long) - 1 - __builtin_clzll(x));
+#else
+    size_t bits = 0;
+    while (x >>= 1)
+        bits++;
+    return bits;
+#endif
+}
+
+/**
+ * Returns the node of the least key not less than the given one, zero if there is none. The descent moves right
+ * whenever the node is less than the key, in the end the trailing right moves plus one are dropped from k.
+ */
+template<typename Key, typename CmpFn>
+size_t frozen_ordered_set<Key, CmpFn>::lower_bound_node(const Key& key) const
+{
+    const size_t n = m_size;
+    const Key* tree = m_tree.data();
+    size_t k = 1;
+    while (k <= n) {
+#if defined(__GNUC__)
+        __builtin_prefetch(tree + 8 * k);
+#endif
+        k = 2 * k + static_cast<size_t>(CMP(tree[k], key));
+    }
+    while (k & 1)
+        k >>= 1;
+    return k >> 1;
+}
+
+/**
+ * Returns the rank of node k. In the perfect tree the node at depth d and offset j within its level has the in-order
+ * position (2j + 1) 2^(height - d) - 1, the deepest level takes the even positions. Of those, the ones from
+ * 2 * m_deepest on are absent and are not counted.
+ */
+template<typename Key, typename CmpFn> inline
+size_t frozen_ordered_set<Key, CmpFn>::order_of_node(size_t k) const
+{
+    const size_t depth = log2(k);
+    const size_t position = ((2 * (k - (size_t{1} << depth)) + 1) << (m_height - depth)) - 1;
+    const size_t deepest_before = (position + 1) / 2;
+    return deepest_before > m_deepest ? position - (deepest_before - m_deepest) : position;
+}
+
+/**
+ * Returns the node of the given rank, the inverse of order_of_node. Past the present deepest nodes only every second
+ * position of the perfect tree is occupied. The trailing zeros of the position plus one give the height of the node.
+ */
+template<typename Key, typename CmpFn> inline
+size_t frozen_ordered_set<Key, CmpFn>::node_of_order(size_t order) const
+{
+    size_t position = order < 2 * m_deepest ? order : 2 * (order - m_deepest) + 1;
+    size_t x = position + 1;
+    size_t height = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        height++;
+    }
+    return (size_t{1} << (m_height - height)) + (x >> 1);
+}
+
+} //!jp
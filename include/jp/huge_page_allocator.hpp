@@ -0,0 +1,110 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <type_traits>
+
+#include "detail/huge_page_arena.hpp"
+
+namespace jp {
+
+/**
+ * An allocator placing single objects into a detail::huge_page_arena, for sets large enough for the dTLB misses of
+ * the descents to matter, e.g. 'ordered_set<Key, std::less<Key>, huge_page_allocator<Key>>'. A default constructed
+ * allocator creates its own arena, copies share it, so several sets may be packed into the same huge pages by
+ * constructing them from one allocator. The arena may be bound to a NUMA node. As the arena is not thread-safe, sets
+ * sharing it must not be modified concurrently. Arrays and over-aligned types go to std::allocator.
+ */
+template<typename T>
+class huge_page_allocator
+{
+    template<typename U>
+    friend class huge_page_allocator;
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit huge_page_allocator(bool hugetlbfs = false, int numa_node = -1);
+    // no move, a moved-from set has to keep the arena to remain usable
+    huge_page_allocator(const huge_page_allocator& other) noexcept = default;
+    huge_page_allocator& operator=(const huge_page_allocator& other) noexcept = default;
+    template<typename U>
+    huge_page_allocator(const huge_page_allocator<U>& other) noexcept;
+
+    T* allocate(size_t n);
+    void deallocate(T* p, size_t n) noexcept;
+    const detail::huge_page_arena& arena() const;
+
+    template<typename U>
+    bool operator==(const huge_page_allocator<U>& other) const noexcept { return m_arena == other.m_arena; }
+    template<typename U>
+    bool operator!=(const huge_page_allocator<U>& other) const noexcept { return m_arena != other.m_arena; }
+
+private:
+    static constexpr bool ARENA = detail::huge_page_arena::cacheable(sizeof(T), alignof(T));
+    std::shared_ptr<detail::huge_page_arena> m_arena;
+};
+
+
+template<typename T> inline
+huge_page_allocator<T>::huge_page_allocator(bool hugetlbfs, int numa_node)
+    : m_arena{std::make_shared<detail::huge_page_arena>(hugetlbfs, numa_node)}
+{ }
+
+template<typename T>
+template<typename U> inline
+huge_page_allocator<T>::huge_page_allocator(const huge_page_allocator<U>& other) noexcept
+    : m_arena{other.m_arena}
+{ }
+
+template<typename T> inline
+T* huge_page_allocator<T>::allocate(size_t n)
+{
+    if (ARENA && n == 1)
+        return static_cast<T*>(m_arena->allocate(sizeof(T)));
+    return std::allocator<T>{}.allocate(n);
+}
+
+template<typename T> inline
+void huge_page_allocator<T>::deallocate(T* p, size_t n) noexcept
+{
+    if (ARENA && n == 1)
+        m_arena->deallocate(p, sizeof(T));
+    else
+        std::allocator<T>{}.deallocate(p, n);
+}
+
+template<typename T> inline
+const detail::huge_page_arena& huge_page_allocator<T>::arena() const
+{
+    return *m_arena;
+}
+
+} //!jp
@@ -0,0 +1,486 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include <iterator>
+
+#include "detail/rb_tree.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An ordered set of records with several unique indices, one per comparator. Every record is allocated once and its
+ * node is linked into a separate red-black tree augmented with subtree sizes for every index, hence each index
+ * supports order_of_key and find_by_order. Index I is selected with a template argument, e.g. find<1>(probe), where
+ * the probe is a record compared with the comparator of index I.
+ *
+ * A record is inserted only if none of the indices contains an equivalent record.
+ */
+template<
+        typename Record,
+        typename... Cmp_Fns
+        >
+class multi_index_ordered_set
+{
+    static_assert(sizeof...(Cmp_Fns) > 0, "multi_index_ordered_set needs at least one index");
+
+    static constexpr size_t N = sizeof...(Cmp_Fns);
+
+    template<size_t I>
+    using cmp_type = std::tuple_element_t<I, std::tuple<Cmp_Fns...>>;
+
+    struct node_base
+    {
+        detail::rb_node hooks[N];
+    };
+
+    struct node : node_base
+    {
+        Record record;
+
+        node() = delete;
+        node(const Record& record);
+    };
+
+public:
+    template<size_t I>
+    class const_iterator
+    {
+        friend class multi_index_ordered_set<Record, Cmp_Fns...>;
+        const_iterator(const multi_index_ordered_set* set, node* nd);
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Record;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Record*;
+        using reference = const Record&;
+
+        const_iterator() = delete;
+        const_iterator(const const_iterator& other) = default;
+        const_iterator(const_iterator&&) = default;
+        const_iterator& operator=(const const_iterator& other) = default;
+        const_iterator& operator=(const_iterator&&) = default;
+        ~const_iterator() = default;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+        const Record* operator->() const;
+        const Record& operator*() const;
+    private:
+        const multi_index_ordered_set* m_set;
+        node* m_node;
+    };
+
+    multi_index_ordered_set();
+    multi_index_ordered_set(const multi_index_ordered_set& other);
+    multi_index_ordered_set(multi_index_ordered_set&& other);
+    multi_index_ordered_set& operator=(const multi_index_ordered_set& other);
+    multi_index_ordered_set& operator=(multi_index_ordered_set&& other);
+    ~multi_index_ordered_set();
+    std::pair<const_iterator<0>, bool> insert(const Record& record);
+    template<size_t I>
+    size_t erase(const Record& probe);
+    template<size_t I>
+    const_iterator<I> erase(const_iterator<I> it);
+    template<size_t I>
+    size_t order_of_key(const Record& probe) const;
+    template<size_t I, size_t J>
+    size_t order_of(const const_iterator<J>& it) const;
+    template<size_t I>
+    const_iterator<I> find(const Record& probe) const;
+    template<size_t I>
+    const_iterator<I> find_by_order(size_t order) const;
+    template<size_t I>
+    const_iterator<I> begin() const;
+    template<size_t I>
+    const_iterator<I> end() const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+private:
+    static node* to_node(detail::rb_node* x, size_t index);
+    template<size_t I>
+    node* search(const Record& probe) const;
+    template<size_t I>
+    node* locate(const Record& record, detail::rb_node*& parent, bool& left) const;
+    template<size_t... Is>
+    node* locate_all(const Record& record, detail::rb_node** parents, bool* lefts, std::index_sequence<Is...>) const;
+    void unlink(node* z);
+
+    std::array<detail::rb_node*, N> m_roots;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Record, typename... CmpFns> inline
+multi_index_ordered_set<Record, CmpFns...>::node::node(const Record& record)
+    : node_base{}
+    , record{record}
+{ }
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::const_iterator(const multi_index_ordered_set* set,
+                                                                               node* nd)
+    : m_set{set}
+    , m_node{nd}
+{ }
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>&
+multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator++()
+{
+    m_node = to_node(detail::rb_successor(&m_node->hooks[I]), I);
+    return *this;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator++(int)
+{
+    const_iterator tmp{*this};
+    operator++();
+    return tmp;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>&
+multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator--()
+{
+    if (m_node == nullptr)
+        m_node = to_node(detail::rb_max(m_set->m_roots[I]), I);
+    else
+        m_node = to_node(detail::rb_predecessor(&m_node->hooks[I]), I);
+    return *this;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator--(int)
+{
+    const_iterator tmp{*this};
+    operator--();
+    return tmp;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+bool multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator==(const const_iterator& other) const
+{
+    return m_node == other.m_node;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+bool multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator!=(const const_iterator& other) const
+{
+    return m_node != other.m_node;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+const Record* multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator->() const
+{
+    return &(m_node->record);
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+const Record& multi_index_ordered_set<Record, CmpFns...>::const_iterator<I>::operator*() const
+{
+    return m_node->record;
+}
+
+template<typename Record, typename... CmpFns> inline
+multi_index_ordered_set<Record, CmpFns...>::multi_index_ordered_set()
+    : m_roots{}
+{ }
+
+template<typename Record, typename... CmpFns>
+multi_index_ordered_set<Record, CmpFns...>::multi_index_ordered_set(const multi_index_ordered_set& other)
+    : multi_index_ordered_set()
+{
+    for (auto it = other.template begin<0>(); it != other.template end<0>(); ++it)
+        insert(*it);
+}
+
+template<typename Record, typename... CmpFns> inline
+multi_index_ordered_set<Record, CmpFns...>::multi_index_ordered_set(multi_index_ordered_set&& other)
+    : m_roots{other.m_roots}
+{
+    other.m_roots.fill(nullptr);
+}
+
+template<typename Record, typename... CmpFns>
+multi_index_ordered_set<Record, CmpFns...>&
+multi_index_ordered_set<Record, CmpFns...>::operator=(const multi_index_ordered_set& other)
+{
+    if (&other == this)
+        return *this;
+    clear();
+    for (auto it = other.template begin<0>(); it != other.template end<0>(); ++it)
+        insert(*it);
+    return *this;
+}
+
+template<typename Record, typename... CmpFns>
+multi_index_ordered_set<Record, CmpFns...>&
+multi_index_ordered_set<Record, CmpFns...>::operator=(multi_index_ordered_set&& other)
+{
+    if (&other == this)
+        return *this;
+    clear();
+    m_roots = other.m_roots;
+    other.m_roots.fill(nullptr);
+    return *this;
+}
+
+template<typename Record, typename... CmpFns> inline
+multi_index_ordered_set<Record, CmpFns...>::~multi_index_ordered_set()
+{
+    clear();
+}
+
+/**
+ * Inserts the record into all indices with a single allocation. If any index already contains an equivalent record,
+ * nothing is inserted and the returned iterator points to the conflicting record.
+ */
+template<typename Record, typename... CmpFns>
+std::pair<typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<0>, bool>
+multi_index_ordered_set<Record, CmpFns...>::insert(const Record& record)
+{
+    detail::rb_node* parents[N];
+    bool lefts[N];
+    node* conflict = locate_all(record, parents, lefts, std::make_index_sequence<N>{});
+    if (conflict != nullptr)
+        return std::make_pair(const_iterator<0>{this, conflict}, false);
+    node* z = new node(record);
+    for (size_t i = 0; i < N; i++)
+        detail::rb_insert(m_roots[i], parents[i], lefts[i], &z->hooks[i]);
+    return std::make_pair(const_iterator<0>{this, z}, true);
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I>
+size_t multi_index_ordered_set<Record, CmpFns...>::erase(const Record& probe)
+{
+    node* z = search<I>(probe);
+    if (z == nullptr)
+        return 0;
+    unlink(z);
+    delete z;
+    return 1;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I>
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::erase(const_iterator<I> it)
+{
+    node* z = it.m_node;
+    ++it;
+    unlink(z);
+    delete z;
+    return it;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+size_t multi_index_ordered_set<Record, CmpFns...>::order_of_key(const Record& probe) const
+{
+    size_t order = 0;
+    detail::rb_node* x = m_roots[I];
+    while (x != nullptr) {
+        if (cmp_type<I>{}(to_node(x, I)->record, probe)) {
+            order += detail::rb_size(x->left) + 1;
+            x = x->right;
+        } else {
+            x = x->left;
+        }
+    }
+    return order;
+}
+
+/**
+ * Returns the order in index I of the record pointed by an iterator of index J, climbing from its node to the root.
+ */
+template<typename Record, typename... CmpFns>
+template<size_t I, size_t J> inline
+size_t multi_index_ordered_set<Record, CmpFns...>::order_of(const const_iterator<J>& it) const
+{
+    if (it.m_node == nullptr)
+        return size();
+    return detail::rb_rank(&it.m_node->hooks[I]);
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::find(const Record& probe) const
+{
+    return const_iterator<I>{this, search<I>(probe)};
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::find_by_order(size_t order) const
+{
+    return const_iterator<I>{this, to_node(detail::rb_select(m_roots[I], order), I)};
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::begin() const
+{
+    return const_iterator<I>{this, to_node(detail::rb_min(m_roots[I]), I)};
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::template const_iterator<I>
+multi_index_ordered_set<Record, CmpFns...>::end() const
+{
+    return const_iterator<I>{this, nullptr};
+}
+
+template<typename Record, typename... CmpFns> inline
+size_t multi_index_ordered_set<Record, CmpFns...>::size() const
+{
+    return detail::rb_size(m_roots[0]);
+}
+
+template<typename Record, typename... CmpFns> inline
+bool multi_index_ordered_set<Record, CmpFns...>::empty() const
+{
+    return m_roots[0] == nullptr;
+}
+
+template<typename Record, typename... CmpFns>
+void multi_index_ordered_set<Record, CmpFns...>::clear()
+{
+    // nodes are visited in post-order of the first index, every node is freed once
+    detail::rb_node* x = m_roots[0];
+    while (x != nullptr) {
+        if (x->left != nullptr) {
+            x = x->left;
+        } else if (x->right != nullptr) {
+            x = x->right;
+        } else {
+            detail::rb_node* parent = x->parent;
+            if (parent != nullptr)
+                (parent->left == x ? parent->left : parent->right) = nullptr;
+            delete to_node(x, 0);
+            x = parent;
+        }
+    }
+    m_roots.fill(nullptr);
+}
+
+template<typename Record, typename... CmpFns> inline
+typename multi_index_ordered_set<Record, CmpFns...>::node*
+multi_index_ordered_set<Record, CmpFns...>::to_node(detail::rb_node* x, size_t index)
+{
+    if (x == nullptr)
+        return nullptr;
+    return static_cast<node*>(reinterpret_cast<node_base*>(x - index));
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::node*
+multi_index_ordered_set<Record, CmpFns...>::search(const Record& probe) const
+{
+    detail::rb_node* x = m_roots[I];
+    while (x != nullptr) {
+        const Record& record = to_node(x, I)->record;
+        if (cmp_type<I>{}(probe, record))
+            x = x->left;
+        else if (cmp_type<I>{}(record, probe))
+            x = x->right;
+        else
+            return to_node(x, I);
+    }
+    return nullptr;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t I> inline
+typename multi_index_ordered_set<Record, CmpFns...>::node*
+multi_index_ordered_set<Record, CmpFns...>::locate(const Record& record, detail::rb_node*& parent, bool& left) const
+{
+    detail::rb_node* x = m_roots[I];
+    parent = nullptr;
+    left = false;
+    while (x != nullptr) {
+        const Record& other = to_node(x, I)->record;
+        parent = x;
+        if (cmp_type<I>{}(record, other)) {
+            left = true;
+            x = x->left;
+        } else if (cmp_type<I>{}(other, record)) {
+            left = false;
+            x = x->right;
+        } else {
+            return to_node(x, I);
+        }
+    }
+    return nullptr;
+}
+
+template<typename Record, typename... CmpFns>
+template<size_t... Is>
+typename multi_index_ordered_set<Record, CmpFns...>::node*
+multi_index_ordered_set<Record, CmpFns...>::locate_all(const Record& record, detail::rb_node** parents, bool* lefts,
+                                                       std::index_sequence<Is...>) const
+{
+    node* conflict = nullptr;
+    (((conflict = locate<Is>(record, parents[Is], lefts[Is])) == nullptr) && ...);
+    return conflict;
+}
+
+template<typename Record, typename... CmpFns> inline
+void multi_index_ordered_set<Record, CmpFns...>::unlink(node* z)
+{
+    for (size_t i = 0; i < N; i++)
+        detail::rb_erase(m_roots[i], &z->hooks[i]);
+}
+
+} //!jp
@@ -0,0 +1,232 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <shared_mutex>
+
+#include "ordered_set.hpp"
+#include "huge_page_allocator.hpp"
+#include "detail/numa.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A thread-safe ordered set split by key ranges into shards, each an ordered_set whose nodes live in a
+ * huge_page_arena bound to one NUMA node. The ranges are given by sorted splitter keys, shard i holding the keys in
+ * [splitters[i - 1], splitters[i]), and consecutive shards are spread evenly over the nodes, so with one splitter on a
+ * 2-socket machine each socket owns one half of the key space. Every operation on a key is routed to the shard owning
+ * it, so threads pinned to the socket owning their key range (see shard_node) descend through local memory only.
+ *
+ * Each shard is guarded by its own reader-writer lock. Updates lock only their shard. Global ranks are exact: the
+ * rank of a key is its rank in its shard plus the counts of all preceding shards, read under shared locks taken in
+ * shard order, so a rank query sees a consistent prefix of the set. Results are returned by value, as iterators
+ * would not survive concurrent updates.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class numa_ordered_set
+{
+    using allocator = huge_page_allocator<Key>;
+    using set_type = ordered_set<Key, Cmp_Fn, allocator>;
+
+    struct alignas(64) shard
+    {
+        explicit shard(int numa_node);
+
+        mutable std::shared_mutex mutex;
+        set_type set;
+        int numa_node;
+    };
+
+public:
+    explicit numa_ordered_set(std::vector<Key> splitters = {});
+    numa_ordered_set(const numa_ordered_set&) = delete;
+    numa_ordered_set& operator=(const numa_ordered_set&) = delete;
+    ~numa_ordered_set() = default;
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    bool contains(const Key& key) const;
+    size_t order_of_key(const Key& key) const;
+    std::optional<Key> find_by_order(size_t order) const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    size_t shard_count() const;
+    size_t shard_of(const Key& key) const;
+    int shard_node(size_t index) const;
+
+private:
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    std::vector<Key> m_splitters;
+    std::vector<std::unique_ptr<shard>> m_shards;
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+numa_ordered_set<Key, CmpFn>::shard::shard(int numa_node)
+    : mutex{}
+    , set{allocator{false, numa_node}}
+    , numa_node{numa_node}
+{ }
+
+/**
+ * Creates splitters.size() + 1 shards, the splitters have to be strictly increasing. Shards are bound to NUMA nodes
+ * only if there is more than one, otherwise their memory is placed by the first touch.
+ */
+template<typename Key, typename CmpFn> inline
+numa_ordered_set<Key, CmpFn>::numa_ordered_set(std::vector<Key> splitters)
+    : m_splitters{std::move(splitters)}
+    , m_shards{}
+{
+    assert(std::adjacent_find(m_splitters.begin(), m_splitters.end(),
+                              [](const Key& a, const Key& b) { return !CMP(a, b); }) == m_splitters.end());
+    const size_t count = m_splitters.size() + 1;
+    const size_t nodes = detail::numa_node_count();
+    m_shards.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        m_shards.push_back(std::make_unique<shard>(nodes > 1 ? static_cast<int>(i * nodes / count) : -1));
+}
+
+template<typename Key, typename CmpFn> inline
+bool numa_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    shard& s = *m_shards[shard_of(key)];
+    std::unique_lock<std::shared_mutex> lock{s.mutex};
+    return s.set.insert(key).second;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t numa_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    shard& s = *m_shards[shard_of(key)];
+    std::unique_lock<std::shared_mutex> lock{s.mutex};
+    size_t before = s.set.size();
+    s.set.erase(key);
+    return before - s.set.size();
+}
+
+template<typename Key, typename CmpFn> inline
+bool numa_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    const shard& s = *m_shards[shard_of(key)];
+    std::shared_lock<std::shared_mutex> lock{s.mutex};
+    return s.set.contains(key);
+}
+
+template<typename Key, typename CmpFn>
+size_t numa_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    const size_t index = shard_of(key);
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(index + 1);
+    size_t order = 0;
+    for (size_t i = 0; i < index; i++) {
+        locks.emplace_back(m_shards[i]->mutex);
+        order += m_shards[i]->set.size();
+    }
+    locks.emplace_back(m_shards[index]->mutex);
+    return order + m_shards[index]->set.order_of_key(key);
+}
+
+/**
+ * Returns the key with the given global rank, or nothing if the set has at most order keys.
+ */
+template<typename Key, typename CmpFn>
+std::optional<Key> numa_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(m_shards.size());
+    for (const auto& s : m_shards) {
+        locks.emplace_back(s->mutex);
+        if (order < s->set.size())
+            return *s->set.find_by_order(order);
+        order -= s->set.size();
+    }
+    return std::nullopt;
+}
+
+template<typename Key, typename CmpFn>
+size_t numa_ordered_set<Key, CmpFn>::size() const
+{
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(m_shards.size());
+    size_t total = 0;
+    for (const auto& s : m_shards) {
+        locks.emplace_back(s->mutex);
+        total += s->set.size();
+    }
+    return total;
+}
+
+template<typename Key, typename CmpFn> inline
+bool numa_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+template<typename Key, typename CmpFn>
+void numa_ordered_set<Key, CmpFn>::clear()
+{
+    for (const auto& s : m_shards) {
+        std::unique_lock<std::shared_mutex> lock{s->mutex};
+        s->set.clear();
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+size_t numa_ordered_set<Key, CmpFn>::shard_count() const
+{
+    return m_shards.size();
+}
+
+template<typename Key, typename CmpFn> inline
+size_t numa_ordered_set<Key, CmpFn>::shard_of(const Key& key) const
+{
+    return static_cast<size_t>(std::upper_bound(m_splitters.begin(), m_splitters.end(), key, CMP) - m_splitters.begin());
+}
+
+/**
+ * Returns the NUMA node holding the nodes of the given shard, or -1 if the shard is not bound to any.
+ */
+template<typename Key, typename CmpFn> inline
+int numa_ordered_set<Key, CmpFn>::shard_node(size_t index) const
+{
+    return m_shards[index]->numa_node;
+}
+
+} //!jp
@@ -0,0 +1,612 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <queue>
+#include <vector>
+#include <ostream>
+#include <cassert>
+#include <sstream>
+#include <string_view>
+
+#include "detail/rb_tree.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An ordered_set of arithmetic-like keys augmented with lazy "add delta to all keys in subtree" tags, so that all
+ * keys not less than a given key can be shifted in O(log n), e.g. to keep positions in a mutable document up to date.
+ *
+ * Every node stores its key with all tags of its ancestors applied, except for the tags which have not been pushed
+ * down yet. Tags are pushed down along every descent and, through a detail::rb_hook, before every rotation done by the
+ * shared red-black tree core, hence the stored key of a node is exact as soon as the tags of all its ancestors are
+ * zero. Because of that even const members may push tags down, which is not observable but means that const members
+ * must not be called concurrently.
+ *
+ * Key has to be default constructible to zero and support operator+= and operator!=.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class offset_ordered_set
+{
+    struct node : detail::rb_node
+    {
+        Key key;
+        Key offset;
+
+        node() = delete;
+        node(const Key& key);
+        std::string str() const;
+    };
+
+public:
+    class const_iterator : public std::iterator<std::bidirectional_iterator_tag, node>
+    {
+        friend class offset_ordered_set<Key, Cmp_Fn>;
+        const_iterator(const offset_ordered_set* tree, node* nd);
+    public:
+        const_iterator() = delete;
+        const_iterator(const const_iterator& other) = default;
+        const_iterator(const_iterator&&) = default;
+        const_iterator& operator=(const const_iterator& other) = default;
+        const_iterator& operator=(const_iterator&&) = default;
+        ~const_iterator() = default;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+        const Key* operator->();
+        const Key& operator*();
+    private:
+        const offset_ordered_set* m_tree;
+        node* m_node;
+    };
+
+    offset_ordered_set();
+    offset_ordered_set(const offset_ordered_set& other);
+    offset_ordered_set(offset_ordered_set&& other);
+    offset_ordered_set& operator=(const offset_ordered_set& other);
+    offset_ordered_set& operator=(offset_ordered_set&& other);
+    ~offset_ordered_set();
+    std::pair<const_iterator, bool> insert(const Key& key);
+    const_iterator erase(const Key& key);
+    void shift_from(const Key& key, const Key& delta);
+    size_t order_of_key(const Key& key) const;
+    const_iterator find(const Key& key) const;
+    const_iterator find_by_order(size_t order) const;
+    const_iterator min() const;
+    const_iterator max() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    template<typename T, typename C>
+    friend std::ostream& operator<<(std::ostream& out, const offset_ordered_set<T, C>& tree);
+
+private:
+    static node* cast(detail::rb_node* x);
+    static void before_rotate(const void* context, detail::rb_node* x, detail::rb_node* y);
+    detail::rb_hook hook() const;
+    void delete_all_memory();
+    void deep_copy(const offset_ordered_set& src, offset_ordered_set& dst);
+    bool equal(const Key& lhs, const Key& rhs) const;
+    bool not_equal(const Key& lhs, const Key& rhs) const;
+    void apply(detail::rb_node* x, const Key& delta) const;
+    void push(detail::rb_node* x) const;
+    void push_path(detail::rb_node* x) const;
+    void push_all() const;
+    node* search(const Key& key) const;
+    void erase_tree(detail::rb_node* root);
+    const_iterator erase(node* z);
+    void print(std::ostream& out, detail::rb_node* x, std::string& prefix) const;
+
+    static constexpr bool RED = detail::RB_RED;
+    static constexpr bool BLACK = detail::RB_BLACK;
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    detail::rb_node* m_root;
+    mutable size_t m_pending;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+offset_ordered_set<Key, CmpFn>::node::node(const Key& key)
+    : detail::rb_node{1, nullptr, nullptr, nullptr, RED}
+    , key{key}
+    , offset{}
+{ }
+
+template<typename Key, typename CmpFn> inline
+offset_ordered_set<Key, CmpFn>::const_iterator::const_iterator(const offset_ordered_set* tree, node* nd)
+    : m_tree{tree}
+    , m_node{nd}
+{ }
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator& offset_ordered_set<Key, CmpFn>::const_iterator::operator++()
+{
+    m_node = cast(detail::rb_successor(m_node));
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::const_iterator::operator++(int)
+{
+    const_iterator tmp{*this};
+    operator++();
+    return tmp;
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator& offset_ordered_set<Key, CmpFn>::const_iterator::operator--()
+{
+    if (m_node == nullptr)
+        m_node = cast(detail::rb_max(m_tree->m_root));
+    else
+        m_node = cast(detail::rb_predecessor(m_node));
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::const_iterator::operator--(int)
+{
+    const_iterator tmp{*this};
+    operator--();
+    return tmp;
+}
+
+template<typename Key, typename CmpFn> inline
+bool offset_ordered_set<Key, CmpFn>::const_iterator::operator==(const offset_ordered_set::const_iterator& other) const
+{
+    return m_node == other.m_node;
+}
+
+template<typename Key, typename CmpFn> inline
+bool offset_ordered_set<Key, CmpFn>::const_iterator::operator!=(const offset_ordered_set::const_iterator& other) const
+{
+    return m_node != other.m_node;
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* offset_ordered_set<Key, CmpFn>::const_iterator::operator->()
+{
+    m_tree->push_path(m_node);
+    return &(m_node->key);
+}
+
+template<typename Key, typename CmpFn> inline
+const Key& offset_ordered_set<Key, CmpFn>::const_iterator::operator*()
+{
+    m_tree->push_path(m_node);
+    return m_node->key;
+}
+
+template<typename Key, typename CmpFn> inline
+offset_ordered_set<Key, CmpFn>::offset_ordered_set()
+    : m_root(nullptr)
+    , m_pending(0)
+{ }
+
+template<typename Key, typename CmpFn> inline
+offset_ordered_set<Key, CmpFn>::offset_ordered_set(const offset_ordered_set& other)
+    : offset_ordered_set()
+{
+    deep_copy(other, *this);
+}
+
+template<typename Key, typename CmpFn>
+offset_ordered_set<Key, CmpFn>::offset_ordered_set(offset_ordered_set&& other)
+    : m_root{other.m_root}
+    , m_pending{other.m_pending}
+{
+    other.m_root = nullptr;
+    other.m_pending = 0;
+}
+
+template<typename Key, typename CmpFn>
+offset_ordered_set<Key, CmpFn>& offset_ordered_set<Key, CmpFn>::operator=(const offset_ordered_set& other)
+{
+    if(&other == this)
+        return *this;
+    clear();
+    deep_copy(other, *this);
+    return *this;
+}
+
+template<typename Key, typename CmpFn>
+offset_ordered_set<Key, CmpFn>& offset_ordered_set<Key, CmpFn>::operator=(offset_ordered_set&& other)
+{
+    if(&other == this)
+        return *this;
+    std::swap(m_root, other.m_root);
+    std::swap(m_pending, other.m_pending);
+    other.clear();
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+offset_ordered_set<Key, CmpFn>::~offset_ordered_set()
+{
+    delete_all_memory();
+}
+
+template<typename Key, typename CmpFn>
+void offset_ordered_set<Key, CmpFn>::delete_all_memory()
+{
+    erase_tree(m_root);
+    m_root = nullptr;
+    m_pending = 0;
+}
+
+template<typename Key, typename CmpFn>
+void offset_ordered_set<Key, CmpFn>::deep_copy(const offset_ordered_set& src, offset_ordered_set& dst)
+{
+    src.push_all();
+    if (src.m_root == nullptr)
+        return;
+    std::queue<detail::rb_node*> buffor{};
+    buffor.push(src.m_root);
+    while (!buffor.empty()) {
+        detail::rb_node* x = buffor.front();
+        buffor.pop();
+        dst.insert(cast(x)->key);
+        if (x->left != nullptr)
+            buffor.push(x->left);
+        if (x->right != nullptr)
+            buffor.push(x->right);
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+std::pair<typename offset_ordered_set<Key, CmpFn>::const_iterator, bool>
+offset_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    detail::rb_node* x = m_root;
+    detail::rb_node* y = nullptr;
+    bool left = false;
+    while (x != nullptr) {
+        y = x;
+        const Key& x_key = cast(x)->key;
+        if (equal(key, x_key))
+            return std::make_pair(const_iterator{this, cast(x)}, false);
+        push(x);
+        left = CMP(key, x_key);
+        x = left ? x->left : x->right;
+    }
+    node* z = new node{key};
+    const detail::rb_hook h = hook();
+    detail::rb_insert(m_root, y, left, z, nullptr, &h);
+    return std::make_pair(const_iterator{this, z}, true);
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    node* z = search(key);
+    if (z == nullptr)
+        return end();
+    return erase(z);
+}
+
+/**
+ * Adds delta to all keys not less than the given key. The shift has to preserve the order of keys, i.e. the smallest
+ * shifted key must still be greater than the greatest key left in place.
+ */
+template<typename Key, typename CmpFn>
+void offset_ordered_set<Key, CmpFn>::shift_from(const Key& key, const Key& delta)
+{
+    node* first = nullptr;
+    node* last = nullptr;
+    detail::rb_node* x = m_root;
+    while (x != nullptr) {
+        push(x);
+        node* n = cast(x);
+        if (CMP(n->key, key)) {
+            last = n;
+            x = x->right;
+        } else {
+            first = n;
+            n->key += delta;
+            apply(x->right, delta);
+            x = x->left;
+        }
+    }
+    assert(first == nullptr || last == nullptr || CMP(last->key, first->key));
+    (void) first;
+    (void) last;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t offset_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const {
+    size_t current = detail::rb_size(m_root);
+    detail::rb_node* x = m_root;
+    while (x != nullptr && not_equal(key, cast(x)->key)) {
+        push(x);
+        if (CMP(key, cast(x)->key)) {
+            current -= 1 + detail::rb_size(x->right);
+            x = x->left;
+        } else {
+            x = x->right;
+        }
+    }
+    if (x != nullptr)
+        current -= 1 + detail::rb_size(x->right);
+    return current;
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::find(const Key& key) const
+{
+    return const_iterator{this, search(key)};
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator
+offset_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    return const_iterator{this, cast(detail::rb_select(m_root, order))};
+}
+
+template<typename Key, typename CmpFn> inline
+size_t offset_ordered_set<Key, CmpFn>::size() const
+{
+    return detail::rb_size(m_root);
+}
+
+template<typename Key, typename CmpFn> inline
+bool offset_ordered_set<Key, CmpFn>::empty() const
+{
+    return m_root == nullptr;
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::min() const
+{
+    return const_iterator{this, cast(detail::rb_min(m_root))};
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::max() const
+{
+    return const_iterator{this, cast(detail::rb_max(m_root))};
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::begin() const
+{
+    return min();
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::end() const
+{
+    return const_iterator{this, nullptr};
+}
+
+template<typename Key, typename CmpFn> inline
+void offset_ordered_set<Key, CmpFn>::clear()
+{
+    erase_tree(m_root);
+    m_root = nullptr;
+    m_pending = 0;
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::node* offset_ordered_set<Key, CmpFn>::cast(detail::rb_node* x)
+{
+    return static_cast<node*>(x);
+}
+
+/**
+ * Pushes the tags of a rotated pair below it, x first since it is the parent of y.
+ */
+template<typename Key, typename CmpFn> inline
+void offset_ordered_set<Key, CmpFn>::before_rotate(const void* context, detail::rb_node* x, detail::rb_node* y)
+{
+    const offset_ordered_set* tree = static_cast<const offset_ordered_set*>(context);
+    tree->push(x);
+    tree->push(y);
+}
+
+template<typename Key, typename CmpFn> inline
+detail::rb_hook offset_ordered_set<Key, CmpFn>::hook() const
+{
+    return detail::rb_hook{&before_rotate, this};
+}
+
+template<typename Key, typename CmpFn> inline
+bool offset_ordered_set<Key, CmpFn>::equal(const Key& lhs, const Key& rhs) const
+{
+    return (!CMP(lhs, rhs)) & (!CMP(rhs, lhs));
+}
+
+template<typename Key, typename CmpFn> inline
+bool offset_ordered_set<Key, CmpFn>::not_equal(const Key& lhs, const Key& rhs) const
+{
+    return CMP(lhs, rhs) | CMP(rhs, lhs);
+}
+
+template<typename Key, typename CmpFn> inline
+void offset_ordered_set<Key, CmpFn>::apply(detail::rb_node* x, const Key& delta) const
+{
+    if (x == nullptr)
+        return;
+    node* n = cast(x);
+    bool pending = n->offset != Key{};
+    n->key += delta;
+    n->offset += delta;
+    if (pending != (n->offset != Key{}))
+        pending ? --m_pending : ++m_pending;
+}
+
+template<typename Key, typename CmpFn> inline
+void offset_ordered_set<Key, CmpFn>::push(detail::rb_node* x) const
+{
+    node* n = cast(x);
+    if (n->offset != Key{}) {
+        apply(x->left, n->offset);
+        apply(x->right, n->offset);
+        n->offset = Key{};
+        --m_pending;
+    }
+}
+
+template<typename Key, typename CmpFn>
+void offset_ordered_set<Key, CmpFn>::push_path(detail::rb_node* x) const
+{
+    if (m_pending == 0 || x == nullptr)
+        return;
+    std::vector<detail::rb_node*> path{};
+    for (x = x->parent; x != nullptr; x = x->parent)
+        path.push_back(x);
+    for (auto it = path.rbegin(); it != path.rend(); ++it)
+        push(*it);
+}
+
+template<typename Key, typename CmpFn>
+void offset_ordered_set<Key, CmpFn>::push_all() const
+{
+    if (m_pending == 0 || m_root == nullptr)
+        return;
+    std::queue<detail::rb_node*> buffor{};
+    buffor.push(m_root);
+    while (!buffor.empty()) {
+        detail::rb_node* x = buffor.front();
+        buffor.pop();
+        push(x);
+        if (x->left != nullptr)
+            buffor.push(x->left);
+        if (x->right != nullptr)
+            buffor.push(x->right);
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::node* offset_ordered_set<Key, CmpFn>::search(const Key& key) const
+{
+    detail::rb_node* x = m_root;
+    while (x != nullptr && not_equal(key, cast(x)->key)) {
+        push(x);
+        if (CMP(key, cast(x)->key))
+            x = x->left;
+        else
+            x = x->right;
+    }
+    return cast(x);
+}
+
+/**
+ * Frees the subtree in post-order without any auxiliary memory, unlinking every freed node from its parent.
+ */
+template<typename Key, typename CmpFn> inline
+void offset_ordered_set<Key, CmpFn>::erase_tree(detail::rb_node* root)
+{
+    detail::rb_node* x = root;
+    while (x != nullptr) {
+        if (x->left != nullptr) {
+            x = x->left;
+        } else if (x->right != nullptr) {
+            x = x->right;
+        } else {
+            detail::rb_node* parent = x != root ? x->parent : nullptr;
+            if (parent != nullptr)
+                (x == parent->left ? parent->left : parent->right) = nullptr;
+            delete cast(x);
+            x = parent;
+        }
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+typename offset_ordered_set<Key, CmpFn>::const_iterator offset_ordered_set<Key, CmpFn>::erase(node* z)
+{
+    // the path to z is already pushed by search, the path to its successor is pushed here, the unlinking moves the
+    // successor into the place of z and the rotations of the fixup are covered by the hook
+    push(z);
+    for (detail::rb_node* w = z->right; w != nullptr; w = w->left)
+        push(w);
+    auto it = const_iterator{this, cast(detail::rb_successor(z))};
+    const detail::rb_hook h = hook();
+    detail::rb_erase(m_root, z, nullptr, &h);
+    delete z;
+    return it;
+}
+
+template<typename Key, typename CmpFn> inline
+std::ostream& operator<<(std::ostream& out, const offset_ordered_set<Key, CmpFn>& tree)
+{
+    if (tree.m_root == nullptr) {
+        out << "(empty_tree)";
+        return out;
+    }
+
+    tree.push_all();
+    std::string prefix = " ";
+    tree.print(out, tree.m_root, prefix);
+    out << "(key,size,color)";
+    return out;
+}
+
+template<typename Key, typename CmpFn> inline
+void offset_ordered_set<Key, CmpFn>::print(std::ostream& out, detail::rb_node* x, std::string& prefix) const
+{
+    auto prefixEnd = prefix.back();
+    auto prefixSize = prefix.size();
+    std::string str = cast(x)->str();
+    bool is_right = x->parent != nullptr && x->parent->right == x;
+
+    prefix[prefixSize - 1] = is_right ? ' ' : prefixEnd;
+    prefix.resize(prefix.size() + str.size() - 1, ' ');
+    prefix.back() = '|';
+    if (x->right != nullptr)
+        print(out, x->right, prefix);
+
+    std::string_view prefixView = prefix;
+    out << prefixView.substr(0, prefix.size() - str.size()) << str << '\n';
+
+    prefix[prefixSize - 1] = is_right ? prefixEnd : ' ';
+    if (x->left != nullptr)
+        print(out, x->left, prefix);
+    prefix.resize(prefix.size() - str.size() + 1);
+}
+
+template<typename Key, typename CmpFn> inline
+std::string offset_ordered_set<Key, CmpFn>::node::str() const
+{
+    std::stringstream ss{};
+    ss << '(' << key << ',' << size << ',' << (color ? 'b' : 'r') << ')';
+    return ss.str();
+}
+
+} //!jp
@@ -0,0 +1,952 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A thread-safe ordered set stored in a B+-tree whose inner nodes keep the number of keys below each child, so it
+ * supports order_of_key and find_by_order like ordered_set. Synchronization follows optimistic lock coupling, see
+ * 'The ART of Practical Synchronization' by V. Leis, F. Scheibner, A. Kemper and T. Neumann: every node has a version
+ * word doubling as a write lock, readers take no locks and only remember the versions of the nodes on their path, and
+ * a read is retried if any of them changed before it finished. Readers therefore never write to shared memory and
+ * scale with the number of cores. Lookups of a single key only validate the leaf, so they are not disturbed by writes
+ * elsewhere in the tree.
+ *
+ * Writers locate the leaf optimistically as well, so an insert of a present key or an erase of an absent one takes
+ * no lock. Otherwise a writer locks only the nodes whose structure it changes: the leaf, and when the leaf is full the
+ * ancestors it splits and the one receiving the last separator. The counts of the nodes above are adjusted with atomic
+ * additions, without locking or changing their versions, so writers to different leaves do not exclude each other. To
+ * keep the additions from racing with a split copying the counts, a writer marks the nodes it adds to before checking
+ * their versions, and a writer which has locked a node to split it waits until the node is no longer marked.
+ *
+ * As the counts are not covered by the versions, order_of_key, find_by_order and size see every update in flight
+ * either counted or not, they are exact whenever no update is in flight. Iteration is weakly consistent: an iterator
+ * holds a copy of its key and finds the next one by a new descent, so it visits the keys present during the whole
+ * iteration in order and once, and any subset of the keys inserted or erased meanwhile.
+ *
+ * Nodes are not merged when keys are erased, as in the reference implementation, so no node is ever freed while the
+ * set is in use and readers need no memory reclamation. Keys are read while they may be moved by writers, hence they
+ * have to be trivially copyable. Every field read optimistically (counts, sizes, children and keys) is written by the
+ * locked writer with relaxed atomic stores and read with relaxed atomic loads, keys wider than a word byte by byte.
+ * Children are stored with release and loaded with acquire semantics instead, so that a reader following a child
+ * before validating its parent finds the child initialized.
+ * Results are returned by value. clear must not run concurrently with other calls.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class olc_ordered_set
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_default_constructible<Key>::value,
+                  "optimistic readers copy keys which may be concurrently modified");
+
+    static constexpr size_t LEAF_CAPACITY = 32;
+    static constexpr size_t INNER_CAPACITY = 32;
+    static constexpr size_t MAX_HEIGHT = 32;
+    static constexpr std::uint64_t LOCKED = 2;
+    static constexpr bool WORD_KEY = sizeof(Key) <= sizeof(std::uint64_t) && sizeof(Key) == alignof(Key);
+
+    struct node
+    {
+        explicit node(bool leaf);
+
+        std::atomic<std::uint64_t> version;
+        std::uint32_t count;
+        const bool leaf;
+    };
+
+    struct leaf_node : node
+    {
+        leaf_node();
+
+        Key keys[LEAF_CAPACITY];
+    };
+
+    struct inner_node : node
+    {
+        inner_node();
+
+        std::atomic<std::uint32_t> updaters;
+        Key keys[INNER_CAPACITY];
+        node* children[INNER_CAPACITY + 1];
+        size_t sizes[INNER_CAPACITY + 1];
+    };
+
+    struct path
+    {
+        std::array<node*, MAX_HEIGHT> nodes;
+        std::array<std::uint64_t, MAX_HEIGHT> versions;
+        std::array<size_t, MAX_HEIGHT> indices;
+        size_t height;
+    };
+
+public:
+    class const_iterator
+    {
+        friend class olc_ordered_set<Key, Cmp_Fn>;
+        const_iterator(const olc_ordered_set* set, std::optional<Key> key);
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        const_iterator() = delete;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+        const Key* operator->() const;
+        const Key& operator*() const;
+    private:
+        const olc_ordered_set* m_set;
+        std::optional<Key> m_key;
+    };
+
+    olc_ordered_set();
+    olc_ordered_set(const olc_ordered_set&) = delete;
+    olc_ordered_set& operator=(const olc_ordered_set&) = delete;
+    ~olc_ordered_set();
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    size_t order_of_key(const Key& key) const;
+    std::optional<Key> find(const Key& key) const;
+    bool contains(const Key& key) const;
+    std::optional<Key> find_by_order(size_t order) const;
+    std::optional<Key> min() const;
+    std::optional<Key> max() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+private:
+    static leaf_node* as_leaf(node* x);
+    static inner_node* as_inner(node* x);
+    static bool equal(const Key& a, const Key& b);
+    template<typename T>
+    static T load(const T& field);
+    template<typename T>
+    static void store(T& field, T value);
+    static Key load_key(const Key& field);
+    static void store_key(Key& field, const Key& key);
+    static node* load_child(const inner_node* x, size_t i);
+    static void store_child(inner_node* x, size_t i, node* child);
+    static size_t lower_bound(const Key* keys, size_t n, const Key& key);
+    static size_t count(const node* x, size_t capacity);
+    static size_t child_index(const inner_node* x, const Key& key);
+    static size_t total(const node* x);
+    static bool read_lock(const node* x, std::uint64_t& version);
+    static bool validate(const node* x, std::uint64_t version);
+    static bool validate(const path& p);
+    template<typename Read>
+    static auto retry(Read read);
+    bool descend(const Key& key, path& p) const;
+    bool lock(path& p, size_t from);
+    static void unlock(const path& p, size_t from);
+    static bool add_sizes(const path& p, size_t levels, std::ptrdiff_t delta);
+    std::optional<Key> select(size_t order, bool from_back) const;
+    static std::optional<std::optional<Key>> select_from(node* x, std::uint64_t version, size_t order, bool from_back);
+    std::optional<Key> successor(const Key& key) const;
+    void insert_locked(path& p, size_t from, const Key& key);
+    void insert_child(path& p, size_t level, const Key& separator, node* right, size_t left_size, size_t right_size);
+    static void delete_tree(node* x);
+
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    std::atomic<node*> m_root;
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+olc_ordered_set<Key, CmpFn>::node::node(bool leaf)
+    : version{0}
+    , count{0}
+    , leaf{leaf}
+{ }
+
+template<typename Key, typename CmpFn> inline
+olc_ordered_set<Key, CmpFn>::leaf_node::leaf_node()
+    : node{true}
+{ }
+
+template<typename Key, typename CmpFn> inline
+olc_ordered_set<Key, CmpFn>::inner_node::inner_node()
+    : node{false}
+    , updaters{0}
+{ }
+
+template<typename Key, typename CmpFn> inline
+olc_ordered_set<Key, CmpFn>::const_iterator::const_iterator(const olc_ordered_set* set, std::optional<Key> key)
+    : m_set{set}
+    , m_key{key}
+{ }
+
+/**
+ * Moves to the least key greater than the current one at the time of the call.
+ */
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::const_iterator& olc_ordered_set<Key, CmpFn>::const_iterator::operator++()
+{
+    m_key = m_set->successor(*m_key);
+    return *this;
+}
+
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::const_iterator olc_ordered_set<Key, CmpFn>::const_iterator::operator++(int)
+{
+    const_iterator tmp{*this};
+    operator++();
+    return tmp;
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::const_iterator::operator==(const const_iterator& other) const
+{
+    if (!m_key || !other.m_key)
+        return !m_key && !other.m_key;
+    return equal(*m_key, *other.m_key);
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::const_iterator::operator!=(const const_iterator& other) const
+{
+    return !(*this == other);
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* olc_ordered_set<Key, CmpFn>::const_iterator::operator->() const
+{
+    return &*m_key;
+}
+
+template<typename Key, typename CmpFn> inline
+const Key& olc_ordered_set<Key, CmpFn>::const_iterator::operator*() const
+{
+    return *m_key;
+}
+
+template<typename Key, typename CmpFn> inline
+olc_ordered_set<Key, CmpFn>::olc_ordered_set()
+    : m_root{new leaf_node{}}
+{ }
+
+template<typename Key, typename CmpFn> inline
+olc_ordered_set<Key, CmpFn>::~olc_ordered_set()
+{
+    delete_tree(m_root.load(std::memory_order_relaxed));
+}
+
+template<typename Key, typename CmpFn>
+bool olc_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    return retry([this, &key]() -> std::optional<bool> {
+        path p;
+        if (!descend(key, p))
+            return std::nullopt;
+        leaf_node* leaf = as_leaf(p.nodes[p.height]);
+        size_t n = count(leaf, LEAF_CAPACITY);
+        size_t i = lower_bound(leaf->keys, n, key);
+        bool present = i < n && equal(load_key(leaf->keys[i]), key);
+        if (present)
+            return validate(leaf, p.versions[p.height]) ? std::optional<bool>{false} : std::nullopt;
+        // a full leaf splits the full ancestors above it and adds a separator to the first one which is not full
+        size_t from = p.height;
+        bool full = n == LEAF_CAPACITY;
+        while (full && from > 0)
+            full = count(p.nodes[--from], INNER_CAPACITY) == INNER_CAPACITY;
+        if (!lock(p, from))
+            return std::nullopt;
+        if (!add_sizes(p, from, 1)) {
+            unlock(p, from);
+            return std::nullopt;
+        }
+        insert_locked(p, from, key);
+        unlock(p, from);
+        return true;
+    });
+}
+
+template<typename Key, typename CmpFn>
+size_t olc_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    return retry([this, &key]() -> std::optional<size_t> {
+        path p;
+        if (!descend(key, p))
+            return std::nullopt;
+        leaf_node* leaf = as_leaf(p.nodes[p.height]);
+        size_t n = count(leaf, LEAF_CAPACITY);
+        size_t i = lower_bound(leaf->keys, n, key);
+        bool present = i < n && equal(load_key(leaf->keys[i]), key);
+        if (!present)
+            return validate(leaf, p.versions[p.height]) ? std::optional<size_t>{0} : std::nullopt;
+        if (!lock(p, p.height))
+            return std::nullopt;
+        if (!add_sizes(p, p.height, -1)) {
+            unlock(p, p.height);
+            return std::nullopt;
+        }
+        for (; i + 1 < n; i++)
+            store_key(leaf->keys[i], leaf->keys[i + 1]);
+        store(leaf->count, leaf->count - 1);
+        unlock(p, p.height);
+        return 1;
+    });
+}
+
+/**
+ * Sums the counts left of the path and the keys left in the leaf, valid if no node on the path changed meanwhile.
+ */
+template<typename Key, typename CmpFn>
+size_t olc_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    return retry([this, &key]() -> std::optional<size_t> {
+        path p;
+        if (!descend(key, p))
+            return std::nullopt;
+        size_t order = 0;
+        for (size_t level = 0; level < p.height; level++) {
+            const inner_node* x = as_inner(p.nodes[level]);
+            for (size_t i = 0; i < p.indices[level]; i++)
+                order += load(x->sizes[i]);
+        }
+        const leaf_node* leaf = as_leaf(p.nodes[p.height]);
+        order += lower_bound(leaf->keys, count(leaf, LEAF_CAPACITY), key);
+        return validate(p) ? std::optional<size_t>{order} : std::nullopt;
+    });
+}
+
+/**
+ * The leaf reached by the descent covered the key when its version was read, and its range only changes when it is
+ * split, so it is the only node to validate.
+ */
+template<typename Key, typename CmpFn>
+std::optional<Key> olc_ordered_set<Key, CmpFn>::find(const Key& key) const
+{
+    return retry([this, &key]() -> std::optional<std::optional<Key>> {
+        path p;
+        if (!descend(key, p))
+            return std::nullopt;
+        const leaf_node* leaf = as_leaf(p.nodes[p.height]);
+        size_t n = count(leaf, LEAF_CAPACITY);
+        size_t i = lower_bound(leaf->keys, n, key);
+        std::optional<Key> result;
+        if (i < n) {
+            Key found = load_key(leaf->keys[i]);
+            if (equal(found, key))
+                result = found;
+        }
+        return validate(leaf, p.versions[p.height]) ? std::optional<std::optional<Key>>{result} : std::nullopt;
+    });
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    return find(key).has_value();
+}
+
+/**
+ * Returns the key of the given order, or nothing if the set has at most order keys.
+ */
+template<typename Key, typename CmpFn> inline
+std::optional<Key> olc_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    return select(order, false);
+}
+
+template<typename Key, typename CmpFn> inline
+std::optional<Key> olc_ordered_set<Key, CmpFn>::min() const
+{
+    return select(0, false);
+}
+
+template<typename Key, typename CmpFn> inline
+std::optional<Key> olc_ordered_set<Key, CmpFn>::max() const
+{
+    return select(0, true);
+}
+
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::const_iterator olc_ordered_set<Key, CmpFn>::begin() const
+{
+    return const_iterator{this, min()};
+}
+
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::const_iterator olc_ordered_set<Key, CmpFn>::end() const
+{
+    return const_iterator{this, std::nullopt};
+}
+
+/**
+ * Sums the counts of the root.
+ */
+template<typename Key, typename CmpFn>
+size_t olc_ordered_set<Key, CmpFn>::size() const
+{
+    return retry([this]() -> std::optional<size_t> {
+        node* x = m_root.load(std::memory_order_acquire);
+        std::uint64_t version;
+        if (!read_lock(x, version) || x != m_root.load(std::memory_order_acquire))
+            return std::nullopt;
+        size_t sum = 0;
+        if (x->leaf) {
+            sum = count(x, LEAF_CAPACITY);
+        } else {
+            const inner_node* y = as_inner(x);
+            size_t n = count(y, INNER_CAPACITY);
+            for (size_t i = 0; i <= n; i++)
+                sum += load(y->sizes[i]);
+        }
+        return validate(x, version) ? std::optional<size_t>{sum} : std::nullopt;
+    });
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+template<typename Key, typename CmpFn>
+void olc_ordered_set<Key, CmpFn>::clear()
+{
+    delete_tree(m_root.exchange(new leaf_node{}));
+}
+
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::leaf_node* olc_ordered_set<Key, CmpFn>::as_leaf(node* x)
+{
+    return static_cast<leaf_node*>(x);
+}
+
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::inner_node* olc_ordered_set<Key, CmpFn>::as_inner(node* x)
+{
+    return static_cast<inner_node*>(x);
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::equal(const Key& a, const Key& b)
+{
+    return !CMP(a, b) && !CMP(b, a);
+}
+
+/**
+ * Reads a count or size which a writer may be modifying at the same time.
+ */
+template<typename Key, typename CmpFn>
+template<typename T> inline
+T olc_ordered_set<Key, CmpFn>::load(const T& field)
+{
+    return __atomic_load_n(&field, __ATOMIC_RELAXED);
+}
+
+/**
+ * Writes a count or size of a locked node which readers may be reading at the same time.
+ */
+template<typename Key, typename CmpFn>
+template<typename T> inline
+void olc_ordered_set<Key, CmpFn>::store(T& field, T value)
+{
+    __atomic_store_n(&field, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies a key which a writer may be moving at the same time, in a single load if it fits a word and byte by byte
+ * otherwise. A torn copy is possible in the latter case, but then validation fails.
+ */
+template<typename Key, typename CmpFn> inline
+Key olc_ordered_set<Key, CmpFn>::load_key(const Key& field)
+{
+    Key key;
+    if constexpr (WORD_KEY) {
+        __atomic_load(&field, &key, __ATOMIC_RELAXED);
+    } else {
+        const unsigned char* from = reinterpret_cast<const unsigned char*>(&field);
+        unsigned char* to = reinterpret_cast<unsigned char*>(&key);
+        for (size_t i = 0; i < sizeof(Key); i++)
+            to[i] = __atomic_load_n(from + i, __ATOMIC_RELAXED);
+    }
+    return key;
+}
+
+template<typename Key, typename CmpFn> inline
+void olc_ordered_set<Key, CmpFn>::store_key(Key& field, const Key& key)
+{
+    if constexpr (WORD_KEY) {
+        __atomic_store(&field, &key, __ATOMIC_RELAXED);
+    } else {
+        const unsigned char* from = reinterpret_cast<const unsigned char*>(&key);
+        unsigned char* to = reinterpret_cast<unsigned char*>(&field);
+        for (size_t i = 0; i < sizeof(Key); i++)
+            __atomic_store_n(to + i, from[i], __ATOMIC_RELAXED);
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+typename olc_ordered_set<Key, CmpFn>::node* olc_ordered_set<Key, CmpFn>::load_child(const inner_node* x, size_t i)
+{
+    return __atomic_load_n(&x->children[i], __ATOMIC_ACQUIRE);
+}
+
+template<typename Key, typename CmpFn> inline
+void olc_ordered_set<Key, CmpFn>::store_child(inner_node* x, size_t i, node* child)
+{
+    __atomic_store_n(&x->children[i], child, __ATOMIC_RELEASE);
+}
+
+/**
+ * Returns the index of the first of the n keys not less than the given key, loading every probed key atomically.
+ */
+template<typename Key, typename CmpFn> inline
+size_t olc_ordered_set<Key, CmpFn>::lower_bound(const Key* keys, size_t n, const Key& key)
+{
+    size_t first = 0;
+    while (n > 0) {
+        size_t half = n / 2;
+        if (CMP(load_key(keys[first + half]), key)) {
+            first += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return first;
+}
+
+/**
+ * The count may be read while a writer changes it, it is clamped so that a read bound to fail validation stays
+ * within the node.
+ */
+template<typename Key, typename CmpFn> inline
+size_t olc_ordered_set<Key, CmpFn>::count(const node* x, size_t capacity)
+{
+    return std::min<size_t>(__atomic_load_n(&x->count, __ATOMIC_RELAXED), capacity);
+}
+
+/**
+ * Child i holds the keys not less than separator i - 1 and less than separator i.
+ */
+template<typename Key, typename CmpFn> inline
+size_t olc_ordered_set<Key, CmpFn>::child_index(const inner_node* x, const Key& key)
+{
+    size_t n = count(x, INNER_CAPACITY);
+    size_t first = 0;
+    while (n > 0) {
+        size_t half = n / 2;
+        if (!CMP(key, load_key(x->keys[first + half]))) {
+            first += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return first;
+}
+
+/**
+ * Returns the number of keys in the subtree, the node must be locked or the result validated.
+ */
+template<typename Key, typename CmpFn> inline
+size_t olc_ordered_set<Key, CmpFn>::total(const node* x)
+{
+    if (x->leaf)
+        return x->count;
+    const inner_node* y = static_cast<const inner_node*>(x);
+    size_t sum = 0;
+    for (size_t i = 0; i <= y->count; i++)
+        sum += y->sizes[i];
+    return sum;
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::read_lock(const node* x, std::uint64_t& version)
+{
+    version = x->version.load(std::memory_order_acquire);
+    return (version & LOCKED) == 0;
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::validate(const node* x, std::uint64_t version)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return x->version.load(std::memory_order_relaxed) == version;
+}
+
+template<typename Key, typename CmpFn> inline
+bool olc_ordered_set<Key, CmpFn>::validate(const path& p)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    for (size_t level = 0; level <= p.height; level++)
+        if (p.nodes[level]->version.load(std::memory_order_relaxed) != p.versions[level])
+            return false;
+    return true;
+}
+
+/**
+ * Runs the operation until it does not ask for a restart by returning nothing.
+ */
+template<typename Key, typename CmpFn>
+template<typename Read>
+auto olc_ordered_set<Key, CmpFn>::retry(Read read)
+{
+    for (unsigned attempt = 1;; attempt++) {
+        auto result = read();
+        if (result)
+            return *std::move(result);
+        if (attempt % 16 == 0)
+            std::this_thread::yield();
+    }
+}
+
+/**
+ * Records the path to the leaf which may hold the key together with the versions of its nodes. The version of each
+ * child is read before its parent is validated, so every node on the path was the right one for the key when its
+ * version was read. Returns false if the descent has to restart.
+ */
+template<typename Key, typename CmpFn>
+bool olc_ordered_set<Key, CmpFn>::descend(const Key& key, path& p) const
+{
+    node* x = m_root.load(std::memory_order_acquire);
+    std::uint64_t version;
+    if (!read_lock(x, version) || x != m_root.load(std::memory_order_acquire))
+        return false;
+    size_t level = 0;
+    while (!x->leaf) {
+        if (level + 1 == MAX_HEIGHT)
+            return false;
+        inner_node* y = as_inner(x);
+        size_t i = child_index(y, key);
+        node* child = load_child(y, i);
+        std::uint64_t child_version;
+        if (!read_lock(child, child_version) || !validate(x, version))
+            return false;
+        p.nodes[level] = x;
+        p.versions[level] = version;
+        p.indices[level] = i;
+        level++;
+        x = child;
+        version = child_version;
+    }
+    p.nodes[level] = x;
+    p.versions[level] = version;
+    p.height = level;
+    return true;
+}
+
+/**
+ * Write locks the path from the given level down, each node only if it still has the recorded version, and waits
+ * until no writer adds to the counts of the locked inner nodes. On failure unlocks the locked prefix and returns
+ * false.
+ */
+template<typename Key, typename CmpFn>
+bool olc_ordered_set<Key, CmpFn>::lock(path& p, size_t from)
+{
+    for (size_t level = from; level <= p.height; level++) {
+        std::uint64_t expected = p.versions[level];
+        // sequentially consistent, so that either this writer sees a marking by add_sizes or add_sizes sees the lock
+        if (!p.nodes[level]->version.compare_exchange_strong(expected, expected + LOCKED)) {
+            for (size_t i = from; i < level; i++)
+                p.nodes[i]->version.fetch_add(LOCKED, std::memory_order_release);
+            return false;
+        }
+    }
+    // a root split installs a new root above the locked old one, which must not be taken for the whole tree
+    if (from == 0 && p.nodes[0] != m_root.load(std::memory_order_relaxed)) {
+        unlock(p, from);
+        return false;
+    }
+    for (size_t level = from; level < p.height; level++)
+        while (as_inner(p.nodes[level])->updaters.load() != 0)
+            std::this_thread::yield();
+    return true;
+}
+
+/**
+ * Unlocking adds LOCKED once more, which clears the lock bit and carries into a new version.
+ */
+template<typename Key, typename CmpFn> inline
+void olc_ordered_set<Key, CmpFn>::unlock(const path& p, size_t from)
+{
+    for (size_t level = from; level <= p.height; level++)
+        p.nodes[level]->version.fetch_add(LOCKED, std::memory_order_release);
+}
+
+/**
+ * Adds delta to the counts of the path above the given level by atomic additions, without locking the nodes. The
+ * nodes are marked before their versions are checked, so a writer locking one of them to split it either makes the
+ * check fail or waits for the additions to complete. Returns false, having added nothing, if any of the nodes changed.
+ */
+template<typename Key, typename CmpFn>
+bool olc_ordered_set<Key, CmpFn>::add_sizes(const path& p, size_t levels, std::ptrdiff_t delta)
+{
+    for (size_t level = 0; level < levels; level++)
+        as_inner(p.nodes[level])->updaters.fetch_add(1);
+    bool valid = true;
+    for (size_t level = 0; level < levels && valid; level++)
+        valid = p.nodes[level]->version.load() == p.versions[level];
+    for (size_t level = 0; level < levels; level++) {
+        inner_node* x = as_inner(p.nodes[level]);
+        if (valid)
+            __atomic_fetch_add(&x->sizes[p.indices[level]], static_cast<size_t>(delta), __ATOMIC_RELAXED);
+        x->updaters.fetch_sub(1, std::memory_order_release);
+    }
+    return valid;
+}
+
+/**
+ * Returns the key of the given order counted from the front or from the back.
+ */
+template<typename Key, typename CmpFn>
+std::optional<Key> olc_ordered_set<Key, CmpFn>::select(size_t order, bool from_back) const
+{
+    return retry([this, order, from_back]() -> std::optional<std::optional<Key>> {
+        node* x = m_root.load(std::memory_order_acquire);
+        std::uint64_t version;
+        if (!read_lock(x, version) || x != m_root.load(std::memory_order_acquire))
+            return std::nullopt;
+        return select_from(x, version, order, from_back);
+    });
+}
+
+/**
+ * Descends by the counts from x, whose version has been read, towards the given order counted from the front or from
+ * the back, reading the version of every child before validating its parent and validating the leaf at the end.
+ * Returns an empty key if the counts of x add up to at most order. As the counts are adjusted without locking, the
+ * counts of a child may lag behind those of its parent, the descent then restarts by returning nothing.
+ */
+template<typename Key, typename CmpFn>
+std::optional<std::optional<Key>> olc_ordered_set<Key, CmpFn>::select_from(node* x, std::uint64_t version,
+                                                                           size_t order, bool from_back)
+{
+    size_t level = 0;
+    for (; !x->leaf; level++) {
+        if (level + 1 == MAX_HEIGHT)
+            return std::nullopt;
+        inner_node* y = as_inner(x);
+        size_t n = count(y, INNER_CAPACITY);
+        size_t i = 0;
+        for (; i <= n; i++) {
+            size_t c = load(y->sizes[from_back ? n - i : i]);
+            if (order < c)
+                break;
+            order -= c;
+        }
+        if (i > n)
+            return validate(x, version) && level == 0 ? std::optional<std::optional<Key>>{std::optional<Key>{}}
+                                                      : std::nullopt;
+        node* child = load_child(y, from_back ? n - i : i);
+        std::uint64_t child_version;
+        if (!read_lock(child, child_version) || !validate(x, version))
+            return std::nullopt;
+        x = child;
+        version = child_version;
+    }
+    leaf_node* leaf = as_leaf(x);
+    size_t n = count(leaf, LEAF_CAPACITY);
+    std::optional<Key> result;
+    if (order < n)
+        result = load_key(leaf->keys[from_back ? n - 1 - order : order]);
+    if (!validate(x, version) || (!result && level > 0))
+        return std::nullopt;
+    return std::optional<std::optional<Key>>{result};
+}
+
+/**
+ * Returns the least key greater than the given one. If the leaf covering the key holds none, it is the least key of
+ * the nearest subtree right of the path which is not empty.
+ */
+template<typename Key, typename CmpFn>
+std::optional<Key> olc_ordered_set<Key, CmpFn>::successor(const Key& key) const
+{
+    return retry([this, &key]() -> std::optional<std::optional<Key>> {
+        path p;
+        if (!descend(key, p))
+            return std::nullopt;
+        const leaf_node* leaf = as_leaf(p.nodes[p.height]);
+        size_t n = count(leaf, LEAF_CAPACITY);
+        size_t i = lower_bound(leaf->keys, n, key);
+        if (i < n && !CMP(key, load_key(leaf->keys[i])))
+            i++;
+        if (i < n) {
+            Key found = load_key(leaf->keys[i]);
+            return validate(leaf, p.versions[p.height]) ? std::optional<std::optional<Key>>{found} : std::nullopt;
+        }
+        node* x = nullptr;
+        for (size_t level = p.height; x == nullptr && level-- > 0; ) {
+            const inner_node* y = as_inner(p.nodes[level]);
+            size_t m = count(y, INNER_CAPACITY);
+            for (size_t j = p.indices[level] + 1; x == nullptr && j <= m; j++)
+                if (load(y->sizes[j]) > 0)
+                    x = load_child(y, j);
+        }
+        std::uint64_t version = 0;
+        if ((x != nullptr && !read_lock(x, version)) || !validate(p))
+            return std::nullopt;
+        if (x == nullptr)
+            return std::optional<std::optional<Key>>{std::optional<Key>{}};
+        std::optional<std::optional<Key>> found = select_from(x, version, 0, false);
+        // the subtree was counted as not empty, finding nothing means the counts were caught being adjusted
+        if (found && !*found)
+            return std::nullopt;
+        return found;
+    });
+}
+
+/**
+ * Inserts the key into the locked leaf of the path, splitting it and its locked ancestors from the given level down
+ * as needed.
+ */
+template<typename Key, typename CmpFn>
+void olc_ordered_set<Key, CmpFn>::insert_locked(path& p, size_t from, const Key& key)
+{
+    for (size_t level = from; level < p.height; level++) {
+        size_t& size = as_inner(p.nodes[level])->sizes[p.indices[level]];
+        store(size, size + 1);
+    }
+    leaf_node* leaf = as_leaf(p.nodes[p.height]);
+    size_t n = leaf->count;
+    size_t i = static_cast<size_t>(std::lower_bound(leaf->keys, leaf->keys + n, key, CMP) - leaf->keys);
+    if (n < LEAF_CAPACITY) {
+        for (size_t j = n; j > i; j--)
+            store_key(leaf->keys[j], leaf->keys[j - 1]);
+        store_key(leaf->keys[i], key);
+        store(leaf->count, leaf->count + 1);
+        return;
+    }
+    std::array<Key, LEAF_CAPACITY + 1> keys;
+    std::copy(leaf->keys, leaf->keys + i, keys.begin());
+    keys[i] = key;
+    std::copy(leaf->keys + i, leaf->keys + n, keys.begin() + i + 1);
+    const size_t half = (LEAF_CAPACITY + 1) / 2;
+    leaf_node* right = new leaf_node{};
+    for (size_t j = 0; j < half; j++)
+        store_key(leaf->keys[j], keys[j]);
+    std::copy(keys.begin() + half, keys.end(), right->keys);
+    store(leaf->count, static_cast<std::uint32_t>(half));
+    right->count = LEAF_CAPACITY + 1 - half;
+    insert_child(p, p.height, right->keys[0], right, leaf->count, right->count);
+}
+
+/**
+ * Links right, split off the node at the given level of the path, into its parent next to the split node, splitting
+ * the parent in turn if it is full. Splitting the root grows the tree by a new root.
+ */
+template<typename Key, typename CmpFn>
+void olc_ordered_set<Key, CmpFn>::insert_child(path& p, size_t level, const Key& separator, node* right,
+                                               size_t left_size, size_t right_size)
+{
+    if (level == 0) {
+        inner_node* root = new inner_node{};
+        root->count = 1;
+        root->keys[0] = separator;
+        root->children[0] = p.nodes[0];
+        root->children[1] = right;
+        root->sizes[0] = left_size;
+        root->sizes[1] = right_size;
+        m_root.store(root, std::memory_order_release);
+        return;
+    }
+    inner_node* parent = as_inner(p.nodes[level - 1]);
+    size_t i = p.indices[level - 1];
+    size_t n = parent->count;
+    if (n < INNER_CAPACITY) {
+        for (size_t j = n; j > i; j--) {
+            store_key(parent->keys[j], parent->keys[j - 1]);
+            store_child(parent, j + 1, parent->children[j]);
+            store(parent->sizes[j + 1], parent->sizes[j]);
+        }
+        store_key(parent->keys[i], separator);
+        store_child(parent, i + 1, right);
+        store(parent->sizes[i], left_size);
+        store(parent->sizes[i + 1], right_size);
+        store(parent->count, parent->count + 1);
+        return;
+    }
+    std::array<Key, INNER_CAPACITY + 1> keys;
+    std::array<node*, INNER_CAPACITY + 2> children;
+    std::array<size_t, INNER_CAPACITY + 2> sizes;
+    std::copy(parent->keys, parent->keys + i, keys.begin());
+    keys[i] = separator;
+    std::copy(parent->keys + i, parent->keys + n, keys.begin() + i + 1);
+    std::copy(parent->children, parent->children + i + 1, children.begin());
+    children[i + 1] = right;
+    std::copy(parent->children + i + 1, parent->children + n + 1, children.begin() + i + 2);
+    std::copy(parent->sizes, parent->sizes + i, sizes.begin());
+    sizes[i] = left_size;
+    sizes[i + 1] = right_size;
+    std::copy(parent->sizes + i + 1, parent->sizes + n + 1, sizes.begin() + i + 2);
+
+    // the left half keeps half separators, the next one moves up, the right half gets the rest
+    const size_t half = (INNER_CAPACITY + 1) / 2;
+    inner_node* sibling = new inner_node{};
+    for (size_t j = 0; j < half; j++)
+        store_key(parent->keys[j], keys[j]);
+    for (size_t j = 0; j <= half; j++) {
+        store_child(parent, j, children[j]);
+        store(parent->sizes[j], sizes[j]);
+    }
+    store(parent->count, static_cast<std::uint32_t>(half));
+    std::copy(keys.begin() + half + 1, keys.end(), sibling->keys);
+    std::copy(children.begin() + half + 1, children.end(), sibling->children);
+    std::copy(sizes.begin() + half + 1, sizes.end(), sibling->sizes);
+    sibling->count = INNER_CAPACITY - half;
+    insert_child(p, level - 1, keys[half], sibling, total(parent), total(sibling));
+}
+
+template<typename Key, typename CmpFn>
+void olc_ordered_set<Key, CmpFn>::delete_tree(node* x)
+{
+    if (x->leaf) {
+        delete as_leaf(x);
+        return;
+    }
+    inner_node* y = as_inner(x);
+    for (size_t i = 0; i <= y->count; i++)
+        delete_tree(y->children[i]);
+    delete y;
+}
+
+} //!jp
@@ -0,0 +1,552 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <queue>
+#include <ostream>
+#include <sstream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <initializer_list>
+
+#include "detail/rb_tree.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A sequence container addressed by index, i.e. an ordered_set with implicit keys. Elements are located with the same
+ * subtree size descent as ordered_set::find_by_order, so insert_at, erase_at, at, split_at and concat are O(log n).
+ *
+ * Leaves are represented by nullptr instead of a per-container sentinel, so that whole subtrees can be moved between
+ * sequences by split_at and concat without relinking their leaves. Trees are split and concatenated with join by
+ * black height, as described in 'Parallel Ordered Sets Using Join' by G. E. Blelloch, D. Ferizovic and Y. Sun.
+ * The tree algorithms are the key independent ones of detail/rb_tree.hpp, shared with ordered_set.
+ */
+template<typename T>
+class ordered_sequence
+{
+    struct node : detail::rb_node
+    {
+        T value;
+
+        node() = delete;
+        node(const T& value);
+        std::string str() const;
+    };
+
+public:
+    class const_iterator
+    {
+        friend class ordered_sequence<T>;
+        const_iterator(const ordered_sequence* sequence, node* nd);
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator() = delete;
+        const_iterator(const const_iterator& other) = default;
+        const_iterator(const_iterator&&) = default;
+        const_iterator& operator=(const const_iterator& other) = default;
+        const_iterator& operator=(const_iterator&&) = default;
+        ~const_iterator() = default;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        bool operator==(const const_iterator& other) const;
+        bool operator!=(const const_iterator& other) const;
+        const T* operator->() const;
+        const T& operator*() const;
+    private:
+        const ordered_sequence* m_sequence;
+        node* m_node;
+    };
+
+    ordered_sequence();
+    ordered_sequence(std::initializer_list<T> values);
+    ordered_sequence(const ordered_sequence& other);
+    ordered_sequence(ordered_sequence&& other);
+    ordered_sequence& operator=(const ordered_sequence& other);
+    ordered_sequence& operator=(ordered_sequence&& other);
+    ~ordered_sequence();
+    template<typename ForwardIt>
+    void assign(ForwardIt first, ForwardIt last);
+    const_iterator insert_at(size_t index, const T& value);
+    void push_back(const T& value);
+    void erase_at(size_t index);
+    T& at(size_t index);
+    const T& at(size_t index) const;
+    T& operator[](size_t index);
+    const T& operator[](size_t index) const;
+    ordered_sequence split_at(size_t index);
+    void concat(ordered_sequence&& other);
+    const_iterator find_by_order(size_t order) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+
+    template<typename U>
+    friend std::ostream& operator<<(std::ostream& out, const ordered_sequence<U>& sequence);
+
+private:
+    static node* cast(detail::rb_node* x);
+    static detail::rb_node* copy_tree(detail::rb_node* x, detail::rb_node* parent);
+    template<typename ForwardIt>
+    static detail::rb_node* build(ForwardIt& it, size_t count, size_t depth, size_t red_depth,
+                                  detail::rb_node* parent);
+    node* search(size_t index) const;
+    static void erase_tree(detail::rb_node* root);
+    void print(std::ostream& out, detail::rb_node* x, std::string& prefix) const;
+
+    static constexpr bool RED = detail::RB_RED;
+    static constexpr bool BLACK = detail::RB_BLACK;
+    detail::rb_node* m_root;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename T> inline
+ordered_sequence<T>::node::node(const T& value)
+    : detail::rb_node{1, nullptr, nullptr, nullptr, RED}
+    , value{value}
+{ }
+
+template<typename T> inline
+ordered_sequence<T>::const_iterator::const_iterator(const ordered_sequence* sequence, node* nd)
+    : m_sequence{sequence}
+    , m_node{nd}
+{ }
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator& ordered_sequence<T>::const_iterator::operator++()
+{
+    if (m_node != nullptr)
+        m_node = cast(detail::rb_successor(m_node));
+    return *this;
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator ordered_sequence<T>::const_iterator::operator++(int)
+{
+    const_iterator tmp{*this};
+    operator++();
+    return tmp;
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator& ordered_sequence<T>::const_iterator::operator--()
+{
+    if (m_node == nullptr)
+        m_node = cast(detail::rb_max(m_sequence->m_root));
+    else
+        m_node = cast(detail::rb_predecessor(m_node));
+    return *this;
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator ordered_sequence<T>::const_iterator::operator--(int)
+{
+    const_iterator tmp{*this};
+    operator--();
+    return tmp;
+}
+
+template<typename T> inline
+bool ordered_sequence<T>::const_iterator::operator==(const ordered_sequence::const_iterator& other) const
+{
+    return m_node == other.m_node;
+}
+
+template<typename T> inline
+bool ordered_sequence<T>::const_iterator::operator!=(const ordered_sequence::const_iterator& other) const
+{
+    return m_node != other.m_node;
+}
+
+template<typename T> inline
+const T* ordered_sequence<T>::const_iterator::operator->() const
+{
+    return &(m_node->value);
+}
+
+template<typename T> inline
+const T& ordered_sequence<T>::const_iterator::operator*() const
+{
+    return m_node->value;
+}
+
+template<typename T> inline
+ordered_sequence<T>::ordered_sequence()
+    : m_root{nullptr}
+{ }
+
+template<typename T> inline
+ordered_sequence<T>::ordered_sequence(std::initializer_list<T> values)
+    : ordered_sequence()
+{
+    assign(values.begin(), values.end());
+}
+
+template<typename T> inline
+ordered_sequence<T>::ordered_sequence(const ordered_sequence& other)
+    : m_root{copy_tree(other.m_root, nullptr)}
+{ }
+
+template<typename T> inline
+ordered_sequence<T>::ordered_sequence(ordered_sequence&& other)
+    : m_root{other.m_root}
+{
+    other.m_root = nullptr;
+}
+
+template<typename T>
+ordered_sequence<T>& ordered_sequence<T>::operator=(const ordered_sequence& other)
+{
+    if (&other == this)
+        return *this;
+    detail::rb_node* root = copy_tree(other.m_root, nullptr);
+    clear();
+    m_root = root;
+    return *this;
+}
+
+template<typename T>
+ordered_sequence<T>& ordered_sequence<T>::operator=(ordered_sequence&& other)
+{
+    if (&other == this)
+        return *this;
+    clear();
+    m_root = other.m_root;
+    other.m_root = nullptr;
+    return *this;
+}
+
+template<typename T> inline
+ordered_sequence<T>::~ordered_sequence()
+{
+    erase_tree(m_root);
+}
+
+/**
+ * Replaces the content with [first, last) in O(n). The tree is built balanced, with the nodes of the deepest, possibly
+ * incomplete level colored red. The old content is only freed once the new tree is complete, so it is kept if copying
+ * an element throws.
+ */
+template<typename T>
+template<typename ForwardIt>
+void ordered_sequence<T>::assign(ForwardIt first, ForwardIt last)
+{
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    size_t red_depth = 0;
+    while ((size_t{2} << red_depth) <= count)
+        red_depth++;
+    detail::rb_node* root = build(first, count, 0, red_depth, nullptr);
+    if (root != nullptr)
+        root->color = BLACK;
+    clear();
+    m_root = root;
+}
+
+/**
+ * Inserts the value before the element at the given index, or at the end if index is size(). Throws
+ * std::out_of_range if index is greater than size().
+ */
+template<typename T>
+typename ordered_sequence<T>::const_iterator ordered_sequence<T>::insert_at(size_t index, const T& value)
+{
+    if (index > size())
+        throw std::out_of_range("jp::ordered_sequence::insert_at");
+    node* z = new node(value);
+    if (index == size()) {
+        detail::rb_insert(m_root, detail::rb_max(m_root), false, z);
+    } else {
+        detail::rb_node* y = search(index);
+        if (y->left == nullptr)
+            detail::rb_insert(m_root, y, true, z);
+        else
+            detail::rb_insert(m_root, detail::rb_max(y->left), false, z);
+    }
+    return const_iterator{this, z};
+}
+
+template<typename T> inline
+void ordered_sequence<T>::push_back(const T& value)
+{
+    insert_at(size(), value);
+}
+
+/**
+ * Throws std::out_of_range if there is no element at the given index.
+ */
+template<typename T>
+void ordered_sequence<T>::erase_at(size_t index)
+{
+    if (index >= size())
+        throw std::out_of_range("jp::ordered_sequence::erase_at");
+    node* z = search(index);
+    detail::rb_erase(m_root, z);
+    delete z;
+}
+
+template<typename T> inline
+T& ordered_sequence<T>::at(size_t index)
+{
+    if (index >= size())
+        throw std::out_of_range("jp::ordered_sequence::at");
+    return search(index)->value;
+}
+
+template<typename T> inline
+const T& ordered_sequence<T>::at(size_t index) const
+{
+    if (index >= size())
+        throw std::out_of_range("jp::ordered_sequence::at");
+    return search(index)->value;
+}
+
+template<typename T> inline
+T& ordered_sequence<T>::operator[](size_t index)
+{
+    return search(index)->value;
+}
+
+template<typename T> inline
+const T& ordered_sequence<T>::operator[](size_t index) const
+{
+    return search(index)->value;
+}
+
+/**
+ * Keeps the elements [0, index) and returns a sequence with the elements [index, size()). No node is reallocated.
+ * Throws std::out_of_range if index is greater than size().
+ */
+template<typename T>
+ordered_sequence<T> ordered_sequence<T>::split_at(size_t index)
+{
+    if (index > size())
+        throw std::out_of_range("jp::ordered_sequence::split_at");
+    ordered_sequence rest{};
+    size_t lhs_bh = 0;
+    size_t rhs_bh = 0;
+    detail::rb_split(m_root, detail::rb_black_height(m_root), index, m_root, lhs_bh, rest.m_root, rhs_bh);
+    return rest;
+}
+
+/**
+ * Appends all elements of the other sequence, leaving it empty. No node is reallocated.
+ */
+template<typename T>
+void ordered_sequence<T>::concat(ordered_sequence&& other)
+{
+    if (&other == this || other.m_root == nullptr)
+        return;
+    if (m_root == nullptr) {
+        std::swap(m_root, other.m_root);
+        return;
+    }
+    detail::rb_node* k = detail::rb_min(other.m_root);
+    detail::rb_erase(other.m_root, k);
+    size_t bh = 0;
+    detail::rb_join(m_root, m_root, detail::rb_black_height(m_root), k, other.m_root,
+                    detail::rb_black_height(other.m_root), bh);
+    other.m_root = nullptr;
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator ordered_sequence<T>::find_by_order(size_t order) const
+{
+    return const_iterator{this, search(order)};
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator ordered_sequence<T>::begin() const
+{
+    return const_iterator{this, cast(detail::rb_min(m_root))};
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::const_iterator ordered_sequence<T>::end() const
+{
+    return const_iterator{this, nullptr};
+}
+
+template<typename T> inline
+size_t ordered_sequence<T>::size() const
+{
+    return detail::rb_size(m_root);
+}
+
+template<typename T> inline
+bool ordered_sequence<T>::empty() const
+{
+    return m_root == nullptr;
+}
+
+template<typename T> inline
+void ordered_sequence<T>::clear()
+{
+    erase_tree(m_root);
+    m_root = nullptr;
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::node* ordered_sequence<T>::cast(detail::rb_node* x)
+{
+    return static_cast<node*>(x);
+}
+
+/**
+ * Copies the subtree of x, freeing the nodes already copied if copying an element throws.
+ */
+template<typename T>
+detail::rb_node* ordered_sequence<T>::copy_tree(detail::rb_node* x, detail::rb_node* parent)
+{
+    if (x == nullptr)
+        return nullptr;
+    node* y = new node(cast(x)->value);
+    y->size = x->size;
+    y->parent = parent;
+    y->color = x->color;
+    try {
+        y->left = copy_tree(x->left, y);
+        y->right = copy_tree(x->right, y);
+    } catch (...) {
+        erase_tree(y);
+        throw;
+    }
+    return y;
+}
+
+template<typename T>
+template<typename ForwardIt>
+detail::rb_node*
+ordered_sequence<T>::build(ForwardIt& it, size_t count, size_t depth, size_t red_depth, detail::rb_node* parent)
+{
+    if (count == 0)
+        return nullptr;
+    size_t left_count = (count - 1) / 2;
+    detail::rb_node* left = build(it, left_count, depth + 1, red_depth, nullptr);
+    node* x = nullptr;
+    try {
+        x = new node(*it);
+        ++it;
+    } catch (...) {
+        erase_tree(left);
+        throw;
+    }
+    x->size = count;
+    x->left = left;
+    x->parent = parent;
+    x->color = depth == red_depth ? RED : BLACK;
+    if (left != nullptr)
+        left->parent = x;
+    try {
+        x->right = build(it, count - 1 - left_count, depth + 1, red_depth, x);
+    } catch (...) {
+        erase_tree(x);
+        throw;
+    }
+    return x;
+}
+
+template<typename T> inline
+typename ordered_sequence<T>::node* ordered_sequence<T>::search(size_t index) const
+{
+    return cast(detail::rb_select(m_root, index));
+}
+
+template<typename T> inline
+void ordered_sequence<T>::erase_tree(detail::rb_node* root)
+{
+    if (root == nullptr)
+        return;
+    std::queue<detail::rb_node*> buffor;
+    buffor.push(root);
+    while (!buffor.empty()) {
+        detail::rb_node* x = buffor.front();
+        buffor.pop();
+        if (x->left != nullptr)
+            buffor.push(x->left);
+        if (x->right != nullptr)
+            buffor.push(x->right);
+        delete cast(x);
+    }
+}
+
+template<typename T> inline
+std::ostream& operator<<(std::ostream& out, const ordered_sequence<T>& sequence)
+{
+    if (sequence.m_root == nullptr) {
+        out << "(empty_tree)";
+        return out;
+    }
+
+    std::string prefix = " ";
+    sequence.print(out, sequence.m_root, prefix);
+    out << "(value,size,color)";
+    return out;
+}
+
+template<typename T> inline
+void ordered_sequence<T>::print(std::ostream& out, detail::rb_node* x, std::string& prefix) const
+{
+    auto prefixEnd = prefix.back();
+    auto prefixSize = prefix.size();
+    std::string str = cast(x)->str();
+    bool is_right = x->parent != nullptr && x->parent->right == x;
+
+    prefix[prefixSize - 1] = is_right ? ' ' : prefixEnd;
+    prefix.resize(prefix.size() + str.size() - 1, ' ');
+    prefix.back() = '|';
+    if (x->right != nullptr)
+        print(out, x->right, prefix);
+
+    std::string_view prefixView = prefix;
+    out << prefixView.substr(0, prefix.size() - str.size()) << str << '\n';
+
+    prefix[prefixSize - 1] = is_right ? prefixEnd : ' ';
+    if (x->left != nullptr)
+        print(out, x->left, prefix);
+    prefix.resize(prefix.size() - str.size() + 1);
+}
+
+template<typename T> inline
+std::string ordered_sequence<T>::node::str() const
+{
+    std::stringstream ss{};
+    ss << '(' << value << ',' << size << ',' << (color ? 'b' : 'r') << ')';
+    return ss.str();
+}
+
+} //!jp
@@ -25,11 +25,25 @@
 #pragma once
 
 #include <queue>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <istream>
 #include <ostream>
+#include <algorithm>
 #include <cassert>
+#include <limits>
 #include <sstream>
+#include <future>
+#include <optional>
+#include <stdexcept>
 #include <string_view>
 
+#include "detail/rb_tree.hpp"
+#include "detail/hash_index.hpp"
+#include "detail/counting_filter.hpp"
+#include "thread_pool.hpp"
+
 namespace jp {
 
 /////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
@@ -40,39 +54,76 @@ namespace jp {
  * PBDS docs:
  * https://gcc.gnu.org/onlinedocs/libstdc++/ext/pb_ds/tree_based_containers.html
  *
- * Red-black tree implementation according to 'Introduction to Algorithms, Third Edition' by T. H. Cormen.
+ * Red-black tree implementation according to 'Introduction to Algorithms, Third Edition' by T. H. Cormen. Rebalancing
+ * and size maintenance are done by the key independent functions of detail/rb_tree.hpp on the rb_node header of the
+ * nodes, only the descents comparing keys are instantiated per key type.
+ *
+ * Nodes are obtained from Allocator rebound to the node type, see cached_allocator for a per-thread node cache shared
+ * by all sets and huge_page_allocator for packing the nodes of large sets into huge pages. An empty set allocates
+ * nothing.
+ *
+ * The async_* operations split the whole-set work over the subtrees and run it on a thread_pool. Until the returned
+ * future is ready the set, and the set or range passed, must not be used, with the exception of async_clear which
+ * detaches the nodes at once. The nodes are allocated and freed by several threads, so the allocator has to be
+ * thread-safe.
  */
 template<
         typename Key,
-        typename Cmp_Fn = std::less<Key>
+        typename Cmp_Fn = std::less<Key>,
+        typename Allocator = std::allocator<Key>
         >
 class ordered_set
 {
-    struct node
+    struct node : detail::rb_node
     {
-        size_t size;
-        node* left;
-        node* right;
-        node* parent;
         Key key;
-        bool color;
 
         node() = delete;
-        node(const Key& key, size_t size, node* left, node* right, node* parent, bool color);
+        node(const Key& key);
         std::string str() const;
     };
 
+    using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+    using node_traits = std::allocator_traits<node_allocator>;
+
+    struct spine_entry
+    {
+        detail::rb_node* tree;
+        size_t bh;
+        node* next;
+    };
+
+    struct journal : detail::rb_journal
+    {
+        std::vector<node*> allocated;
+        std::vector<node*> retired;
+    };
+
 public:
+    using filter_stats = detail::filter_stats;
+
+    /**
+     * Marks a state of the set that can be restored with rollback.
+     */
+    struct checkpoint_type
+    {
+        size_t links;
+        size_t sizes;
+        size_t colors;
+        size_t allocated;
+        size_t retired;
+    };
+
     class const_iterator : public std::iterator<std::bidirectional_iterator_tag, node>
     {
-        friend class ordered_set<Key, Cmp_Fn>;
+        friend class ordered_set<Key, Cmp_Fn, Allocator>;
         const_iterator(const ordered_set* tree, node* nd);
     public:
         const_iterator() = delete;
         const_iterator(const const_iterator& other);
-        const_iterator(const_iterator&&) = delete;
-        const_iterator operator=(const const_iterator& other);
-        const_iterator operator=(const_iterator&&) = delete;
+        const_iterator(const_iterator&&) = default;
+        const_iterator& operator=(const const_iterator& other);
+        const_iterator& operator=(const_iterator&&) = default;
         ~const_iterator() = default;
         const_iterator& operator++();
         const_iterator operator++(int);
@@ -88,16 +139,24 @@ public:
     };
 
     ordered_set();
+    explicit ordered_set(const Allocator& alloc);
     ordered_set(const ordered_set& other);
     ordered_set(ordered_set&& other);
-    ordered_set operator=(const ordered_set& other);
-    ordered_set operator=(ordered_set&& other);
+    ordered_set& operator=(const ordered_set& other);
+    ordered_set& operator=(ordered_set&& other);
     ~ordered_set();
     std::pair<const_iterator, bool> insert(const Key& key);
     const_iterator erase(const Key& key);
+    bool erase_by_order(size_t order);
+    Key extract_by_order(size_t order);
+    size_t erase_less_than(const Key& key);
+    size_t erase_prefix(size_t count);
     size_t order_of_key(const Key& key) const;
     const_iterator find(const Key& key) const;
+    bool contains(const Key& key) const;
     const_iterator find_by_order(size_t order) const;
+    std::vector<const_iterator> partition_points(size_t k) const;
+    std::vector<std::pair<const_iterator, const_iterator>> subranges(size_t k) const;
     const_iterator min() const;
     const_iterator max() const;
     const_iterator begin() const;
@@ -105,628 +164,1319 @@ public:
     size_t size() const;
     bool empty() const;
     void clear();
-
-    template<typename T, typename C>
-    friend std::ostream& operator<<(std::ostream& out, const ordered_set<T, C>& tree);
+    checkpoint_type checkpoint();
+    void rollback(const checkpoint_type& cp);
+    void commit();
+    void enable_hash_index();
+    void disable_hash_index();
+    bool has_hash_index() const;
+    void enable_filter(double fpr = 0.01, size_t max_bytes = std::numeric_limits<size_t>::max());
+    void disable_filter();
+    bool has_filter() const;
+    void rebuild_filter();
+    filter_stats filter_statistics() const;
+    std::future<ordered_set> async_copy(thread_pool& pool = thread_pool::shared()) const;
+    template<typename RandomIt>
+    std::future<void> async_assign(RandomIt first, RandomIt last, thread_pool& pool = thread_pool::shared());
+    std::future<void> async_merge(const ordered_set& other, thread_pool& pool = thread_pool::shared());
+    template<typename Pred>
+    std::future<size_t> async_erase_if(Pred pred, thread_pool& pool = thread_pool::shared());
+    std::future<void> async_clear(thread_pool& pool = thread_pool::shared());
+    template<typename Source>
+    void build_from_stream(Source&& source);
+
+    template<typename T, typename C, typename A>
+    friend std::ostream& operator<<(std::ostream& out, const ordered_set<T, C, A>& tree);
 
 private:
+    static node* cast(detail::rb_node* x);
+    detail::rb_journal* log() const;
+    void adopt_journal(ordered_set& other);
+    void forbid_checkpoint(const char* function) const;
+    node* allocate(const Key& key);
+    void destroy(node* x);
+    void deallocate(node* x);
+    void release(node* x);
+    void track(node* x);
+    void untrack(node* x);
     void delete_all_memory();
     void deep_copy(const ordered_set& src, ordered_set& dst);
     bool equal(const Key& lhs, const Key& rhs) const;
     bool not_equal(const Key& lhs, const Key& rhs) const;
-    node* successor(node* x) const;
-    node* predecessor(node* x) const;
-    node* min(node* x) const;
-    node* max(node* x) const;
     node* search(const Key& key) const;
-    void erase_tree(node* root);
-    void rotate_left(node* x);
-    void rotate_right(node* x);
-    void transplant(node* u, node* v);
-    void updateSize(node* start, node* end, size_t value);
+    void collect_by_order(detail::rb_node* x, size_t offset, const size_t* first, const size_t* last,
+                          node** out) const;
+    void erase_tree(detail::rb_node* root);
+    static node* create(node_allocator& alloc, const Key& key);
+    template<typename Left, typename Right>
+    static void fork_join(thread_pool& pool, bool parallel, Left&& left, Right&& right);
+    template<typename RandomIt>
+    void create_parallel(RandomIt first, node** out, size_t count, thread_pool& pool);
+    static void collect_parallel(detail::rb_node* x, node** out, thread_pool& pool);
+    static detail::rb_node* link_parallel(node** nodes, size_t count, size_t depth, size_t red_depth,
+                                          thread_pool& pool);
+    static detail::rb_node* copy_parallel(const detail::rb_node* x, node_allocator& alloc, thread_pool& pool);
+    static void free_parallel(detail::rb_node* root, node_allocator& alloc, thread_pool& pool);
+    void replace_tree(std::vector<node*>& nodes, thread_pool& pool);
+    template<typename Next>
+    void build_from_keys(Next& next);
+    detail::rb_node* drop_prefix(detail::rb_node* x, size_t bh, size_t count, size_t& rest_bh);
     const_iterator erase(node* z);
-    void fixup_erase(node* x);
-    void fixup_insert(node* z);
-    void print(std::ostream& out, node* x, std::string& prefix) const;
+    node* detach_by_order(size_t order);
+    void print(std::ostream& out, detail::rb_node* x, std::string& prefix) const;
 
-    static constexpr bool RED = 0;
-    static constexpr bool BLACK = 1;
+    static constexpr bool RED = detail::RB_RED;
+    static constexpr bool BLACK = detail::RB_BLACK;
     static constexpr Cmp_Fn CMP = Cmp_Fn();
-    node* m_nil;
-    node* m_root;
+    static constexpr bool HASHABLE = detail::is_hashable<Key>::value;
+    static constexpr size_t FILTER_MIN_CAPACITY = 64;
+    static constexpr size_t PARALLEL_GRAIN = size_t{1} << 14;
+    static constexpr size_t MAX_SPINE = 64;
+    node_allocator m_alloc;
+    detail::rb_node* m_root;
+    std::unique_ptr<journal> m_journal;
+    std::unique_ptr<detail::hash_index<node, Key, Cmp_Fn>> m_index;
+    std::unique_ptr<detail::counting_filter<Key>> m_filter;
 };
 
 
 /////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
 
-template<typename Key, typename CmpFn> inline
-ordered_set<Key, CmpFn>::node::node(const Key& key, size_t size, node* left, node* right, node* parent, bool color)
-    : size{size}
-    , left{left}
-    , right{right}
-    , parent{parent}
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::node::node(const Key& key)
+    : detail::rb_node{1, nullptr, nullptr, nullptr, RED}
     , key{key}
-    , color{color}
 { }
 
-template<typename Key, typename CmpFn> inline
-ordered_set<Key, CmpFn>::const_iterator::const_iterator(const ordered_set* tree, node* nd)
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::const_iterator::const_iterator(const ordered_set* tree, node* nd)
     : m_tree{tree}
     , m_node{nd}
 { }
 
-template<typename Key, typename CmpFn> inline
-ordered_set<Key, CmpFn>::const_iterator::const_iterator(const ordered_set::const_iterator& other)
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::const_iterator::const_iterator(const ordered_set::const_iterator& other)
     : m_tree{other.m_tree}
     , m_node{other.m_node}
 { }
 
-template<typename Key, typename CmpFn>
-typename ordered_set<Key, CmpFn>::const_iterator
-ordered_set<Key, CmpFn>::const_iterator::operator=(const ordered_set::const_iterator& other)
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator&
+ordered_set<Key, CmpFn, Alloc>::const_iterator::operator=(const ordered_set::const_iterator& other)
 {
     m_tree = other.m_tree;
     m_node = other.m_node;
+    return *this;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator& ordered_set<Key, CmpFn>::const_iterator::operator++()
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator& ordered_set<Key, CmpFn, Alloc>::const_iterator::operator++()
 {
-    m_node = m_tree->successor(m_node);
+    m_node = cast(detail::rb_successor(m_node));
     return *this;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::const_iterator::operator++(int)
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::const_iterator::operator++(int)
 {
     const_iterator tmp{*this};
     operator++();
     return tmp;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator& ordered_set<Key, CmpFn>::const_iterator::operator--()
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator& ordered_set<Key, CmpFn, Alloc>::const_iterator::operator--()
 {
-    m_node = m_tree->predecessor(m_node);
+    if (m_node == nullptr)
+        m_node = cast(detail::rb_max(m_tree->m_root));
+    else
+        m_node = cast(detail::rb_predecessor(m_node));
     return *this;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::const_iterator::operator--(int)
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::const_iterator::operator--(int)
 {
     const_iterator tmp{*this};
     operator--();
     return tmp;
 }
 
-template<typename Key, typename CmpFn> inline
-bool ordered_set<Key, CmpFn>::const_iterator::operator==(const ordered_set::const_iterator& other) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::const_iterator::operator==(const ordered_set::const_iterator& other) const
 {
     return m_node == other.m_node;
 }
 
-template<typename Key, typename CmpFn> inline
-bool ordered_set<Key, CmpFn>::const_iterator::operator!=(const ordered_set::const_iterator& other) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::const_iterator::operator!=(const ordered_set::const_iterator& other) const
 {
     return m_node != other.m_node;
 }
 
-template<typename Key, typename CmpFn> inline
-const Key* ordered_set<Key, CmpFn>::const_iterator::operator->()
+template<typename Key, typename CmpFn, typename Alloc> inline
+const Key* ordered_set<Key, CmpFn, Alloc>::const_iterator::operator->()
 {
     return &(m_node->key);
 }
 
-template<typename Key, typename CmpFn> inline
-const Key& ordered_set<Key, CmpFn>::const_iterator::operator*()
+template<typename Key, typename CmpFn, typename Alloc> inline
+const Key& ordered_set<Key, CmpFn, Alloc>::const_iterator::operator*()
 {
     return m_node->key;
 }
 
-template<typename Key, typename CmpFn> inline
-ordered_set<Key, CmpFn>::ordered_set()
-    : m_nil(new node{Key{}, 0, nullptr, nullptr, nullptr, BLACK})
-    , m_root(m_nil)
-{
-    m_nil->left = m_nil;
-    m_nil->right = m_nil;
-    m_nil->parent = m_nil;
-}
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::ordered_set()
+    : m_alloc()
+    , m_root(nullptr)
+    , m_journal(nullptr)
+    , m_index(nullptr)
+    , m_filter(nullptr)
+{ }
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::ordered_set(const Alloc& alloc)
+    : m_alloc(alloc)
+    , m_root(nullptr)
+    , m_journal(nullptr)
+    , m_index(nullptr)
+    , m_filter(nullptr)
+{ }
 
-template<typename Key, typename CmpFn> inline
-ordered_set<Key, CmpFn>::ordered_set(const ordered_set& other)
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::ordered_set(const ordered_set& other)
     : ordered_set()
 {
+    m_alloc = node_traits::select_on_container_copy_construction(other.m_alloc);
+    if constexpr (HASHABLE)
+        if (other.has_hash_index())
+            enable_hash_index();
+    if constexpr (HASHABLE)
+        if (other.has_filter())
+            enable_filter(other.m_filter->fpr(), other.m_filter->max_bytes());
     deep_copy(other, *this);
 }
 
-template<typename Key, typename CmpFn>
-ordered_set<Key, CmpFn>::ordered_set(ordered_set&& other)
-    : m_nil{other.m_nil}
+template<typename Key, typename CmpFn, typename Alloc>
+ordered_set<Key, CmpFn, Alloc>::ordered_set(ordered_set&& other)
+    : m_alloc{std::move(other.m_alloc)}
     , m_root{other.m_root}
+    , m_index{std::move(other.m_index)}
+    , m_filter{std::move(other.m_filter)}
 {
-    other.m_nil = new node{Key{}, 0, nullptr, nullptr, nullptr, BLACK};
-    other.m_root = other.m_nil;
+    adopt_journal(other);
+    other.m_root = nullptr;
 }
 
-template<typename Key, typename CmpFn>
-ordered_set<Key, CmpFn> ordered_set<Key, CmpFn>::operator=(const ordered_set& other)
+template<typename Key, typename CmpFn, typename Alloc>
+ordered_set<Key, CmpFn, Alloc>& ordered_set<Key, CmpFn, Alloc>::operator=(const ordered_set& other)
 {
     if(&other == this)
         return *this;
+    clear();
+    if constexpr (HASHABLE) {
+        if (other.has_hash_index())
+            enable_hash_index();
+        else
+            disable_hash_index();
+    }
+    if constexpr (HASHABLE) {
+        if (other.has_filter())
+            enable_filter(other.m_filter->fpr(), other.m_filter->max_bytes());
+        else
+            disable_filter();
+    }
     deep_copy(other, *this);
     return *this;
 }
 
-template<typename Key, typename CmpFn>
-ordered_set<Key, CmpFn> ordered_set<Key, CmpFn>::operator=(ordered_set&& other)
+/**
+ * Takes over the content and the checkpoints of the other set, the checkpoints of this set are dropped.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+ordered_set<Key, CmpFn, Alloc>& ordered_set<Key, CmpFn, Alloc>::operator=(ordered_set&& other)
 {
     if(&other == this)
         return *this;
     delete_all_memory();
-    m_nil = other.m_nil;
+    static_assert(node_traits::propagate_on_container_move_assignment::value || node_traits::is_always_equal::value,
+                  "moving nodes between sets requires a propagating or always equal allocator");
+    if constexpr (node_traits::propagate_on_container_move_assignment::value)
+        m_alloc = std::move(other.m_alloc);
     m_root = other.m_root;
-    other.m_nil = new node{Key{}, 0, nullptr, nullptr, nullptr, BLACK};
-    other.m_root = other.m_nil;
+    adopt_journal(other);
+    m_index = std::move(other.m_index);
+    m_filter = std::move(other.m_filter);
+    other.m_root = nullptr;
     return *this;
 }
 
-template<typename Key, typename CmpFn> inline
-ordered_set<Key, CmpFn>::~ordered_set()
+template<typename Key, typename CmpFn, typename Alloc> inline
+ordered_set<Key, CmpFn, Alloc>::~ordered_set()
 {
     delete_all_memory();
 }
 
-template<typename Key, typename CmpFn>
-void ordered_set<Key, CmpFn>::delete_all_memory()
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::delete_all_memory()
 {
+    commit();
+    m_index.reset();
+    m_filter.reset();
     erase_tree(m_root);
-    delete m_nil;
-    m_nil = nullptr;
     m_root = nullptr;
 }
 
-template<typename Key, typename CmpFn>
-void ordered_set<Key, CmpFn>::deep_copy(const ordered_set& src, ordered_set& dst)
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::deep_copy(const ordered_set& src, ordered_set& dst)
 {
-    if (src.m_root == src.m_nil)
+    if (src.m_root == nullptr)
         return;
-    std::queue<node*> buffor{};
+    std::queue<detail::rb_node*> buffor{};
     buffor.push(src.m_root);
     while (!buffor.empty()) {
-        node* x = buffor.front();
+        detail::rb_node* x = buffor.front();
         buffor.pop();
-        dst.insert(x->key);
-        if (x->left != src.m_nil)
+        dst.insert(cast(x)->key);
+        if (x->left != nullptr)
             buffor.push(x->left);
-        if (x->right != src.m_nil)
+        if (x->right != nullptr)
             buffor.push(x->right);
     }
 }
 
-template<typename Key, typename CmpFn> inline
-std::pair<typename ordered_set<Key, CmpFn>::const_iterator, bool> ordered_set<Key, CmpFn>::insert(const Key& key)
+template<typename Key, typename CmpFn, typename Alloc> inline
+std::pair<typename ordered_set<Key, CmpFn, Alloc>::const_iterator, bool> ordered_set<Key, CmpFn, Alloc>::insert(const Key& key)
 {
-    node* x = m_root;
-    node* y = m_nil;
-    while (x != m_nil) {
+    detail::rb_node* x = m_root;
+    detail::rb_node* y = nullptr;
+    bool left = false;
+    while (x != nullptr) {
         y = x;
-        if (equal(key, x->key))
-            return std::make_pair(const_iterator{this, x}, false);
-        if (CMP(key, x->key))
-            x = x->left;
-        else
-            x = x->right;
+        const Key& x_key = cast(x)->key;
+        if (equal(key, x_key))
+            return std::make_pair(const_iterator{this, cast(x)}, false);
+        left = CMP(key, x_key);
+        x = left ? x->left : x->right;
     }
-    node* z = new node(key, 1, m_nil, m_nil, y, RED);
-    if (y == m_nil)
-        m_root = z;
-    else if (CMP(z->key, y->key))
-        y->left = z;
-    else
-        y->right = z;
-    updateSize(z->parent, m_nil, 1);
-    fixup_insert(z);
+    node* z = allocate(key);
+    detail::rb_insert(m_root, y, left, z, log());
+    if constexpr (HASHABLE)
+        if (m_filter && m_filter->count() > m_filter->capacity())
+            rebuild_filter();
     return std::make_pair(const_iterator{this, z}, true);
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::erase(const Key& key)
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::erase(const Key& key)
 {
     node* z = search(key);
-    if (z == m_nil)
-        return const_iterator{this, m_nil};
+    if (z == nullptr)
+        return end();
     return erase(z);
 }
 
-template<typename Key, typename CmpFn> inline
-size_t ordered_set<Key, CmpFn>::order_of_key(const Key& key) const {
-    size_t current = m_root->size;
-    node* x = m_root;
-    while (x != m_nil && not_equal(key, x->key)) {
-        if (CMP(key, x->key)) {
-            current--;
-            if (x->right != m_nil)
-                current -= x->right->size;
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::erase_by_order(size_t order)
+{
+    if (order >= size())
+        return false;
+    deallocate(detach_by_order(order));
+    return true;
+}
+
+/**
+ * Unlinks the key at the given order and returns it, throws std::out_of_range if there is no such key.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+Key ordered_set<Key, CmpFn, Alloc>::extract_by_order(size_t order)
+{
+    if (order >= size())
+        throw std::out_of_range("jp::ordered_set::extract_by_order");
+    node* z = detach_by_order(order);
+    untrack(z);
+    Key key = m_journal ? z->key : std::move(z->key);
+    release(z);
+    return key;
+}
+
+/**
+ * Erases all keys less than the given key with a single split, see erase_prefix.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+size_t ordered_set<Key, CmpFn, Alloc>::erase_less_than(const Key& key)
+{
+    return erase_prefix(order_of_key(key));
+}
+
+/**
+ * Erases the count smallest keys and returns the number of erased keys. The tree is split once along the path to the
+ * first kept key in O(log n), the detached subtrees are then freed in bulk without any rebalancing.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+size_t ordered_set<Key, CmpFn, Alloc>::erase_prefix(size_t count)
+{
+    count = std::min(count, size());
+    if (count == 0)
+        return 0;
+    size_t bh = 0;
+    detail::rb_node* root = drop_prefix(m_root, detail::rb_black_height(m_root), count, bh);
+    detail::rb_write(log(), m_root, root);
+    if (m_root != nullptr && m_root->color == RED)
+        detail::rb_write(log(), m_root->color, BLACK);
+    return count;
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+size_t ordered_set<Key, CmpFn, Alloc>::order_of_key(const Key& key) const {
+    if constexpr (HASHABLE) {
+        if (m_index) {
+            node* x = m_index->find(key);
+            if (x != nullptr)
+                return detail::rb_rank(x);
+        }
+    }
+    size_t current = detail::rb_size(m_root);
+    detail::rb_node* x = m_root;
+    while (x != nullptr && not_equal(key, cast(x)->key)) {
+        if (CMP(key, cast(x)->key)) {
+            current -= 1 + detail::rb_size(x->right);
             x = x->left;
         } else {
             x = x->right;
         }
     }
-    if (x->right != m_nil)
-        current -= x->right->size;
-    if (x != m_nil)
-        --current;
+    if (x != nullptr)
+        current -= 1 + detail::rb_size(x->right);
     return current;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::find(const Key& key) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::find(const Key& key) const
 {
     return const_iterator{this, search(key)};
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::contains(const Key& key) const
 {
-    size_t current = m_root->left->size;
-    node* x = m_root;
-    while (x != m_nil && current != order) {
-        if (current > order) {
-            current -= x->left->size;
-            x = x->left;
-            current += x->left->size;
-        } else {
-            x = x->right;
-            current += 1 + x->left->size;
-        }
+    return search(key) != nullptr;
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::find_by_order(size_t order) const
+{
+    return const_iterator{this, cast(detail::rb_select(m_root, order))};
+}
+
+/**
+ * Returns k - 1 iterators to the elements of ranks n / k, 2n / k, ..., (k - 1)n / k, i.e. the boundaries splitting
+ * the set into k parts of (almost) equal size. All ranks are resolved in a single traversal over subtree sizes.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::vector<typename ordered_set<Key, CmpFn, Alloc>::const_iterator> ordered_set<Key, CmpFn, Alloc>::partition_points(size_t k) const
+{
+    std::vector<const_iterator> points{};
+    if (k < 2)
+        return points;
+    const size_t n = size();
+    std::vector<size_t> ranks(k - 1);
+    for (size_t i = 1; i < k; i++)
+        ranks[i - 1] = i * n / k;
+    std::vector<node*> nodes(k - 1, nullptr);
+    collect_by_order(m_root, 0, ranks.data(), ranks.data() + ranks.size(), nodes.data());
+    points.reserve(k - 1);
+    for (node* x : nodes)
+        points.push_back(const_iterator{this, x});
+    return points;
+}
+
+/**
+ * Splits the set into k disjoint, consecutive [first, last) ranges of (almost) equal size, e.g. to hand them over
+ * to worker threads. Ranges are empty when k exceeds the size of the set.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::vector<std::pair<typename ordered_set<Key, CmpFn, Alloc>::const_iterator, typename ordered_set<Key, CmpFn, Alloc>::const_iterator>>
+ordered_set<Key, CmpFn, Alloc>::subranges(size_t k) const
+{
+    std::vector<std::pair<const_iterator, const_iterator>> ranges{};
+    if (k == 0)
+        return ranges;
+    std::vector<const_iterator> points = partition_points(k);
+    ranges.reserve(k);
+    const_iterator first = begin();
+    for (const const_iterator& point : points) {
+        ranges.emplace_back(first, point);
+        first = point;
     }
-    return const_iterator{this, x};
+    ranges.emplace_back(first, end());
+    return ranges;
 }
 
-template<typename Key, typename CmpFn> inline
-size_t ordered_set<Key, CmpFn>::size() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+size_t ordered_set<Key, CmpFn, Alloc>::size() const
 {
-    return m_root->size;
+    return detail::rb_size(m_root);
 }
 
-template<typename Key, typename CmpFn> inline
-bool ordered_set<Key, CmpFn>::empty() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::empty() const
 {
-    return m_root->size == 0;
+    return m_root == nullptr;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::min() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::min() const
 {
-    return const_iterator{this, min(m_root)};
+    return const_iterator{this, cast(detail::rb_min(m_root))};
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::max() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::max() const
 {
-    return const_iterator{this, max(m_root)};
+    return const_iterator{this, cast(detail::rb_max(m_root))};
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::begin() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::begin() const
 {
-    return find_by_order(0);
+    return min();
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::end() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::end() const
 {
-    return const_iterator{this, m_nil};
+    return const_iterator{this, nullptr};
 }
 
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::clear()
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::clear()
 {
+    // the side structures are emptied at once instead of node by node
+    auto index = std::move(m_index);
+    auto filter = std::move(m_filter);
     erase_tree(m_root);
-    m_root = m_nil;
+    detail::rb_write(log(), m_root, nullptr);
+    if (index)
+        index->clear();
+    if (filter)
+        filter->clear();
+    m_index = std::move(index);
+    m_filter = std::move(filter);
 }
 
-template<typename Key, typename CmpFn> inline
-bool ordered_set<Key, CmpFn>::equal(const Key& lhs, const Key& rhs) const
+/**
+ * Starts recording an undo log of all structural changes (links, colors and sizes) and returns a mark of the current
+ * state. Until commit, erased nodes are kept aside instead of being deallocated, so that rollback never allocates.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+typename ordered_set<Key, CmpFn, Alloc>::checkpoint_type ordered_set<Key, CmpFn, Alloc>::checkpoint()
+{
+    if (!m_journal)
+        m_journal = std::make_unique<journal>();
+    return checkpoint_type{m_journal->links.size(), m_journal->sizes.size(), m_journal->colors.size(),
+                           m_journal->allocated.size(), m_journal->retired.size()};
+}
+
+/**
+ * Restores the state marked by cp in time proportional to the number of changes made since. Checkpoints taken after
+ * cp become invalid, cp itself and the earlier ones stay valid.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::rollback(const checkpoint_type& cp)
+{
+    assert(m_journal);
+    journal& log = *m_journal;
+    assert(cp.links <= log.links.size() && cp.sizes <= log.sizes.size() && cp.colors <= log.colors.size());
+    assert(cp.allocated <= log.allocated.size() && cp.retired <= log.retired.size());
+    detail::rb_restore(log, cp.links, cp.sizes, cp.colors);
+    // nodes retired since cp are either linked back or allocated since cp
+    for (size_t i = cp.retired; i < log.retired.size(); i++)
+        track(log.retired[i]);
+    log.retired.resize(cp.retired);
+    for (size_t i = cp.allocated; i < log.allocated.size(); i++) {
+        untrack(log.allocated[i]);
+        destroy(log.allocated[i]);
+    }
+    log.allocated.resize(cp.allocated);
+}
+
+/**
+ * Drops all checkpoints, stops recording the undo log and deallocates the erased nodes.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::commit()
+{
+    if (!m_journal)
+        return;
+    for (node* x : m_journal->retired)
+        destroy(x);
+    m_journal.reset();
+}
+
+/**
+ * Maintains an open-addressing hash table from keys to nodes next to the tree, so that find, contains and erase
+ * locate present keys in O(1) and order_of_key of a present key climbs from its node instead of descending. Requires
+ * std::hash<Key> consistent with the equivalence defined by Cmp_Fn. Builds the table in O(n).
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::enable_hash_index()
+{
+    static_assert(HASHABLE, "the hash index requires std::hash<Key>");
+    if (m_index)
+        return;
+    m_index = std::make_unique<detail::hash_index<node, Key, CmpFn>>();
+    for (detail::rb_node* x = detail::rb_min(m_root); x != nullptr; x = detail::rb_successor(x))
+        m_index->insert(cast(x));
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::disable_hash_index()
+{
+    m_index.reset();
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::has_hash_index() const
+{
+    return m_index != nullptr;
+}
+
+/**
+ * Puts a counting Bloom filter in front of the lookups by key, so that most lookups of absent keys are answered
+ * without touching the tree. The filter is sized for twice the current number of keys at the given false positive
+ * rate, but takes at most max_bytes, and is rebuilt for twice the size whenever the set outgrows it. Requires
+ * std::hash<Key> consistent with the equivalence defined by Cmp_Fn.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::enable_filter(double fpr, size_t max_bytes)
+{
+    static_assert(HASHABLE, "the filter requires std::hash<Key>");
+    m_filter = std::make_unique<detail::counting_filter<Key>>(FILTER_MIN_CAPACITY, fpr, max_bytes);
+    rebuild_filter();
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::disable_filter()
+{
+    m_filter.reset();
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::has_filter() const
+{
+    return m_filter != nullptr;
+}
+
+/**
+ * Resizes the filter for twice the current number of keys and recounts them in O(n). Also clears the counters which
+ * got stuck at their maximum. The statistics are kept.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::rebuild_filter()
+{
+    assert(m_filter);
+    m_filter->reset(std::max(2 * size(), FILTER_MIN_CAPACITY));
+    for (detail::rb_node* x = detail::rb_min(m_root); x != nullptr; x = detail::rb_successor(x))
+        m_filter->insert(cast(x)->key);
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::filter_stats ordered_set<Key, CmpFn, Alloc>::filter_statistics() const
+{
+    assert(m_filter);
+    return m_filter->stats();
+}
+
+/**
+ * Returns a copy of the set with the same shape, the subtrees are copied in parallel.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::future<ordered_set<Key, CmpFn, Alloc>> ordered_set<Key, CmpFn, Alloc>::async_copy(thread_pool& pool) const
+{
+    return pool.submit([this, &pool] {
+        ordered_set copy;
+        copy.m_alloc = node_traits::select_on_container_copy_construction(m_alloc);
+        copy.m_root = copy_parallel(m_root, copy.m_alloc, pool);
+        if constexpr (HASHABLE)
+            if (has_hash_index())
+                copy.enable_hash_index();
+        if constexpr (HASHABLE)
+            if (has_filter())
+                copy.enable_filter(m_filter->fpr(), m_filter->max_bytes());
+        return copy;
+    });
+}
+
+/**
+ * Replaces the content with the keys of the range, which must be sorted and unique. The nodes are created in
+ * parallel and linked into a balanced tree bottom up. The future throws std::invalid_argument and the set is left
+ * unchanged if the keys are not sorted and unique. Throws std::logic_error if a checkpoint is open.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename RandomIt>
+std::future<void> ordered_set<Key, CmpFn, Alloc>::async_assign(RandomIt first, RandomIt last, thread_pool& pool)
+{
+    forbid_checkpoint("jp::ordered_set::async_assign");
+    return pool.submit([this, first, last, &pool] {
+        const size_t count = static_cast<size_t>(last - first);
+        for (size_t i = 1; i < count; i++)
+            if (!CMP(first[i - 1], first[i]))
+                throw std::invalid_argument("jp::ordered_set::async_assign: keys not sorted and unique");
+        std::vector<node*> nodes(count, nullptr);
+        try {
+            create_parallel(first, nodes.data(), count, pool);
+        } catch (...) {
+            for (node* x : nodes)
+                if (x != nullptr)
+                    destroy(x);
+            throw;
+        }
+        detail::rb_node* old = m_root;
+        replace_tree(nodes, pool);
+        free_parallel(old, m_alloc, pool);
+    });
+}
+
+/**
+ * Inserts all keys of the other set. The nodes of both sets are gathered in parallel, merged, and the result is
+ * relinked into a balanced tree in parallel, the nodes already in the set are reused. Throws std::logic_error if a
+ * checkpoint is open.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::future<void> ordered_set<Key, CmpFn, Alloc>::async_merge(const ordered_set& other, thread_pool& pool)
+{
+    forbid_checkpoint("jp::ordered_set::async_merge");
+    assert(&other != this);
+    return pool.submit([this, &other, &pool] {
+        std::vector<node*> mine(size());
+        std::vector<node*> theirs(other.size());
+        fork_join(pool, mine.size() + theirs.size() > PARALLEL_GRAIN,
+                  [&] { collect_parallel(m_root, mine.data(), pool); },
+                  [&] { collect_parallel(other.m_root, theirs.data(), pool); });
+        std::vector<node*> merged;
+        std::vector<node*> created;
+        merged.reserve(mine.size() + theirs.size());
+        created.reserve(theirs.size());
+        try {
+            size_t i = 0;
+            for (node* y : theirs) {
+                while (i < mine.size() && CMP(mine[i]->key, y->key))
+                    merged.push_back(mine[i++]);
+                if (i < mine.size() && !CMP(y->key, mine[i]->key))
+                    continue;
+                created.push_back(create(m_alloc, y->key));
+                merged.push_back(created.back());
+            }
+            merged.insert(merged.end(), mine.begin() + i, mine.end());
+        } catch (...) {
+            for (node* x : created)
+                destroy(x);
+            throw;
+        }
+        replace_tree(merged, pool);
+    });
+}
+
+/**
+ * Erases all keys satisfying the predicate and returns their number. The predicate is called in order from a single
+ * thread, the survivors are relinked into a balanced tree and the erased nodes freed in parallel. Nothing is changed
+ * if the predicate throws. Throws std::logic_error if a checkpoint is open.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename Pred>
+std::future<size_t> ordered_set<Key, CmpFn, Alloc>::async_erase_if(Pred pred, thread_pool& pool)
+{
+    forbid_checkpoint("jp::ordered_set::async_erase_if");
+    return pool.submit([this, pred = std::move(pred), &pool]() mutable {
+        std::vector<node*> nodes(size());
+        std::vector<node*> erased;
+        collect_parallel(m_root, nodes.data(), pool);
+        size_t kept = 0;
+        for (node* x : nodes) {
+            if (pred(static_cast<const Key&>(x->key)))
+                erased.push_back(x);
+            else
+                nodes[kept++] = x;
+        }
+        nodes.resize(kept);
+        replace_tree(nodes, pool);
+        // linking the erased nodes as well lets them be freed in parallel by subtrees
+        free_parallel(link_parallel(erased.data(), erased.size(), 0, 0, pool), m_alloc, pool);
+        return erased.size();
+    });
+}
+
+/**
+ * Empties the set at once and frees the nodes in the background, the set can be used right away. Throws
+ * std::logic_error if a checkpoint is open.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+std::future<void> ordered_set<Key, CmpFn, Alloc>::async_clear(thread_pool& pool)
+{
+    forbid_checkpoint("jp::ordered_set::async_clear");
+    detail::rb_node* root = m_root;
+    // the task owns a copy of the allocator, the set may be destroyed before it finishes
+    std::future<void> done = pool.submit([root, alloc = m_alloc, &pool]() mutable {
+        free_parallel(root, alloc, pool);
+    });
+    m_root = nullptr;
+    if (m_index)
+        m_index->clear();
+    if (m_filter)
+        m_filter->clear();
+    return done;
+}
+
+/**
+ * Replaces the content with the keys of the source, either a std::istream read by operator>> until its end or a
+ * callable returning std::optional<Key> and std::nullopt at the end. The keys must come in ascending order, repeated
+ * keys are skipped. They are consumed one at a time, so the memory used is the tree and O(log n) more, and the set is
+ * cleared first, so the old and the new tree are never held together. Keys out of order or input which cannot be
+ * read as a key throw std::invalid_argument, the set is left empty if anything throws. Throws std::logic_error if a
+ * checkpoint is open, as the tree is built without recording the changes.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename Source>
+void ordered_set<Key, CmpFn, Alloc>::build_from_stream(Source&& source)
+{
+    if constexpr (std::is_base_of<std::istream, std::remove_reference_t<Source>>::value) {
+        std::istream& in = source;
+        auto next = [&in]() -> std::optional<Key> {
+            Key key{};
+            if (in >> key)
+                return key;
+            if (!in.eof())
+                throw std::invalid_argument("jp::ordered_set::build_from_stream: malformed input");
+            return std::nullopt;
+        };
+        build_from_keys(next);
+    } else {
+        build_from_keys(source);
+    }
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::node* ordered_set<Key, CmpFn, Alloc>::cast(detail::rb_node* x)
+{
+    return static_cast<node*>(x);
+}
+
+/**
+ * Returns the journal the structural changes are recorded in, nullptr when there is no checkpoint.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+detail::rb_journal* ordered_set<Key, CmpFn, Alloc>::log() const
+{
+    return m_journal.get();
+}
+
+/**
+ * Takes over the journal of the other set. The entries recorded for the root pointer of the other set are redirected
+ * to the root pointer of this set, the other entries refer to fields of nodes, which move along with the tree.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::adopt_journal(ordered_set& other)
+{
+    m_journal = std::move(other.m_journal);
+    if (!m_journal)
+        return;
+    for (auto& link : m_journal->links)
+        if (link.first == &other.m_root)
+            link.first = &m_root;
+}
+
+/**
+ * Throws std::logic_error when a checkpoint is open. The bulk operations relink the tree without recording the changes,
+ * so a later rollback would restore fields of nodes they have freed.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::forbid_checkpoint(const char* function) const
+{
+    if (m_journal)
+        throw std::logic_error(std::string(function) + ": not allowed with an open checkpoint");
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::node* ordered_set<Key, CmpFn, Alloc>::allocate(const Key& key)
+{
+    node* x = create(m_alloc, key);
+    if (m_journal)
+        m_journal->allocated.push_back(x);
+    track(x);
+    return x;
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::deallocate(node* x)
+{
+    untrack(x);
+    release(x);
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::release(node* x)
+{
+    if (m_journal)
+        m_journal->retired.push_back(x);
+    else
+        destroy(x);
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::destroy(node* x)
+{
+    node_traits::destroy(m_alloc, x);
+    node_traits::deallocate(m_alloc, x, 1);
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::track(node* x)
+{
+    if constexpr (HASHABLE) {
+        if (m_index)
+            m_index->insert(x);
+        if (m_filter)
+            m_filter->insert(x->key);
+    }
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::untrack(node* x)
+{
+    if constexpr (HASHABLE) {
+        if (m_index)
+            m_index->erase(x);
+        if (m_filter)
+            m_filter->erase(x->key);
+    }
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::equal(const Key& lhs, const Key& rhs) const
 {
     return (!CMP(lhs, rhs)) & (!CMP(rhs, lhs));
 }
 
-template<typename Key, typename CmpFn> inline
-bool ordered_set<Key, CmpFn>::not_equal(const Key& lhs, const Key& rhs) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+bool ordered_set<Key, CmpFn, Alloc>::not_equal(const Key& lhs, const Key& rhs) const
 {
     return CMP(lhs, rhs) | CMP(rhs, lhs);
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::node* ordered_set<Key, CmpFn>::successor(node* x) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::node* ordered_set<Key, CmpFn, Alloc>::search(const Key& key) const
 {
-    if (x->right != m_nil)
-        return min(x->right);
-    while (x != m_nil) {
-        if (x == x->parent->left)
-            return x->parent;
-        x = x->parent;
+    if constexpr (HASHABLE) {
+        if (m_filter && !m_filter->may_contain(key))
+            return nullptr;
+    }
+    node* x = nullptr;
+    if constexpr (HASHABLE) {
+        if (m_index)
+            x = m_index->find(key);
     }
-    return m_nil;
+    if (!m_index) {
+        x = cast(m_root);
+        while (x != nullptr && not_equal(key, x->key)) {
+            if (CMP(key, x->key))
+                x = cast(x->left);
+            else
+                x = cast(x->right);
+        }
+    }
+    if (m_filter && x == nullptr)
+        m_filter->record_false_positive();
+    return x;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::node* ordered_set<Key, CmpFn>::predecessor(node* x) const
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::collect_by_order(detail::rb_node* x, size_t offset, const size_t* first,
+                                               const size_t* last, node** out) const
 {
-    if (x->left != m_nil)
-        return max(x->left);
-    while (x != m_nil) {
-        if (x == x->parent->right)
-            return x->parent;
-        x = x->parent;
+    while (x != nullptr && first != last) {
+        size_t order = offset + detail::rb_size(x->left);
+        const size_t* lower = std::lower_bound(first, last, order);
+        const size_t* upper = std::upper_bound(lower, last, order);
+        collect_by_order(x->left, offset, first, lower, out);
+        std::fill(out + (lower - first), out + (upper - first), cast(x));
+        out += upper - first;
+        first = upper;
+        offset = order + 1;
+        x = x->right;
     }
-    return m_nil;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::node* ordered_set<Key, CmpFn>::min(node* x) const
+/**
+ * Frees the subtree in post-order without any auxiliary memory, unlinking every freed node from its parent.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::erase_tree(detail::rb_node* root)
 {
-    if (x != m_nil)
-        while (x->left != m_nil)
+    detail::rb_node* x = root;
+    while (x != nullptr) {
+        if (x->left != nullptr) {
             x = x->left;
+        } else if (x->right != nullptr) {
+            x = x->right;
+        } else {
+            detail::rb_node* parent = x != root ? x->parent : nullptr;
+            if (parent != nullptr)
+                detail::rb_write(log(), x == parent->left ? parent->left : parent->right, nullptr);
+            deallocate(cast(x));
+            x = parent;
+        }
+    }
+}
+
+/**
+ * Allocates and constructs a node without tracking it, may be called by several threads for a thread-safe allocator.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::node* ordered_set<Key, CmpFn, Alloc>::create(node_allocator& alloc,
+                                                                                     const Key& key)
+{
+    node* x = node_traits::allocate(alloc, 1);
+    try {
+        node_traits::construct(alloc, x, key);
+    } catch (...) {
+        node_traits::deallocate(alloc, x, 1);
+        throw;
+    }
     return x;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::node* ordered_set<Key, CmpFn>::max(node* x) const
+/**
+ * Runs both functions, the right one as a task of the pool if parallel. Waits for both even if one throws and then
+ * rethrows, the right one is run inline if the task cannot be submitted.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename Left, typename Right>
+void ordered_set<Key, CmpFn, Alloc>::fork_join(thread_pool& pool, bool parallel, Left&& left, Right&& right)
 {
-    if (x != m_nil)
-        while (x->right != m_nil)
-            x = x->right;
+    std::future<void> task;
+    if (parallel) {
+        try {
+            task = pool.submit([&right] { right(); });
+        } catch (...) {
+        }
+    }
+    if (!task.valid()) {
+        left();
+        right();
+        return;
+    }
+    try {
+        left();
+    } catch (...) {
+        try {
+            pool.wait(task);
+        } catch (...) {
+        }
+        throw;
+    }
+    pool.wait(task);
+}
+
+/**
+ * Creates the nodes of count keys into out, on failure the nodes created so far are left in out for the caller.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename RandomIt>
+void ordered_set<Key, CmpFn, Alloc>::create_parallel(RandomIt first, node** out, size_t count, thread_pool& pool)
+{
+    if (count <= PARALLEL_GRAIN) {
+        for (size_t i = 0; i < count; i++)
+            out[i] = create(m_alloc, first[i]);
+        return;
+    }
+    const size_t half = count / 2;
+    fork_join(pool, true,
+              [&] { create_parallel(first, out, half, pool); },
+              [&] { create_parallel(first + half, out + half, count - half, pool); });
+}
+
+/**
+ * Stores the nodes of the subtree in order into out, the subtrees larger than the grain are walked in parallel.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::collect_parallel(detail::rb_node* x, node** out, thread_pool& pool)
+{
+    if (x == nullptr)
+        return;
+    const size_t left_size = detail::rb_size(x->left);
+    out[left_size] = cast(x);
+    fork_join(pool, x->size > PARALLEL_GRAIN,
+              [&] { collect_parallel(x->left, out, pool); },
+              [&] { collect_parallel(x->right, out + left_size + 1, pool); });
+}
+
+/**
+ * Links the sorted nodes into a perfectly balanced subtree and returns its root. The levels below red_depth exist
+ * only partially and are colored red, so that all paths have the same number of black nodes. Does not throw.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+detail::rb_node* ordered_set<Key, CmpFn, Alloc>::link_parallel(node** nodes, size_t count, size_t depth,
+                                                               size_t red_depth, thread_pool& pool)
+{
+    if (count == 0)
+        return nullptr;
+    const size_t left_count = (count - 1) / 2;
+    detail::rb_node* x = nodes[left_count];
+    detail::rb_node* left = nullptr;
+    detail::rb_node* right = nullptr;
+    fork_join(pool, count > PARALLEL_GRAIN,
+              [&] { left = link_parallel(nodes, left_count, depth + 1, red_depth, pool); },
+              [&] { right = link_parallel(nodes + left_count + 1, count - left_count - 1, depth + 1, red_depth,
+                                          pool); });
+    x->size = count;
+    x->left = left;
+    x->right = right;
+    x->parent = nullptr;
+    x->color = depth == red_depth ? RED : BLACK;
+    if (left != nullptr)
+        left->parent = x;
+    if (right != nullptr)
+        right->parent = x;
     return x;
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::node* ordered_set<Key, CmpFn>::search(const Key& key) const
+/**
+ * Returns a copy of the subtree with the same shape and colors, frees the partial copy if an allocation throws.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+detail::rb_node* ordered_set<Key, CmpFn, Alloc>::copy_parallel(const detail::rb_node* x, node_allocator& alloc,
+                                                               thread_pool& pool)
+{
+    if (x == nullptr)
+        return nullptr;
+    node* y = create(alloc, static_cast<const node*>(x)->key);
+    detail::rb_node* left = nullptr;
+    detail::rb_node* right = nullptr;
+    try {
+        fork_join(pool, x->size > PARALLEL_GRAIN,
+                  [&] { left = copy_parallel(x->left, alloc, pool); },
+                  [&] { right = copy_parallel(x->right, alloc, pool); });
+    } catch (...) {
+        free_parallel(left, alloc, pool);
+        free_parallel(right, alloc, pool);
+        node_traits::destroy(alloc, y);
+        node_traits::deallocate(alloc, y, 1);
+        throw;
+    }
+    y->size = x->size;
+    y->color = x->color;
+    y->left = left;
+    y->right = right;
+    if (left != nullptr)
+        left->parent = y;
+    if (right != nullptr)
+        right->parent = y;
+    return y;
+}
+
+/**
+ * Frees the nodes of a detached subtree, the subtrees larger than the grain in parallel. Does not untrack the nodes.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::free_parallel(detail::rb_node* root, node_allocator& alloc, thread_pool& pool)
 {
-    node* x = m_root;
-    while (x != m_nil && not_equal(key, x->key)) {
-        if (CMP(key, x->key))
+    if (root == nullptr)
+        return;
+    if (root->size > PARALLEL_GRAIN) {
+        fork_join(pool, true,
+                  [&] { free_parallel(root->left, alloc, pool); },
+                  [&] { free_parallel(root->right, alloc, pool); });
+        node_traits::destroy(alloc, cast(root));
+        node_traits::deallocate(alloc, cast(root), 1);
+        return;
+    }
+    detail::rb_node* x = root;
+    while (x != nullptr) {
+        if (x->left != nullptr) {
             x = x->left;
-        else
+        } else if (x->right != nullptr) {
             x = x->right;
+        } else {
+            detail::rb_node* parent = x != root ? x->parent : nullptr;
+            if (parent != nullptr)
+                (x == parent->left ? parent->left : parent->right) = nullptr;
+            node_traits::destroy(alloc, cast(x));
+            node_traits::deallocate(alloc, cast(x), 1);
+            x = parent;
+        }
     }
-    return x;
 }
 
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::erase_tree(node* root)
+/**
+ * Makes the sorted nodes the content of the set, the previous tree is not freed. Rebuilds the index and the filter.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+void ordered_set<Key, CmpFn, Alloc>::replace_tree(std::vector<node*>& nodes, thread_pool& pool)
 {
-    if (root == m_nil)
-        return;
-    std::queue<node*> buffor;
-    buffor.push(root);
-    while (!buffor.empty()) {
-        node* x = buffor.front();
-        buffor.pop();
-        if (x->left != m_nil)
-            buffor.push(x->left);
-        if (x->right != m_nil)
-            buffor.push(x->right);
-        delete x;
+    size_t red_depth = 0;
+    while ((size_t{2} << red_depth) <= nodes.size())
+        red_depth++;
+    m_root = link_parallel(nodes.data(), nodes.size(), 0, red_depth, pool);
+    if (m_root != nullptr)
+        m_root->color = BLACK;
+    if constexpr (HASHABLE) {
+        if (m_index) {
+            m_index->clear();
+            for (node* x : nodes)
+                m_index->insert(x);
+        }
+        if (m_filter)
+            rebuild_filter();
     }
 }
 
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::rotate_left(node* x)
+/**
+ * Builds the tree from the sorted keys returned by next. The tree grows like a binary counter: the right spine holds
+ * perfect all-black subtrees of distinct heights, each with the node following it, and a new node merges the
+ * subtrees of equal height on its way in, in amortized O(1). At the end the spine is folded with rb_join, in O(log n)
+ * as the heights decrease.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+template<typename Next>
+void ordered_set<Key, CmpFn, Alloc>::build_from_keys(Next& next)
 {
-    node* y = x->right;
-    x->right = y->left;
-    if (y->left != m_nil)
-        y->left->parent = x;
-    y->parent = x->parent;
-    if (x->parent == m_nil)
-        m_root = y;
-    else if (x == x->parent->left)
-        x->parent->left = y;
-    else
-        x->parent->right = y;
-    y->left = x;
-    x->parent = y;
-    if(x->left != m_nil)
-        y->size += x->left->size;
-    y->size++;
-    if (y->right != m_nil)
-        x->size -= y->right->size;
-    x->size--;
-}
-
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::rotate_right(node* x)
-{
-    node* y = x->left;
-    x->left = y->right;
-    if (y->right != m_nil)
-        y->right->parent = x;
-    y->parent = x->parent;
-    if (x->parent == m_nil)
-        m_root = y;
-    else if (x == x->parent->left)
-        x->parent->left = y;
-    else
-        x->parent->right = y;
-    y->right = x;
-    x->parent = y;
-    if(x->right != m_nil)
-        y->size += x->right->size;
-    y->size++;
-    if (y->left!= m_nil)
-        x->size -= y->left->size;
-    x->size--;
-}
-
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::transplant(node* u, node* v)
-{
-    if (u->parent == m_nil)
-        m_root = v;
-    else if (u == u->parent->left)
-        u->parent->left = v;
-    else
-        u->parent->right = v;
-    v->parent = u->parent;
-}
-
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::updateSize(node* start, node* end, size_t value)
-{
-    while (start != end) {
-        start->size += value;
-        start = start->parent;
-    }
-}
-
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::fixup_insert(node* z)
-{
-    while (z->parent->color == RED) {
-        if (z->parent == z->parent->parent->left) {
-            node* y = z->parent->parent->right;
-            if (y->color == RED) {
-                z->parent->color = BLACK;
-                y->color = BLACK;
-                z->parent->parent->color = RED;
-                z = z->parent->parent;
-            } else {
-                if (z == z->parent->right) {
-                    z = z->parent;
-                    rotate_left(z);
-                }
-                z->parent->color = BLACK;
-                z->parent->parent->color = RED;
-                rotate_right(z->parent->parent);
+    forbid_checkpoint("jp::ordered_set::build_from_stream");
+    clear();
+    // the heights on the spine are distinct, so it never reallocates and the pushes cannot throw
+    std::vector<spine_entry> spine;
+    spine.reserve(MAX_SPINE);
+    detail::rb_node* open = nullptr;
+    size_t open_bh = 0;
+    node* last = nullptr;
+    try {
+        for (std::optional<Key> key = next(); key; key = next()) {
+            if (last != nullptr && !CMP(last->key, *key)) {
+                if (CMP(*key, last->key))
+                    throw std::invalid_argument("jp::ordered_set::build_from_stream: keys not sorted");
+                continue;
             }
-        } else {
-            node* y = z->parent->parent->left;
-            if (y->color == RED) {
-                z->parent->color = BLACK;
-                y->color = BLACK;
-                z->parent->parent->color = RED;
-                z = z->parent->parent;
-            } else {
-                if (z == z->parent->left) {
-                    z = z->parent;
-                    rotate_right(z);
-                }
-                z->parent->color = BLACK;
-                z->parent->parent->color = RED;
-                rotate_left(z->parent->parent);
+            node* x = allocate(*key);
+            x->color = BLACK;
+            last = x;
+            if (open != nullptr) {
+                spine.push_back(spine_entry{open, open_bh, x});
+                open = nullptr;
+                open_bh = 0;
+                continue;
             }
+            detail::rb_node* tree = x;
+            size_t bh = 1;
+            for (; !spine.empty() && spine.back().bh == bh; bh++) {
+                detail::rb_node* m = spine.back().next;
+                m->left = spine.back().tree;
+                m->right = tree;
+                m->left->parent = m;
+                m->right->parent = m;
+                m->size = m->left->size + m->right->size + 1;
+                tree = m;
+                spine.pop_back();
+            }
+            open = tree;
+            open_bh = bh;
+        }
+    } catch (...) {
+        for (const spine_entry& e : spine) {
+            erase_tree(e.tree);
+            deallocate(e.next);
         }
+        erase_tree(open);
+        throw;
     }
-    m_root->color = BLACK;
+    detail::rb_node* root = open;
+    size_t bh = open_bh;
+    for (; !spine.empty(); spine.pop_back()) {
+        detail::rb_node* joined = nullptr;
+        size_t joined_bh = 0;
+        detail::rb_join(joined, spine.back().tree, spine.back().bh, spine.back().next, root, bh, joined_bh);
+        root = joined;
+        bh = joined_bh;
+    }
+    m_root = root;
+    // the filter was sized for the empty set while the keys were counted in
+    if constexpr (HASHABLE)
+        if (m_filter)
+            rebuild_filter();
 }
 
-template<typename Key, typename CmpFn> inline
-typename ordered_set<Key, CmpFn>::const_iterator ordered_set<Key, CmpFn>::erase(node* z)
+/**
+ * Detaches x from its parent, frees its count smallest keys and returns the root of the rest. Only the subtrees on
+ * the right of the path are joined back, everything on the left is freed without rebalancing. The joins use m_root
+ * as the root of the tree being rebalanced, so that the journal never refers to a local variable.
+ */
+template<typename Key, typename CmpFn, typename Alloc>
+detail::rb_node* ordered_set<Key, CmpFn, Alloc>::drop_prefix(detail::rb_node* x, size_t bh, size_t count, size_t& rest_bh)
 {
-    updateSize(z->parent, m_nil, -1);
-    auto it = const_iterator{this, successor(z)};
-    node* y = z;
-    node* x = nullptr;
-    bool y_original_color = y->color;
-    if (z->left == m_nil) {
-        x = z->right;
-        transplant(z, z->right);
-    } else if (z->right == m_nil) {
-        x = z->left;
-        transplant(z, z->left);
-    } else {
-        y = min(z->right);
-        y_original_color = y->color;
-        x = y->right;
-        if (y->parent == z) {
-            x->parent = y;
-        } else {
-            updateSize(y->parent, z, -1);
-            y->size -= y->right->size;
-            transplant(y, y->right);
-            y->right = z->right;
-            y->right->parent = y;
-            y->size += y->right->size;
-        }
-        transplant(z, y);
-        y->left = z->left;
-        y->left->parent = y;
-        y->color = z->color;
-        y->size += y->left->size;
-    }
-    if (y_original_color == BLACK)
-        fixup_erase(x);
-    m_nil->parent = m_nil;
-    assert(m_nil->color == BLACK);
-    delete z;
+    if (count == 0) {
+        if (x != nullptr)
+            detail::rb_write(log(), x->parent, nullptr);
+        rest_bh = bh;
+        return x;
+    }
+    if (count == x->size) {
+        erase_tree(x);
+        rest_bh = 0;
+        return nullptr;
+    }
+    size_t child_bh = bh - (x->color == BLACK);
+    detail::rb_node* left = x->left;
+    detail::rb_node* right = x->right;
+    if (count <= detail::rb_size(left)) {
+        size_t left_bh = 0;
+        detail::rb_node* rest = drop_prefix(left, child_bh, count, left_bh);
+        if (right != nullptr)
+            detail::rb_write(log(), right->parent, nullptr);
+        detail::rb_join(m_root, rest, left_bh, x, right, child_bh, rest_bh, log());
+        return m_root;
+    }
+    count -= detail::rb_size(left) + 1;
+    erase_tree(left);
+    deallocate(cast(x));
+    return drop_prefix(right, child_bh, count, rest_bh);
+}
+
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::const_iterator ordered_set<Key, CmpFn, Alloc>::erase(node* z)
+{
+    auto it = const_iterator{this, cast(detail::rb_successor(z))};
+    detail::rb_erase(m_root, z, log());
+    deallocate(z);
     return it;
 }
 
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::fixup_erase(node* x)
+/**
+ * Finds the node of the given order and unlinks it in a single descent. The sizes on the path are decremented on
+ * the way down, as the node is known to exist.
+ */
+template<typename Key, typename CmpFn, typename Alloc> inline
+typename ordered_set<Key, CmpFn, Alloc>::node* ordered_set<Key, CmpFn, Alloc>::detach_by_order(size_t order)
 {
-    while (x != m_root && x->color == BLACK) {
-        if (x == x->parent->left) {
-            node* w = x->parent->right;
-            if (w->color == RED) {
-                w->color = BLACK;
-                x->parent->color = RED;
-                rotate_left(x->parent);
-                w = x->parent->right;
-            }
-            if (w->left->color == BLACK && w->right->color == BLACK) {
-                w->color = RED;
-                x = x->parent;
-            } else {
-                if (w->right->color == BLACK) {
-                    w->left->color = BLACK;
-                    w->color = RED;
-                    rotate_right(w);
-                    w = x->parent->right;
-                }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
-                w->right->color = BLACK;
-                rotate_left(x->parent);
-                x = m_root;
-            }
+    detail::rb_node* x = m_root;
+    size_t current = detail::rb_size(x->left);
+    while (current != order) {
+        detail::rb_write(log(), x->size, x->size - 1);
+        if (current > order) {
+            x = x->left;
+            current -= 1 + detail::rb_size(x->right);
         } else {
-            node* w = x->parent->left;
-            if (w->color == RED) {
-                w->color = BLACK;
-                x->parent->color = RED;
-                rotate_right(x->parent);
-                w = x->parent->left;
-            }
-            if (w->right->color == BLACK && w->left->color == BLACK) {
-                w->color = RED;
-                x = x->parent;
-            } else {
-                if (w->left->color == BLACK) {
-                    w->right->color = BLACK;
-                    w->color = RED;
-                    rotate_left(w);
-                    w = x->parent->left;
-                }
-                w->color = x->parent->color;
-                x->parent->color = BLACK;
-                w->left->color = BLACK;
-                rotate_right(x->parent);
-                x = m_root;
-            }
+            x = x->right;
+            current += 1 + detail::rb_size(x->left);
         }
     }
-    x->color = BLACK;
+    detail::rb_unlink(m_root, x, log());
+    return cast(x);
 }
 
-template<typename Key, typename CmpFn> inline
-std::ostream& operator<<(std::ostream& out, const ordered_set<Key, CmpFn>& tree)
+template<typename Key, typename CmpFn, typename Alloc> inline
+std::ostream& operator<<(std::ostream& out, const ordered_set<Key, CmpFn, Alloc>& tree)
 {
-    if (tree.m_root == tree.m_nil) {
+    if (tree.m_root == nullptr) {
         out << "(empty_tree)";
         return out;
     }
@@ -737,30 +1487,31 @@ std::ostream& operator<<(std::ostream& out, const ordered_set<Key, CmpFn>& tree)
     return out;
 }
 
-template<typename Key, typename CmpFn> inline
-void ordered_set<Key, CmpFn>::print(std::ostream& out, node* x, std::string& prefix) const
+template<typename Key, typename CmpFn, typename Alloc> inline
+void ordered_set<Key, CmpFn, Alloc>::print(std::ostream& out, detail::rb_node* x, std::string& prefix) const
 {
     auto prefixEnd = prefix.back();
     auto prefixSize = prefix.size();
-    std::string str = x->str();
+    std::string str = cast(x)->str();
+    bool is_right = x->parent != nullptr && x->parent->right == x;
 
-    prefix[prefixSize - 1] = (x->parent->right == x) ? ' ' : prefixEnd;
+    prefix[prefixSize - 1] = is_right ? ' ' : prefixEnd;
     prefix.resize(prefix.size() + str.size() - 1, ' ');
     prefix.back() = '|';
-    if (x->right != m_nil)
+    if (x->right != nullptr)
         print(out, x->right, prefix);
 
     std::string_view prefixView = prefix;
     out << prefixView.substr(0, prefix.size() - str.size()) << str << '\n';
 
-    prefix[prefixSize - 1] = (x->parent->right == x) ? prefixEnd : ' ';
-    if (x->left != m_nil)
+    prefix[prefixSize - 1] = is_right ? prefixEnd : ' ';
+    if (x->left != nullptr)
         print(out, x->left, prefix);
     prefix.resize(prefix.size() - str.size() + 1);
 }
 
-template<typename Key, typename CmpFn> inline
-std::string ordered_set<Key, CmpFn>::node::str() const
+template<typename Key, typename CmpFn, typename Alloc> inline
+std::string ordered_set<Key, CmpFn, Alloc>::node::str() const
 {
     std::stringstream ss{};
     ss << '(' << key << ',' << size << ',' << (color ? 'b' : 'r') << ')';
@@ -0,0 +1,417 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A partially persistent ordered set. Every call to insert or erase creates a new version, version 0 being the empty
+ * set, and all versions can be queried with order_of_key, find_by_order and find in O(log n).
+ *
+ * Nodes are immutable and every update copies only the path to the modified key (path copying), all other nodes are
+ * shared between versions. Since the subtree sizes on the whole search path change with every update anyway, this
+ * costs O(log n) nodes per update, same as the size updates of ordered_set. Subtree sizes also drive the balancing:
+ * the tree is weight-balanced as described in 'Balancing weight-balanced trees' by Y. Hirai and K. Yamamoto, which
+ * needs no color and no parent pointers, so nodes can be shared.
+ *
+ * Nodes live in a single array and are linked by 32-bit indices, so at most 2^32 - 2 nodes can be created. An update
+ * which would create more throws std::length_error and leaves the set unchanged.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class persistent_ordered_set
+{
+    using index = std::uint32_t;
+
+    struct node
+    {
+        Key key;
+        index size;
+        index left;
+        index right;
+    };
+
+public:
+    persistent_ordered_set();
+    bool insert(const Key& key);
+    bool erase(const Key& key);
+    size_t version() const;
+    size_t order_of_key(const Key& key) const;
+    size_t order_of_key(const Key& key, size_t version) const;
+    const Key* find(const Key& key) const;
+    const Key* find(const Key& key, size_t version) const;
+    const Key* find_by_order(size_t order) const;
+    const Key* find_by_order(size_t order, size_t version) const;
+    size_t size() const;
+    size_t size(size_t version) const;
+    bool empty() const;
+    size_t node_count() const;
+    void clear();
+
+private:
+    index root(size_t version) const;
+    index make(const Key& key, index left, index right);
+    index balance(const Key& key, index left, index right);
+    index rotate_left(const Key& key, index left, index right);
+    index rotate_right(const Key& key, index left, index right);
+    bool is_balanced(index a, index b) const;
+    bool is_single(index a, index b) const;
+    index insert(index x, const Key& key, bool& inserted);
+    index erase(index x, const Key& key, bool& erased);
+    index erase_min(index x, index& min);
+    index erase_max(index x, index& max);
+    index glue(index left, index right);
+    template<typename Update>
+    bool update(Update&& update);
+
+    static constexpr index NIL = 0;
+    static constexpr index DELTA = 3;
+    static constexpr index GAMMA = 2;
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    std::vector<node> m_nodes;
+    std::vector<index> m_versions;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+persistent_ordered_set<Key, CmpFn>::persistent_ordered_set()
+    : m_nodes{node{Key{}, 0, NIL, NIL}}
+    , m_versions{NIL}
+{ }
+
+template<typename Key, typename CmpFn>
+bool persistent_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    return update([this, &key](bool& inserted) { return insert(m_versions.back(), key, inserted); });
+}
+
+template<typename Key, typename CmpFn>
+bool persistent_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    return update([this, &key](bool& erased) { return erase(m_versions.back(), key, erased); });
+}
+
+template<typename Key, typename CmpFn> inline
+size_t persistent_ordered_set<Key, CmpFn>::version() const
+{
+    return m_versions.size() - 1;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t persistent_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    return order_of_key(key, version());
+}
+
+template<typename Key, typename CmpFn> inline
+size_t persistent_ordered_set<Key, CmpFn>::order_of_key(const Key& key, size_t version) const
+{
+    size_t order = 0;
+    index x = root(version);
+    while (x != NIL) {
+        const node& nd = m_nodes[x];
+        if (CMP(nd.key, key)) {
+            order += m_nodes[nd.left].size + 1;
+            x = nd.right;
+        } else {
+            x = nd.left;
+        }
+    }
+    return order;
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* persistent_ordered_set<Key, CmpFn>::find(const Key& key) const
+{
+    return find(key, version());
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* persistent_ordered_set<Key, CmpFn>::find(const Key& key, size_t version) const
+{
+    index x = root(version);
+    while (x != NIL) {
+        const node& nd = m_nodes[x];
+        if (CMP(key, nd.key))
+            x = nd.left;
+        else if (CMP(nd.key, key))
+            x = nd.right;
+        else
+            return &nd.key;
+    }
+    return nullptr;
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* persistent_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    return find_by_order(order, version());
+}
+
+template<typename Key, typename CmpFn> inline
+const Key* persistent_ordered_set<Key, CmpFn>::find_by_order(size_t order, size_t version) const
+{
+    index x = root(version);
+    if (order >= m_nodes[x].size)
+        return nullptr;
+    while (true) {
+        const node& nd = m_nodes[x];
+        size_t current = m_nodes[nd.left].size;
+        if (order == current)
+            return &nd.key;
+        if (order < current) {
+            x = nd.left;
+        } else {
+            order -= current + 1;
+            x = nd.right;
+        }
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+size_t persistent_ordered_set<Key, CmpFn>::size() const
+{
+    return size(version());
+}
+
+template<typename Key, typename CmpFn> inline
+size_t persistent_ordered_set<Key, CmpFn>::size(size_t version) const
+{
+    return m_nodes[root(version)].size;
+}
+
+template<typename Key, typename CmpFn> inline
+bool persistent_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t persistent_ordered_set<Key, CmpFn>::node_count() const
+{
+    return m_nodes.size() - 1;
+}
+
+/**
+ * Drops the whole history, the set goes back to version 0.
+ */
+template<typename Key, typename CmpFn> inline
+void persistent_ordered_set<Key, CmpFn>::clear()
+{
+    m_nodes.resize(1);
+    m_versions.assign(1, NIL);
+}
+
+template<typename Key, typename CmpFn> inline
+typename persistent_ordered_set<Key, CmpFn>::index persistent_ordered_set<Key, CmpFn>::root(size_t version) const
+{
+    assert(version < m_versions.size());
+    return m_versions[version];
+}
+
+/**
+ * Runs an update of the latest version and records the root it returns as a new version. If anything throws, the
+ * nodes already created are dropped, so the set is left unchanged.
+ */
+template<typename Key, typename CmpFn>
+template<typename Update>
+bool persistent_ordered_set<Key, CmpFn>::update(Update&& update)
+{
+    const size_t nodes = m_nodes.size();
+    bool changed = false;
+    try {
+        index x = update(changed);
+        m_versions.push_back(x);
+    } catch (...) {
+        m_nodes.erase(m_nodes.begin() + static_cast<std::ptrdiff_t>(nodes), m_nodes.end());
+        throw;
+    }
+    return changed;
+}
+
+/**
+ * Throws std::length_error once every index but the largest one is taken.
+ */
+template<typename Key, typename CmpFn> inline
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::make(const Key& key, index left, index right)
+{
+    if (m_nodes.size() >= static_cast<size_t>(index(-1)))
+        throw std::length_error("jp::persistent_ordered_set: too many nodes for 32-bit indices");
+    index size = m_nodes[left].size + m_nodes[right].size + 1;
+    m_nodes.push_back(node{key, size, left, right});
+    return static_cast<index>(m_nodes.size() - 1);
+}
+
+template<typename Key, typename CmpFn> inline
+bool persistent_ordered_set<Key, CmpFn>::is_balanced(index a, index b) const
+{
+    return DELTA * (size_t{m_nodes[a].size} + 1) >= size_t{m_nodes[b].size} + 1;
+}
+
+template<typename Key, typename CmpFn> inline
+bool persistent_ordered_set<Key, CmpFn>::is_single(index a, index b) const
+{
+    return size_t{m_nodes[a].size} + 1 < GAMMA * (size_t{m_nodes[b].size} + 1);
+}
+
+/**
+ * Creates a node of the given key and subtrees, which were balanced before a single insertion or erasure.
+ */
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::balance(const Key& key, index left, index right)
+{
+    if (m_nodes[left].size + m_nodes[right].size <= 1)
+        return make(key, left, right);
+    if (!is_balanced(left, right))
+        return rotate_left(key, left, right);
+    if (!is_balanced(right, left))
+        return rotate_right(key, left, right);
+    return make(key, left, right);
+}
+
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::rotate_left(const Key& key, index left, index right)
+{
+    const node r = m_nodes[right];
+    if (is_single(r.left, r.right))
+        return make(r.key, make(key, left, r.left), r.right);
+    const node rl = m_nodes[r.left];
+    return make(rl.key, make(key, left, rl.left), make(r.key, rl.right, r.right));
+}
+
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::rotate_right(const Key& key, index left, index right)
+{
+    const node l = m_nodes[left];
+    if (is_single(l.right, l.left))
+        return make(l.key, l.left, make(key, l.right, right));
+    const node lr = m_nodes[l.right];
+    return make(lr.key, make(l.key, l.left, lr.left), make(key, lr.right, right));
+}
+
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::insert(index x, const Key& key, bool& inserted)
+{
+    if (x == NIL) {
+        inserted = true;
+        return make(key, NIL, NIL);
+    }
+    const node nd = m_nodes[x];
+    if (CMP(key, nd.key)) {
+        index left = insert(nd.left, key, inserted);
+        return inserted ? balance(nd.key, left, nd.right) : x;
+    }
+    if (CMP(nd.key, key)) {
+        index right = insert(nd.right, key, inserted);
+        return inserted ? balance(nd.key, nd.left, right) : x;
+    }
+    return x;
+}
+
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::erase(index x, const Key& key, bool& erased)
+{
+    if (x == NIL)
+        return NIL;
+    const node nd = m_nodes[x];
+    if (CMP(key, nd.key)) {
+        index left = erase(nd.left, key, erased);
+        return erased ? balance(nd.key, left, nd.right) : x;
+    }
+    if (CMP(nd.key, key)) {
+        index right = erase(nd.right, key, erased);
+        return erased ? balance(nd.key, nd.left, right) : x;
+    }
+    erased = true;
+    return glue(nd.left, nd.right);
+}
+
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::erase_min(index x, index& min)
+{
+    const node nd = m_nodes[x];
+    if (nd.left == NIL) {
+        min = x;
+        return nd.right;
+    }
+    index left = erase_min(nd.left, min);
+    return balance(nd.key, left, nd.right);
+}
+
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::erase_max(index x, index& max)
+{
+    const node nd = m_nodes[x];
+    if (nd.right == NIL) {
+        max = x;
+        return nd.left;
+    }
+    index right = erase_max(nd.right, max);
+    return balance(nd.key, nd.left, right);
+}
+
+/**
+ * Joins the subtrees of an erased node, replacing it with the extreme key of the bigger subtree.
+ */
+template<typename Key, typename CmpFn>
+typename persistent_ordered_set<Key, CmpFn>::index
+persistent_ordered_set<Key, CmpFn>::glue(index left, index right)
+{
+    if (left == NIL)
+        return right;
+    if (right == NIL)
+        return left;
+    index extreme = NIL;
+    if (m_nodes[left].size > m_nodes[right].size) {
+        left = erase_max(left, extreme);
+    } else {
+        right = erase_min(right, extreme);
+    }
+    const Key key = m_nodes[extreme].key;
+    return balance(key, left, right);
+}
+
+} //!jp
@@ -0,0 +1,303 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#include "ordered_set.hpp"
+#include "frozen_ordered_set.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An ordered set for one writer and readers which can live with a slightly stale view. The writer updates a private
+ * ordered_set and publishes frozen_ordered_set copies of it, built in linear time from its in-order traversal, by an
+ * atomic store of a raw pointer.
+ *
+ * Readers go through a reader, which claims one of the set's reader slots for its lifetime. reader::pin announces
+ * the reader in its slot, loads the published pointer and stores it in the slot as a hazard pointer, a fixed number of
+ * steps, so pinning and the queries on the pinned snapshot are wait-free. As there is only one writer, the pointer
+ * does not have to be validated: the writer scans the slots only after it unpublished a snapshot, and a reader which
+ * announces itself after that scan loads a newer one. A snapshot stays pinned until the reader pins again, unpins or
+ * is destroyed.
+ *
+ * Replaced snapshots are kept by the writer, which rebuilds one no slot pins for the next publication instead of
+ * allocating a new one and frees the others. Readers holding pins on old snapshots only keep those alive, the writer
+ * never waits for them.
+ *
+ * Given a maximal staleness, every update publishes if the published snapshot is older than that and out of date.
+ * A writer which may go idle should call publish_if_stale periodically, so the last updates are published too.
+ * All functions of the set must be called by the writer, readers must be destroyed before the set.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class published_ordered_set
+{
+public:
+    using snapshot_type = frozen_ordered_set<Key, Cmp_Fn>;
+    using clock = std::chrono::steady_clock;
+
+private:
+    static constexpr size_t MIN_SLOTS = 64;
+    static constexpr std::uintptr_t PINNING = 1;
+
+    struct alignas(64) reader_slot
+    {
+        std::atomic<bool> claimed{false};
+        std::atomic<std::uintptr_t> pinned{0};
+    };
+
+public:
+    class reader
+    {
+    public:
+        explicit reader(const published_ordered_set& set);
+        reader(const reader&) = delete;
+        reader& operator=(const reader&) = delete;
+        ~reader();
+        const snapshot_type& pin();
+        void unpin();
+    private:
+        const published_ordered_set& m_set;
+        reader_slot& m_slot;
+    };
+
+    explicit published_ordered_set(clock::duration max_staleness = clock::duration::zero(), size_t reader_slots = 0);
+    published_ordered_set(const published_ordered_set&) = delete;
+    published_ordered_set& operator=(const published_ordered_set&) = delete;
+    ~published_ordered_set();
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    void clear();
+    void publish();
+    bool publish_if_stale();
+    const ordered_set<Key, Cmp_Fn>& latest() const;
+
+private:
+    reader_slot& claim() const;
+    std::unique_ptr<snapshot_type> unpinned();
+    void updated();
+
+    ordered_set<Key, Cmp_Fn> m_set;
+    const size_t m_slot_count;
+    const std::unique_ptr<reader_slot[]> m_slots;
+    std::atomic<snapshot_type*> m_published;
+    std::vector<std::unique_ptr<snapshot_type>> m_replaced;
+    clock::duration m_max_staleness;
+    clock::time_point m_published_at;
+    bool m_dirty;
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+/**
+ * Claims a free reader slot, throws std::length_error if all are claimed. Only claiming is not wait-free, so a reader
+ * is meant to live as long as its thread reads.
+ */
+template<typename Key, typename CmpFn> inline
+published_ordered_set<Key, CmpFn>::reader::reader(const published_ordered_set& set)
+    : m_set{set}
+    , m_slot{set.claim()}
+{ }
+
+template<typename Key, typename CmpFn> inline
+published_ordered_set<Key, CmpFn>::reader::~reader()
+{
+    unpin();
+    m_slot.claimed.store(false, std::memory_order_release);
+}
+
+/**
+ * Pins the published snapshot and returns it, releasing the previous pin of this reader. The snapshot stays valid
+ * until the next pin, unpin or the destruction of the reader.
+ */
+template<typename Key, typename CmpFn> inline
+const typename published_ordered_set<Key, CmpFn>::snapshot_type& published_ordered_set<Key, CmpFn>::reader::pin()
+{
+    m_slot.pinned.store(PINNING);
+    const snapshot_type* x = m_set.m_published.load();
+    m_slot.pinned.store(reinterpret_cast<std::uintptr_t>(x));
+    return *x;
+}
+
+template<typename Key, typename CmpFn> inline
+void published_ordered_set<Key, CmpFn>::reader::unpin()
+{
+    m_slot.pinned.store(0, std::memory_order_release);
+}
+
+/**
+ * Starts with an empty snapshot published. A zero staleness leaves publishing to the writer. By default there are
+ * twice as many reader slots as hardware threads but at least MIN_SLOTS.
+ */
+template<typename Key, typename CmpFn> inline
+published_ordered_set<Key, CmpFn>::published_ordered_set(clock::duration max_staleness, size_t reader_slots)
+    : m_set{}
+    , m_slot_count{reader_slots != 0 ? reader_slots : std::max<size_t>(MIN_SLOTS, 2 * std::thread::hardware_concurrency())}
+    , m_slots{new reader_slot[m_slot_count]}
+    , m_published{new snapshot_type{}}
+    , m_replaced{}
+    , m_max_staleness{max_staleness}
+    , m_published_at{clock::now()}
+    , m_dirty{false}
+{ }
+
+/**
+ * No reader may be left.
+ */
+template<typename Key, typename CmpFn> inline
+published_ordered_set<Key, CmpFn>::~published_ordered_set()
+{
+    delete m_published.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename CmpFn> inline
+bool published_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    bool inserted = m_set.insert(key).second;
+    if (inserted)
+        updated();
+    return inserted;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t published_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    size_t before = m_set.size();
+    m_set.erase(key);
+    size_t erased = before - m_set.size();
+    if (erased != 0)
+        updated();
+    return erased;
+}
+
+template<typename Key, typename CmpFn> inline
+void published_ordered_set<Key, CmpFn>::clear()
+{
+    if (m_set.empty())
+        return;
+    m_set.clear();
+    updated();
+}
+
+/**
+ * Builds a snapshot of the current content and makes it the one readers pin. The replaced snapshot is kept, as readers
+ * may still pin it.
+ */
+template<typename Key, typename CmpFn>
+void published_ordered_set<Key, CmpFn>::publish()
+{
+    std::unique_ptr<snapshot_type> next = unpinned();
+    next->assign(m_set.begin(), m_set.end());
+    m_replaced.reserve(m_replaced.size() + 1);
+    m_replaced.emplace_back(m_published.exchange(next.release()));
+    m_published_at = clock::now();
+    m_dirty = false;
+}
+
+/**
+ * Publishes if there are unpublished updates and the published snapshot is older than the maximal staleness.
+ */
+template<typename Key, typename CmpFn> inline
+bool published_ordered_set<Key, CmpFn>::publish_if_stale()
+{
+    if (!m_dirty || clock::now() - m_published_at < m_max_staleness)
+        return false;
+    publish();
+    return true;
+}
+
+/**
+ * Returns the up to date content, for the writer.
+ */
+template<typename Key, typename CmpFn> inline
+const ordered_set<Key, CmpFn>& published_ordered_set<Key, CmpFn>::latest() const
+{
+    return m_set;
+}
+
+template<typename Key, typename CmpFn>
+typename published_ordered_set<Key, CmpFn>::reader_slot& published_ordered_set<Key, CmpFn>::claim() const
+{
+    for (size_t i = 0; i < m_slot_count; i++) {
+        bool expected = false;
+        if (!m_slots[i].claimed.load(std::memory_order_relaxed)
+                && m_slots[i].claimed.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return m_slots[i];
+    }
+    throw std::length_error("jp::published_ordered_set::reader: all reader slots are claimed");
+}
+
+/**
+ * Takes a replaced snapshot which no reader pins and frees the other ones, or allocates a new snapshot. Every replaced
+ * snapshot was unpublished before the scan, so a reader which is not seen pinning it can no longer get it. A reader
+ * seen in the middle of pinning might get any of them, then all are kept until a later publication.
+ */
+template<typename Key, typename CmpFn>
+std::unique_ptr<typename published_ordered_set<Key, CmpFn>::snapshot_type> published_ordered_set<Key, CmpFn>::unpinned()
+{
+    std::vector<std::uintptr_t> pinned;
+    for (size_t i = 0; i < m_slot_count; i++) {
+        std::uintptr_t x = m_slots[i].pinned.load();
+        if (x == PINNING)
+            return std::make_unique<snapshot_type>();
+        if (x != 0)
+            pinned.push_back(x);
+    }
+    std::unique_ptr<snapshot_type> spare;
+    for (auto& x : m_replaced) {
+        if (std::find(pinned.begin(), pinned.end(), reinterpret_cast<std::uintptr_t>(x.get())) != pinned.end())
+            continue;
+        if (spare == nullptr)
+            spare = std::move(x);
+        else
+            x.reset();
+    }
+    m_replaced.erase(std::remove(m_replaced.begin(), m_replaced.end(), nullptr), m_replaced.end());
+    return spare != nullptr ? std::move(spare) : std::make_unique<snapshot_type>();
+}
+
+template<typename Key, typename CmpFn> inline
+void published_ordered_set<Key, CmpFn>::updated()
+{
+    m_dirty = true;
+    if (m_max_staleness != clock::duration::zero())
+        publish_if_stale();
+}
+
+} //!jp
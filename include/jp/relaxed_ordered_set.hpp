@@ -0,0 +1,743 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <tuple>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <algorithm>
+#include <functional>
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * A thread-safe ordered set in a relaxed-balance tree: updates only change the tree locally and leave the balance to
+ * be restored later, so writers lock nothing but the nodes right above their leaf.
+ *
+ * The tree is leaf-oriented, keys are stored in the leaves and inner nodes only route (keys less than the key of an
+ * inner node are on its left), as in the chromatic trees of O. Nurmi and E. Soisalon-Soininen. An insert replaces a
+ * leaf by a new inner node with two leaves and an erase replaces the parent of a leaf by its sibling, under the locks
+ * of the one or two nodes whose links change. Readers lock nothing.
+ *
+ * Instead of the colors of a chromatic tree, the balance is kept by the subtree counts which rank queries need
+ * anyway: a node is out of balance if one of its children holds more than 2/3 of its keys, and rebalancing rebuilds
+ * the topmost such node on a path into a perfectly balanced subtree (partial rebuilding, as in scapegoat trees). An
+ * insert which ends too deep, or an erase which halves the set, helps by rebalancing if no other thread does,
+ * otherwise the work is left to the next helper or to an explicit rebalance().
+ *
+ * Counts are incremented along the path after the local change, so order_of_key and find_by_order are exact when no
+ * update is in flight and may miss the updates in flight otherwise. Only the nodes at least COUNTED_DEPTH deep keep
+ * their counts up to date: the counts above would be modified by every update and make all writers contend on the
+ * same few cache lines. A count above that depth is summed from the nodes at that depth instead, at most
+ * 2^COUNTED_DEPTH loads of nodes which only change when the tree is rebuilt. Nodes never get deeper, an erase moves
+ * the subtree of the sibling up and a rebuild replaces the inner nodes, so a node deep enough now has been counted by
+ * every update that passed it. Unlinked nodes are reclaimed by epochs, as in seqlock_ordered_set.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class relaxed_ordered_set
+{
+    struct node_base
+    {
+        explicit node_base(bool leaf, size_t count);
+        void lock();
+        void unlock();
+
+        const bool leaf;
+        std::atomic<bool> locked;
+        std::atomic<bool> removed;
+        std::atomic<node_base*> left;
+        std::atomic<node_base*> right;
+        std::atomic<size_t> count;
+    };
+
+    struct node : node_base
+    {
+        node(const Key& key, bool leaf, size_t count);
+
+        const Key key;
+    };
+
+    struct retired_node
+    {
+        node* x;
+        std::uint64_t epoch;
+    };
+
+    struct alignas(64) thread_slot
+    {
+        std::atomic<std::uint64_t> epoch{0};
+        std::mutex mutex;
+        std::vector<retired_node> retired;
+    };
+
+    class guard
+    {
+    public:
+        explicit guard(const relaxed_ordered_set& set);
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+        ~guard();
+        thread_slot& slot() const;
+    private:
+        const relaxed_ordered_set& m_set;
+        size_t m_slot;
+    };
+
+public:
+    explicit relaxed_ordered_set(size_t thread_slots = 0);
+    relaxed_ordered_set(const relaxed_ordered_set&) = delete;
+    relaxed_ordered_set& operator=(const relaxed_ordered_set&) = delete;
+    ~relaxed_ordered_set();
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    bool contains(const Key& key) const;
+    size_t order_of_key(const Key& key) const;
+    std::optional<Key> find_by_order(size_t order) const;
+    size_t size() const;
+    bool empty() const;
+    void rebalance();
+    size_t height() const;
+
+private:
+    static node* cast(node_base* x);
+    node_base* child(const node_base* x, const Key& key) const;
+    std::atomic<node_base*>& link(node_base* parent, const node_base* x);
+    static size_t count(const node_base* x, size_t depth);
+    static bool unbalanced(const node_base* x, size_t depth);
+    static size_t height_bound(size_t size);
+    size_t enter() const;
+    void leave(size_t slot) const;
+    void retire(thread_slot& slot, node* x) const;
+    void help(const Key* key);
+    bool rebuild(node_base* parent, node_base* x);
+    node_base* build(std::vector<node*>& leaves, size_t begin, size_t end);
+    static void delete_inner(node_base* x);
+    void reclaim();
+    static size_t height(const node_base* x);
+    static void delete_tree(node_base* x);
+
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    static constexpr size_t MIN_SLOTS = 64;
+    static constexpr size_t RECLAIM_THRESHOLD = 256;
+    static constexpr size_t COUNTED_DEPTH = 5;
+    mutable node_base m_head;
+    const size_t m_slot_count;
+    const std::unique_ptr<thread_slot[]> m_slots;
+    mutable std::atomic<std::uint64_t> m_epoch;
+    std::mutex m_helper;
+    // the largest size seen by a helper since the whole tree was rebuilt
+    std::atomic<size_t> m_rebuilt_size;
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+relaxed_ordered_set<Key, CmpFn>::node_base::node_base(bool leaf, size_t count)
+    : leaf{leaf}
+    , locked{false}
+    , removed{false}
+    , left{nullptr}
+    , right{nullptr}
+    , count{count}
+{ }
+
+template<typename Key, typename CmpFn> inline
+void relaxed_ordered_set<Key, CmpFn>::node_base::lock()
+{
+    for (unsigned spins = 1; locked.exchange(true, std::memory_order_acquire); spins++)
+        if (spins % 64 == 0)
+            std::this_thread::yield();
+}
+
+template<typename Key, typename CmpFn> inline
+void relaxed_ordered_set<Key, CmpFn>::node_base::unlock()
+{
+    locked.store(false, std::memory_order_release);
+}
+
+template<typename Key, typename CmpFn> inline
+relaxed_ordered_set<Key, CmpFn>::node::node(const Key& key, bool leaf, size_t count)
+    : node_base{leaf, count}
+    , key(key)
+{ }
+
+template<typename Key, typename CmpFn> inline
+relaxed_ordered_set<Key, CmpFn>::guard::guard(const relaxed_ordered_set& set)
+    : m_set{set}
+    , m_slot{set.enter()}
+{ }
+
+template<typename Key, typename CmpFn> inline
+relaxed_ordered_set<Key, CmpFn>::guard::~guard()
+{
+    m_set.leave(m_slot);
+}
+
+template<typename Key, typename CmpFn> inline
+typename relaxed_ordered_set<Key, CmpFn>::thread_slot& relaxed_ordered_set<Key, CmpFn>::guard::slot() const
+{
+    return m_set.m_slots[m_slot];
+}
+
+/**
+ * Creates the given number of slots for threads inside an operation, by default twice the number of hardware threads
+ * but at least MIN_SLOTS. Further threads spin until a slot frees up.
+ */
+template<typename Key, typename CmpFn> inline
+relaxed_ordered_set<Key, CmpFn>::relaxed_ordered_set(size_t thread_slots)
+    : m_head{false, 0}
+    , m_slot_count{thread_slots != 0 ? thread_slots : std::max<size_t>(MIN_SLOTS, 2 * std::thread::hardware_concurrency())}
+    , m_slots{new thread_slot[m_slot_count]}
+    , m_epoch{1}
+    , m_helper{}
+    , m_rebuilt_size{0}
+{ }
+
+/**
+ * No operation may be in progress.
+ */
+template<typename Key, typename CmpFn>
+relaxed_ordered_set<Key, CmpFn>::~relaxed_ordered_set()
+{
+    delete_tree(m_head.left.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < m_slot_count; i++)
+        for (const retired_node& r : m_slots[i].retired)
+            delete r.x;
+}
+
+/**
+ * Replaces the leaf where the key belongs by an inner node over the old and the new leaf, then counts the key on the
+ * path, which it may no longer be part of the tree by then, and helps rebalancing if the leaf ended too deep.
+ */
+template<typename Key, typename CmpFn>
+bool relaxed_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    static thread_local std::vector<node_base*> path;
+    guard g{*this};
+    for (;;) {
+        path.clear();
+        node_base* parent = &m_head;
+        node_base* x = m_head.left.load(std::memory_order_acquire);
+        while (x != nullptr && !x->leaf) {
+            path.push_back(x);
+            parent = x;
+            x = child(x, key);
+        }
+        if (x != nullptr && !CMP(key, cast(x)->key) && !CMP(cast(x)->key, key))
+            return false;
+
+        node* leaf = new node(key, true, 1);
+        node_base* replacement = leaf;
+        if (x != nullptr) {
+            const bool smaller = CMP(key, cast(x)->key);
+            node* inner = new node(smaller ? cast(x)->key : key, false, 2);
+            inner->left.store(smaller ? leaf : x, std::memory_order_relaxed);
+            inner->right.store(smaller ? x : leaf, std::memory_order_relaxed);
+            replacement = inner;
+        }
+        parent->lock();
+        std::atomic<node_base*>& to_x = link(parent, x);
+        if (parent->removed.load(std::memory_order_relaxed) || to_x.load(std::memory_order_relaxed) != x) {
+            parent->unlock();
+            if (replacement != leaf)
+                delete cast(replacement);
+            delete leaf;
+            continue;
+        }
+        to_x.store(replacement, std::memory_order_release);
+        parent->unlock();
+
+        for (size_t depth = COUNTED_DEPTH; depth < path.size(); depth++)
+            path[depth]->count.fetch_add(1, std::memory_order_relaxed);
+        if (path.size() > height_bound(count(m_head.left.load(std::memory_order_acquire), 0)))
+            help(&key);
+        return true;
+    }
+}
+
+/**
+ * Replaces the parent of the leaf by the sibling of the leaf, under the locks of the grandparent and the parent.
+ */
+template<typename Key, typename CmpFn>
+size_t relaxed_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    static thread_local std::vector<node_base*> path;
+    guard g{*this};
+    for (;;) {
+        path.clear();
+        path.push_back(&m_head);
+        node_base* x = m_head.left.load(std::memory_order_acquire);
+        while (x != nullptr && !x->leaf) {
+            path.push_back(x);
+            x = child(x, key);
+        }
+        if (x == nullptr || CMP(key, cast(x)->key) || CMP(cast(x)->key, key))
+            return 0;
+
+        node_base* parent = path.back();
+        node_base* grandparent = path.size() > 1 ? path[path.size() - 2] : nullptr;
+        if (grandparent != nullptr)
+            grandparent->lock();
+        parent->lock();
+        bool valid = !parent->removed.load(std::memory_order_relaxed)
+                && link(parent, x).load(std::memory_order_relaxed) == x
+                && (grandparent == nullptr || (!grandparent->removed.load(std::memory_order_relaxed)
+                                               && link(grandparent, parent).load(std::memory_order_relaxed) == parent));
+        if (valid) {
+            if (grandparent == nullptr) {
+                parent->left.store(nullptr, std::memory_order_release);
+            } else {
+                node_base* sibling = (parent->left.load(std::memory_order_relaxed) == x ? parent->right : parent->left)
+                        .load(std::memory_order_relaxed);
+                link(grandparent, parent).store(sibling, std::memory_order_release);
+                parent->removed.store(true, std::memory_order_relaxed);
+            }
+        }
+        parent->unlock();
+        if (grandparent != nullptr)
+            grandparent->unlock();
+        if (!valid)
+            continue;
+
+        if (grandparent != nullptr) {
+            path.pop_back();
+            retire(g.slot(), cast(parent));
+        }
+        retire(g.slot(), cast(x));
+        // the path starts with the head, the node at depth d follows at d + 1
+        for (size_t depth = COUNTED_DEPTH; depth + 1 < path.size(); depth++)
+            path[depth + 1]->count.fetch_sub(1, std::memory_order_relaxed);
+        if (2 * count(m_head.left.load(std::memory_order_acquire), 0) < m_rebuilt_size.load(std::memory_order_relaxed))
+            help(nullptr);
+        return 1;
+    }
+}
+
+template<typename Key, typename CmpFn>
+bool relaxed_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    guard g{*this};
+    node_base* x = m_head.left.load(std::memory_order_acquire);
+    while (x != nullptr && !x->leaf)
+        x = child(x, key);
+    return x != nullptr && !CMP(key, cast(x)->key) && !CMP(cast(x)->key, key);
+}
+
+template<typename Key, typename CmpFn>
+size_t relaxed_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    guard g{*this};
+    size_t order = 0;
+    node_base* x = m_head.left.load(std::memory_order_acquire);
+    for (size_t depth = 1; x != nullptr && !x->leaf; depth++) {
+        node_base* left = x->left.load(std::memory_order_acquire);
+        if (CMP(key, cast(x)->key)) {
+            x = left;
+        } else {
+            order += count(left, depth);
+            x = x->right.load(std::memory_order_acquire);
+        }
+    }
+    if (x != nullptr && CMP(cast(x)->key, key))
+        order++;
+    return order;
+}
+
+/**
+ * Returns a copy of the key of the given order, or nothing if the set has at most order keys.
+ */
+template<typename Key, typename CmpFn>
+std::optional<Key> relaxed_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    guard g{*this};
+    node_base* x = m_head.left.load(std::memory_order_acquire);
+    if (x == nullptr || order >= count(x, 0))
+        return std::nullopt;
+    for (size_t depth = 1; !x->leaf; depth++) {
+        node_base* left = x->left.load(std::memory_order_acquire);
+        size_t left_count = count(left, depth);
+        if (order < left_count) {
+            x = left;
+        } else {
+            order -= left_count;
+            x = x->right.load(std::memory_order_acquire);
+        }
+    }
+    return cast(x)->key;
+}
+
+template<typename Key, typename CmpFn> inline
+size_t relaxed_ordered_set<Key, CmpFn>::size() const
+{
+    guard g{*this};
+    return count(m_head.left.load(std::memory_order_acquire), 0);
+}
+
+template<typename Key, typename CmpFn> inline
+bool relaxed_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+ * Rebuilds every maximal unbalanced subtree and frees the unlinked nodes no thread can reach anymore. May run
+ * concurrently with updates, which then wait for the locks of the subtree being rebuilt.
+ */
+template<typename Key, typename CmpFn>
+void relaxed_ordered_set<Key, CmpFn>::rebalance()
+{
+    std::lock_guard<std::mutex> lock{m_helper};
+    {
+        guard g{*this};
+        // parent, node and depth of the node
+        std::vector<std::tuple<node_base*, node_base*, size_t>> stack;
+        stack.emplace_back(&m_head, m_head.left.load(std::memory_order_acquire), 0);
+        while (!stack.empty()) {
+            auto [parent, x, depth] = stack.back();
+            stack.pop_back();
+            if (x == nullptr || x->leaf)
+                continue;
+            if (unbalanced(x, depth) && rebuild(parent, x))
+                continue;
+            stack.emplace_back(x, x->left.load(std::memory_order_acquire), depth + 1);
+            stack.emplace_back(x, x->right.load(std::memory_order_acquire), depth + 1);
+        }
+    }
+    reclaim();
+}
+
+/**
+ * Returns the height of the tree, for diagnostics, no update may be in progress.
+ */
+template<typename Key, typename CmpFn> inline
+size_t relaxed_ordered_set<Key, CmpFn>::height() const
+{
+    return height(m_head.left.load(std::memory_order_acquire));
+}
+
+template<typename Key, typename CmpFn> inline
+typename relaxed_ordered_set<Key, CmpFn>::node* relaxed_ordered_set<Key, CmpFn>::cast(node_base* x)
+{
+    return static_cast<node*>(x);
+}
+
+template<typename Key, typename CmpFn> inline
+typename relaxed_ordered_set<Key, CmpFn>::node_base*
+relaxed_ordered_set<Key, CmpFn>::child(const node_base* x, const Key& key) const
+{
+    const std::atomic<node_base*>& next = CMP(key, static_cast<const node*>(x)->key) ? x->left : x->right;
+    return next.load(std::memory_order_acquire);
+}
+
+/**
+ * Returns the link of parent which may point to x, the left one of the head or the one on the side of the key of x.
+ */
+template<typename Key, typename CmpFn> inline
+std::atomic<typename relaxed_ordered_set<Key, CmpFn>::node_base*>&
+relaxed_ordered_set<Key, CmpFn>::link(node_base* parent, const node_base* x)
+{
+    if (parent == &m_head || parent->left.load(std::memory_order_relaxed) == x)
+        return parent->left;
+    if (parent->right.load(std::memory_order_relaxed) == x || x == nullptr)
+        return parent->right;
+    // x is not a child anymore, return the link the validation will fail on
+    return parent->left;
+}
+
+/**
+ * Returns the number of keys below x at the given depth, the root being at depth 0. Above COUNTED_DEPTH the count is
+ * summed from the nodes at that depth.
+ */
+template<typename Key, typename CmpFn>
+size_t relaxed_ordered_set<Key, CmpFn>::count(const node_base* x, size_t depth)
+{
+    if (x == nullptr)
+        return 0;
+    if (x->leaf || depth >= COUNTED_DEPTH)
+        return x->count.load(std::memory_order_relaxed);
+    return count(x->left.load(std::memory_order_acquire), depth + 1)
+            + count(x->right.load(std::memory_order_acquire), depth + 1);
+}
+
+/**
+ * A node is unbalanced if one of its children holds more than 2/3 of its keys, the slack of 2 keeps tiny subtrees
+ * from being rebuilt over and over.
+ */
+template<typename Key, typename CmpFn> inline
+bool relaxed_ordered_set<Key, CmpFn>::unbalanced(const node_base* x, size_t depth)
+{
+    size_t left = count(x->left.load(std::memory_order_acquire), depth + 1);
+    size_t right = count(x->right.load(std::memory_order_acquire), depth + 1);
+    return 3 * std::max(left, right) > 2 * (left + right) + 2 * 3;
+}
+
+/**
+ * The height of a tree without unbalanced nodes is at most log_{3/2} of the size, below twice its bit width.
+ */
+template<typename Key, typename CmpFn> inline
+size_t relaxed_ordered_set<Key, CmpFn>::height_bound(size_t size)
+{
+    size_t bits = 0;
+    while (size >> bits)
+        bits++;
+    return 2 * bits + 4;
+}
+
+/**
+ * Claims a free slot and announces the current epoch in it, see seqlock_ordered_set.
+ */
+template<typename Key, typename CmpFn>
+size_t relaxed_ordered_set<Key, CmpFn>::enter() const
+{
+    static thread_local size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (size_t n = 1, i = hint % m_slot_count;; n++, i = (i + 1) % m_slot_count) {
+        std::uint64_t epoch = m_epoch.load();
+        std::uint64_t expected = 0;
+        if (m_slots[i].epoch.load(std::memory_order_relaxed) == 0 && m_slots[i].epoch.compare_exchange_strong(expected, epoch)) {
+            for (std::uint64_t current; (current = m_epoch.load()) != epoch; epoch = current)
+                m_slots[i].epoch.store(current);
+            hint = i;
+            return i;
+        }
+        if (n % m_slot_count == 0)
+            std::this_thread::yield();
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+void relaxed_ordered_set<Key, CmpFn>::leave(size_t slot) const
+{
+    m_slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+template<typename Key, typename CmpFn> inline
+void relaxed_ordered_set<Key, CmpFn>::retire(thread_slot& slot, node* x) const
+{
+    std::lock_guard<std::mutex> lock{slot.mutex};
+    slot.retired.push_back(retired_node{x, m_epoch.load(std::memory_order_relaxed)});
+}
+
+/**
+ * Rebalances unless another thread is already doing so: along the path to the key if given, otherwise the whole
+ * tree. Rebalancing only restores the bounds of the query times, so if it throws, e.g. on a failed allocation, the
+ * work is left to the next helper instead of failing the update which has already been made.
+ */
+template<typename Key, typename CmpFn>
+void relaxed_ordered_set<Key, CmpFn>::help(const Key* key)
+{
+    std::unique_lock<std::mutex> lock{m_helper, std::try_to_lock};
+    if (!lock.owns_lock())
+        return;
+    try {
+        if (key == nullptr) {
+            rebuild(&m_head, m_head.left.load(std::memory_order_acquire));
+        } else {
+            m_rebuilt_size.store(std::max(m_rebuilt_size.load(std::memory_order_relaxed),
+                                          count(m_head.left.load(std::memory_order_acquire), 0)),
+                                 std::memory_order_relaxed);
+            node_base* parent = &m_head;
+            node_base* x = m_head.left.load(std::memory_order_acquire);
+            for (size_t depth = 0; x != nullptr && !x->leaf && !unbalanced(x, depth); depth++) {
+                parent = x;
+                x = child(x, *key);
+            }
+            if (x != nullptr && !x->leaf)
+                rebuild(parent, x);
+        }
+    } catch (...) {
+        return;
+    }
+    size_t retired = 0;
+    for (size_t i = 0; i < m_slot_count; i++) {
+        std::lock_guard<std::mutex> slot_lock{m_slots[i].mutex};
+        retired += m_slots[i].retired.size();
+    }
+    if (retired >= RECLAIM_THRESHOLD)
+        reclaim();
+}
+
+/**
+ * Replaces the subtree of x by a perfectly balanced one over the same leaves. The parent and then all inner nodes of
+ * the subtree are locked level by level, i.e. ancestors before descendants, as the updates do, which rules out
+ * deadlocks and stops all updates inside the subtree. Returns false if x is no longer a child of parent. The vectors
+ * grow and the new nodes are allocated under the locks, if that throws the locks are released and the subtree is
+ * left as it was.
+ */
+template<typename Key, typename CmpFn>
+bool relaxed_ordered_set<Key, CmpFn>::rebuild(node_base* parent, node_base* x)
+{
+    if (x == nullptr || x->leaf)
+        return false;
+    guard g{*this};
+    parent->lock();
+    std::atomic<node_base*>& to_x = link(parent, x);
+    if (parent->removed.load(std::memory_order_relaxed) || to_x.load(std::memory_order_relaxed) != x) {
+        parent->unlock();
+        return false;
+    }
+    std::vector<node_base*> inner;
+    std::vector<node*> leaves;
+    size_t locked = 0;
+    node_base* rebuilt = nullptr;
+    try {
+        inner.push_back(x);
+        for (; locked < inner.size(); locked++) {
+            inner[locked]->lock();
+            for (node_base* c : {inner[locked]->left.load(std::memory_order_relaxed),
+                                 inner[locked]->right.load(std::memory_order_relaxed)})
+                if (!c->leaf)
+                    inner.push_back(c);
+        }
+        // the links may have changed until the lock of each node was taken, collect the leaves from the locked nodes
+        std::vector<node_base*> stack{x};
+        while (!stack.empty()) {
+            node_base* y = stack.back();
+            stack.pop_back();
+            if (y->leaf) {
+                leaves.push_back(cast(y));
+            } else {
+                stack.push_back(y->right.load(std::memory_order_relaxed));
+                stack.push_back(y->left.load(std::memory_order_relaxed));
+            }
+        }
+        rebuilt = build(leaves, 0, leaves.size());
+    } catch (...) {
+        for (size_t i = 0; i < locked; i++)
+            inner[i]->unlock();
+        parent->unlock();
+        throw;
+    }
+    to_x.store(rebuilt, std::memory_order_release);
+    for (node_base* y : inner) {
+        y->removed.store(true, std::memory_order_relaxed);
+        y->unlock();
+    }
+    parent->unlock();
+    for (node_base* y : inner)
+        retire(g.slot(), cast(y));
+    if (parent == &m_head)
+        m_rebuilt_size.store(leaves.size(), std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Links the leaves under new inner nodes into a perfectly balanced tree. If an allocation throws, the inner nodes
+ * already created are freed, the leaves are left alone.
+ */
+template<typename Key, typename CmpFn>
+typename relaxed_ordered_set<Key, CmpFn>::node_base*
+relaxed_ordered_set<Key, CmpFn>::build(std::vector<node*>& leaves, size_t begin, size_t end)
+{
+    if (end - begin == 1)
+        return leaves[begin];
+    size_t mid = begin + (end - begin) / 2;
+    node* x = new node(leaves[mid]->key, false, end - begin);
+    try {
+        x->left.store(build(leaves, begin, mid), std::memory_order_relaxed);
+        x->right.store(build(leaves, mid, end), std::memory_order_relaxed);
+    } catch (...) {
+        delete_inner(x);
+        throw;
+    }
+    return x;
+}
+
+/**
+ * Frees the inner nodes of a tree made by build but not linked, the leaves belong to the set.
+ */
+template<typename Key, typename CmpFn>
+void relaxed_ordered_set<Key, CmpFn>::delete_inner(node_base* x)
+{
+    if (x == nullptr || x->leaf)
+        return;
+    delete_inner(x->left.load(std::memory_order_relaxed));
+    delete_inner(x->right.load(std::memory_order_relaxed));
+    delete cast(x);
+}
+
+/**
+ * Advances the epoch and frees the nodes retired before the oldest epoch still announced.
+ */
+template<typename Key, typename CmpFn>
+void relaxed_ordered_set<Key, CmpFn>::reclaim()
+{
+    m_epoch.fetch_add(1);
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    for (size_t i = 0; i < m_slot_count; i++) {
+        std::uint64_t epoch = m_slots[i].epoch.load();
+        if (epoch != 0)
+            oldest = std::min(oldest, epoch);
+    }
+    for (size_t i = 0; i < m_slot_count; i++) {
+        std::lock_guard<std::mutex> lock{m_slots[i].mutex};
+        auto& retired = m_slots[i].retired;
+        auto kept = std::partition(retired.begin(), retired.end(),
+                                   [oldest](const retired_node& r) { return r.epoch >= oldest; });
+        for (auto it = kept; it != retired.end(); ++it)
+            delete it->x;
+        retired.erase(kept, retired.end());
+    }
+}
+
+template<typename Key, typename CmpFn>
+size_t relaxed_ordered_set<Key, CmpFn>::height(const node_base* x)
+{
+    if (x == nullptr)
+        return 0;
+    if (x->leaf)
+        return 1;
+    return 1 + std::max(height(x->left.load(std::memory_order_relaxed)), height(x->right.load(std::memory_order_relaxed)));
+}
+
+template<typename Key, typename CmpFn>
+void relaxed_ordered_set<Key, CmpFn>::delete_tree(node_base* x)
+{
+    std::vector<node_base*> stack;
+    if (x != nullptr)
+        stack.push_back(x);
+    while (!stack.empty()) {
+        node_base* y = stack.back();
+        stack.pop_back();
+        if (!y->leaf) {
+            stack.push_back(y->left.load(std::memory_order_relaxed));
+            stack.push_back(y->right.load(std::memory_order_relaxed));
+        }
+        delete cast(y);
+    }
+}
+
+} //!jp
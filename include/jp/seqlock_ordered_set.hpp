@@ -0,0 +1,458 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <algorithm>
+#include <functional>
+
+#include "detail/rb_tree.hpp"
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An ordered set for one writer thread and any number of reader threads, where reads never block and never write to
+ * memory shared with other readers except their epoch slot.
+ *
+ * The writer brackets every change of the tree with increments of a sequence counter, odd while the tree is being
+ * modified. Readers descend optimistically, without any lock, and retry if the counter was odd or changed meanwhile.
+ * A descent through a tree being rebalanced may see any mix of old and new links, so it is bounded by MAX_DEPTH and
+ * its result is discarded unless validated. Nodes unlinked by the writer are not freed until no reader can still
+ * reach them: a reader announces the global epoch in a slot for the duration of its read, and a node retired in
+ * epoch e is freed once every announced epoch is greater than e (epoch based reclamation, see 'Practical lock-freedom'
+ * by K. Fraser). Keys are never modified in place, so a reader may compare or copy the key of any node it reaches.
+ * The writer stores links and sizes atomically with release semantics and readers load them with acquire semantics,
+ * so a reader racing with a rebalancing reads stale but whole fields and never reaches a node before its key.
+ *
+ * insert, erase and clear must be called from a single thread at a time, the remaining functions from any thread.
+ */
+template<
+        typename Key,
+        typename Cmp_Fn = std::less<Key>
+        >
+class seqlock_ordered_set
+{
+    struct node : detail::rb_node
+    {
+        explicit node(const Key& key);
+        const Key key;
+    };
+
+    struct retired_node
+    {
+        node* x;
+        std::uint64_t epoch;
+    };
+
+    struct alignas(64) reader_slot
+    {
+        std::atomic<std::uint64_t> epoch{0};
+    };
+
+public:
+    explicit seqlock_ordered_set(size_t reader_slots = 0);
+    seqlock_ordered_set(const seqlock_ordered_set&) = delete;
+    seqlock_ordered_set& operator=(const seqlock_ordered_set&) = delete;
+    ~seqlock_ordered_set();
+    bool insert(const Key& key);
+    size_t erase(const Key& key);
+    void clear();
+    bool contains(const Key& key) const;
+    size_t order_of_key(const Key& key) const;
+    std::optional<Key> find_by_order(size_t order) const;
+    size_t size() const;
+    bool empty() const;
+    size_t retired() const;
+
+private:
+    static node* cast(detail::rb_node* x);
+    static detail::rb_node* load(detail::rb_node* const& field);
+    static size_t load_size(const detail::rb_node* x);
+    template<typename Read>
+    auto read(Read read) const;
+    size_t enter() const;
+    void leave(size_t slot) const;
+    void begin_write();
+    void end_write();
+    node* search(const Key& key) const;
+    void retire(node* x);
+    void reclaim();
+
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    static constexpr size_t MAX_DEPTH = 2 * std::numeric_limits<size_t>::digits;
+    static constexpr size_t MIN_SLOTS = 64;
+    static constexpr size_t RECLAIM_THRESHOLD = 64;
+    std::atomic<std::uint64_t> m_sequence;
+    std::atomic<std::uint64_t> m_epoch;
+    const size_t m_slot_count;
+    const std::unique_ptr<reader_slot[]> m_slots;
+    detail::rb_node* m_root;
+    detail::rb_journal m_writes;
+    std::atomic<size_t> m_size;
+    std::vector<retired_node> m_retired;
+};
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, typename CmpFn> inline
+seqlock_ordered_set<Key, CmpFn>::node::node(const Key& key)
+    : detail::rb_node{}
+    , key(key)
+{ }
+
+/**
+ * Creates the given number of reader slots, by default twice the number of hardware threads but at least MIN_SLOTS.
+ * At most that many reads are in progress at a time, further readers spin until a slot frees up.
+ */
+template<typename Key, typename CmpFn> inline
+seqlock_ordered_set<Key, CmpFn>::seqlock_ordered_set(size_t reader_slots)
+    : m_sequence{0}
+    , m_epoch{1}
+    , m_slot_count{reader_slots != 0 ? reader_slots : std::max<size_t>(MIN_SLOTS, 2 * std::thread::hardware_concurrency())}
+    , m_slots{new reader_slot[m_slot_count]}
+    , m_root{nullptr}
+    , m_writes{}
+    , m_size{0}
+    , m_retired{}
+{
+    m_writes.record = false;
+    m_writes.atomic = true;
+}
+
+/**
+ * No read may be in progress.
+ */
+template<typename Key, typename CmpFn>
+seqlock_ordered_set<Key, CmpFn>::~seqlock_ordered_set()
+{
+    clear();
+    for (const retired_node& r : m_retired)
+        delete r.x;
+}
+
+template<typename Key, typename CmpFn>
+bool seqlock_ordered_set<Key, CmpFn>::insert(const Key& key)
+{
+    detail::rb_node* x = m_root;
+    detail::rb_node* y = nullptr;
+    bool left = false;
+    while (x != nullptr) {
+        y = x;
+        const Key& x_key = cast(x)->key;
+        if (!CMP(key, x_key) && !CMP(x_key, key))
+            return false;
+        left = CMP(key, x_key);
+        x = left ? x->left : x->right;
+    }
+    node* z = new node(key);
+    begin_write();
+    detail::rb_insert(m_root, y, left, z, &m_writes);
+    end_write();
+    m_size.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+template<typename Key, typename CmpFn>
+size_t seqlock_ordered_set<Key, CmpFn>::erase(const Key& key)
+{
+    node* z = search(key);
+    if (z == nullptr)
+        return 0;
+    begin_write();
+    detail::rb_erase(m_root, z, &m_writes);
+    end_write();
+    m_size.fetch_sub(1, std::memory_order_release);
+    retire(z);
+    return 1;
+}
+
+/**
+ * Unlinks the whole tree at once and retires all its nodes, without modifying them.
+ */
+template<typename Key, typename CmpFn>
+void seqlock_ordered_set<Key, CmpFn>::clear()
+{
+    detail::rb_node* root = m_root;
+    if (root == nullptr)
+        return;
+    begin_write();
+    detail::rb_write(&m_writes, m_root, nullptr);
+    end_write();
+    m_size.store(0, std::memory_order_release);
+    std::vector<detail::rb_node*> stack{root};
+    m_retired.reserve(m_retired.size() + root->size);
+    while (!stack.empty()) {
+        detail::rb_node* x = stack.back();
+        stack.pop_back();
+        if (x->left != nullptr)
+            stack.push_back(x->left);
+        if (x->right != nullptr)
+            stack.push_back(x->right);
+        m_retired.push_back(retired_node{cast(x), m_epoch.load(std::memory_order_relaxed)});
+    }
+    reclaim();
+}
+
+template<typename Key, typename CmpFn>
+bool seqlock_ordered_set<Key, CmpFn>::contains(const Key& key) const
+{
+    return read([this, &key]() -> std::optional<bool> {
+        detail::rb_node* x = load(m_root);
+        for (size_t depth = 0; x != nullptr; depth++) {
+            if (depth == MAX_DEPTH)
+                return std::nullopt;
+            const Key& x_key = cast(x)->key;
+            if (CMP(key, x_key))
+                x = load(x->left);
+            else if (CMP(x_key, key))
+                x = load(x->right);
+            else
+                return true;
+        }
+        return false;
+    });
+}
+
+template<typename Key, typename CmpFn>
+size_t seqlock_ordered_set<Key, CmpFn>::order_of_key(const Key& key) const
+{
+    return read([this, &key]() -> std::optional<size_t> {
+        detail::rb_node* x = load(m_root);
+        size_t current = load_size(x);
+        for (size_t depth = 0; x != nullptr; depth++) {
+            if (depth == MAX_DEPTH)
+                return std::nullopt;
+            const Key& x_key = cast(x)->key;
+            if (CMP(key, x_key)) {
+                current -= 1 + load_size(load(x->right));
+                x = load(x->left);
+            } else if (CMP(x_key, key)) {
+                x = load(x->right);
+            } else {
+                current -= 1 + load_size(load(x->right));
+                break;
+            }
+        }
+        return current;
+    });
+}
+
+/**
+ * Returns a copy of the key of the given order, or nothing if the set has at most order keys.
+ */
+template<typename Key, typename CmpFn>
+std::optional<Key> seqlock_ordered_set<Key, CmpFn>::find_by_order(size_t order) const
+{
+    return read([this, order]() -> std::optional<std::optional<Key>> {
+        detail::rb_node* x = load(m_root);
+        size_t current = x != nullptr ? load_size(load(x->left)) : 0;
+        for (size_t depth = 0; x != nullptr; depth++) {
+            if (depth == MAX_DEPTH)
+                return std::nullopt;
+            if (current == order)
+                return std::optional<Key>{cast(x)->key};
+            if (current > order) {
+                x = load(x->left);
+                if (x != nullptr)
+                    current -= 1 + load_size(load(x->right));
+            } else {
+                x = load(x->right);
+                if (x != nullptr)
+                    current += 1 + load_size(load(x->left));
+            }
+        }
+        return std::optional<Key>{};
+    });
+}
+
+/**
+ * Returns the size after the last completed update.
+ */
+template<typename Key, typename CmpFn> inline
+size_t seqlock_ordered_set<Key, CmpFn>::size() const
+{
+    return m_size.load(std::memory_order_acquire);
+}
+
+template<typename Key, typename CmpFn> inline
+bool seqlock_ordered_set<Key, CmpFn>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+ * Returns the number of unlinked nodes waiting for the readers which may still reach them, writer only.
+ */
+template<typename Key, typename CmpFn> inline
+size_t seqlock_ordered_set<Key, CmpFn>::retired() const
+{
+    return m_retired.size();
+}
+
+template<typename Key, typename CmpFn> inline
+typename seqlock_ordered_set<Key, CmpFn>::node* seqlock_ordered_set<Key, CmpFn>::cast(detail::rb_node* x)
+{
+    return static_cast<node*>(x);
+}
+
+/**
+ * Reads a link which the writer may be modifying at the same time.
+ */
+template<typename Key, typename CmpFn> inline
+detail::rb_node* seqlock_ordered_set<Key, CmpFn>::load(detail::rb_node* const& field)
+{
+    return __atomic_load_n(&field, __ATOMIC_ACQUIRE);
+}
+
+template<typename Key, typename CmpFn> inline
+size_t seqlock_ordered_set<Key, CmpFn>::load_size(const detail::rb_node* x)
+{
+    return x != nullptr ? __atomic_load_n(&x->size, __ATOMIC_ACQUIRE) : 0;
+}
+
+/**
+ * Runs the read until it completes within an even and unchanged sequence number. The read returns nothing if it
+ * detected an inconsistency on its own.
+ */
+template<typename Key, typename CmpFn>
+template<typename Read>
+auto seqlock_ordered_set<Key, CmpFn>::read(Read read) const
+{
+    size_t slot = enter();
+    for (unsigned attempt = 1;; attempt++) {
+        std::uint64_t before = m_sequence.load(std::memory_order_acquire);
+        if ((before & 1) == 0) {
+            auto result = read();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (result && m_sequence.load(std::memory_order_relaxed) == before) {
+                leave(slot);
+                return *std::move(result);
+            }
+        }
+        if (attempt % 64 == 0)
+            std::this_thread::yield();
+    }
+}
+
+/**
+ * Claims a free reader slot and announces the current epoch in it.
+ */
+template<typename Key, typename CmpFn>
+size_t seqlock_ordered_set<Key, CmpFn>::enter() const
+{
+    static thread_local size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (size_t n = 1, i = hint % m_slot_count;; n++, i = (i + 1) % m_slot_count) {
+        std::uint64_t epoch = m_epoch.load();
+        std::uint64_t expected = 0;
+        if (m_slots[i].epoch.load(std::memory_order_relaxed) == 0 && m_slots[i].epoch.compare_exchange_strong(expected, epoch)) {
+            // the writer may have advanced the epoch before seeing the announcement, catch up until it is stable
+            for (std::uint64_t current; (current = m_epoch.load()) != epoch; epoch = current)
+                m_slots[i].epoch.store(current);
+            hint = i;
+            return i;
+        }
+        if (n % m_slot_count == 0)
+            std::this_thread::yield();
+    }
+}
+
+template<typename Key, typename CmpFn> inline
+void seqlock_ordered_set<Key, CmpFn>::leave(size_t slot) const
+{
+    m_slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+/**
+ * The fence orders the odd sequence number before the modifications, it also publishes a new node before it is
+ * linked.
+ */
+template<typename Key, typename CmpFn> inline
+void seqlock_ordered_set<Key, CmpFn>::begin_write()
+{
+    m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template<typename Key, typename CmpFn> inline
+void seqlock_ordered_set<Key, CmpFn>::end_write()
+{
+    m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename Key, typename CmpFn>
+typename seqlock_ordered_set<Key, CmpFn>::node* seqlock_ordered_set<Key, CmpFn>::search(const Key& key) const
+{
+    detail::rb_node* x = m_root;
+    while (x != nullptr) {
+        const Key& x_key = cast(x)->key;
+        if (CMP(key, x_key))
+            x = x->left;
+        else if (CMP(x_key, key))
+            x = x->right;
+        else
+            return cast(x);
+    }
+    return nullptr;
+}
+
+template<typename Key, typename CmpFn> inline
+void seqlock_ordered_set<Key, CmpFn>::retire(node* x)
+{
+    m_retired.push_back(retired_node{x, m_epoch.load(std::memory_order_relaxed)});
+    if (m_retired.size() >= RECLAIM_THRESHOLD)
+        reclaim();
+}
+
+/**
+ * Advances the epoch, so readers starting from now on cannot reach any of the retired nodes, and frees the nodes
+ * retired before the oldest epoch still announced.
+ */
+template<typename Key, typename CmpFn>
+void seqlock_ordered_set<Key, CmpFn>::reclaim()
+{
+    m_epoch.fetch_add(1);
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    for (size_t i = 0; i < m_slot_count; i++) {
+        std::uint64_t epoch = m_slots[i].epoch.load();
+        if (epoch != 0)
+            oldest = std::min(oldest, epoch);
+    }
+    auto kept = std::partition(m_retired.begin(), m_retired.end(),
+                               [oldest](const retired_node& r) { return r.epoch >= oldest; });
+    for (auto it = kept; it != m_retired.end(); ++it)
+        delete it->x;
+    m_retired.erase(kept, m_retired.end());
+}
+
+} //!jp
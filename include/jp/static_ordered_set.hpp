@@ -0,0 +1,831 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <utility>
+#include <ostream>
+#include <cassert>
+#include <sstream>
+#include <iterator>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <string_view>
+#include <type_traits>
+
+namespace jp {
+
+/////////////////////////////////////////////////////////////////////////////// DECLARATION ////////////////////////////
+
+/**
+ * An ordered_set of at most N keys which never allocates. All nodes live in an array inside the object and refer to
+ * each other by the smallest unsigned integer type that can index it, the sentinel is the element 0 of the array.
+ * Erased nodes are reused through a free list. Inserting a new key into a full set throws std::length_error, full()
+ * tells in advance whether it would. As nothing refers to an address, the set is trivially copyable whenever Key is.
+ *
+ * Everything but printing, partition_points and subranges is constexpr, so for a literal Key and Cmp_Fn a set can be
+ * built and queried at compile time, e.g. 'constexpr static_ordered_set<int, 4> table{7, 3, 5};' ends up in read-only
+ * data. Exceeding the capacity in a constant expression is a compile error. The two exceptions return their result in
+ * a std::vector, the set itself still never allocates.
+ *
+ * Red-black tree implementation according to 'Introduction to Algorithms, Third Edition' by T. H. Cormen.
+ */
+template<
+        typename Key,
+        size_t N,
+        typename Cmp_Fn = std::less<Key>
+        >
+class static_ordered_set
+{
+    static_assert(N > 0 && N < UINT32_MAX, "unsupported capacity");
+
+    using index_type = std::conditional_t<(N < UINT8_MAX), std::uint8_t,
+                       std::conditional_t<(N < UINT16_MAX), std::uint16_t, std::uint32_t>>;
+
+    struct node
+    {
+        Key key;
+        index_type size;
+        index_type left;
+        index_type right;
+        index_type parent;
+        bool color;
+
+        std::string str() const;
+    };
+
+public:
+    class const_iterator
+    {
+        friend class static_ordered_set<Key, N, Cmp_Fn>;
+        constexpr const_iterator(const static_ordered_set* tree, index_type nd);
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = Key;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Key*;
+        using reference = const Key&;
+
+        const_iterator() = delete;
+        const_iterator(const const_iterator& other) = default;
+        const_iterator(const_iterator&&) = default;
+        const_iterator& operator=(const const_iterator& other) = default;
+        const_iterator& operator=(const_iterator&&) = default;
+        ~const_iterator() = default;
+        constexpr const_iterator& operator++();
+        constexpr const_iterator operator++(int);
+        constexpr const_iterator& operator--();
+        constexpr const_iterator operator--(int);
+        constexpr bool operator==(const const_iterator& other) const;
+        constexpr bool operator!=(const const_iterator& other) const;
+        constexpr const Key* operator->() const;
+        constexpr const Key& operator*() const;
+    private:
+        const static_ordered_set* m_tree;
+        index_type m_node;
+    };
+
+    constexpr static_ordered_set();
+    constexpr static_ordered_set(std::initializer_list<Key> keys);
+    constexpr std::pair<const_iterator, bool> insert(const Key& key);
+    constexpr const_iterator erase(const Key& key);
+    constexpr bool erase_by_order(size_t order);
+    constexpr Key extract_by_order(size_t order);
+    constexpr size_t erase_less_than(const Key& key);
+    constexpr size_t erase_prefix(size_t count);
+    constexpr size_t order_of_key(const Key& key) const;
+    constexpr const_iterator find(const Key& key) const;
+    constexpr const_iterator find_by_order(size_t order) const;
+    std::vector<const_iterator> partition_points(size_t k) const;
+    std::vector<std::pair<const_iterator, const_iterator>> subranges(size_t k) const;
+    constexpr const_iterator min() const;
+    constexpr const_iterator max() const;
+    constexpr const_iterator begin() const;
+    constexpr const_iterator end() const;
+    constexpr size_t size() const;
+    constexpr bool empty() const;
+    constexpr bool full() const;
+    static constexpr size_t capacity();
+    constexpr void clear();
+
+    template<typename T, size_t M, typename C>
+    friend std::ostream& operator<<(std::ostream& out, const static_ordered_set<T, M, C>& tree);
+
+private:
+    constexpr index_type allocate(const Key& key, index_type parent);
+    constexpr void deallocate(index_type x);
+    constexpr bool equal(const Key& lhs, const Key& rhs) const;
+    constexpr bool not_equal(const Key& lhs, const Key& rhs) const;
+    constexpr index_type successor(index_type x) const;
+    constexpr index_type predecessor(index_type x) const;
+    constexpr index_type min(index_type x) const;
+    constexpr index_type max(index_type x) const;
+    constexpr index_type search(const Key& key) const;
+    constexpr const_iterator erase_node(index_type z);
+    constexpr void rotate_left(index_type x);
+    constexpr void rotate_right(index_type x);
+    constexpr void transplant(index_type u, index_type v);
+    constexpr void updateSize(index_type start, index_type end, int value);
+    constexpr void fixup_erase(index_type x);
+    constexpr void fixup_insert(index_type z);
+    void print(std::ostream& out, index_type x, std::string& prefix) const;
+
+    static constexpr bool RED = 0;
+    static constexpr bool BLACK = 1;
+    static constexpr index_type NIL = 0;
+    static constexpr Cmp_Fn CMP = Cmp_Fn();
+    node m_nodes[N + 1];
+    index_type m_root;
+    index_type m_used; // nodes ever taken from the array, the free list holds the erased ones
+    index_type m_free;
+};
+
+
+/////////////////////////////////////////////////////////////////////////////// DEFINITION /////////////////////////////
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+static_ordered_set<Key, N, CmpFn>::const_iterator::const_iterator(const static_ordered_set* tree, index_type nd)
+    : m_tree{tree}
+    , m_node{nd}
+{ }
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator&
+static_ordered_set<Key, N, CmpFn>::const_iterator::operator++()
+{
+    m_node = m_tree->successor(m_node);
+    return *this;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator
+static_ordered_set<Key, N, CmpFn>::const_iterator::operator++(int)
+{
+    const_iterator tmp{*this};
+    operator++();
+    return tmp;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator&
+static_ordered_set<Key, N, CmpFn>::const_iterator::operator--()
+{
+    m_node = m_tree->predecessor(m_node);
+    return *this;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator
+static_ordered_set<Key, N, CmpFn>::const_iterator::operator--(int)
+{
+    const_iterator tmp{*this};
+    operator--();
+    return tmp;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::const_iterator::operator==(const const_iterator& other) const
+{
+    return m_node == other.m_node;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::const_iterator::operator!=(const const_iterator& other) const
+{
+    return m_node != other.m_node;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+const Key* static_ordered_set<Key, N, CmpFn>::const_iterator::operator->() const
+{
+    return &(m_tree->m_nodes[m_node].key);
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+const Key& static_ordered_set<Key, N, CmpFn>::const_iterator::operator*() const
+{
+    return m_tree->m_nodes[m_node].key;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+static_ordered_set<Key, N, CmpFn>::static_ordered_set()
+    : m_nodes{}
+    , m_root{NIL}
+    , m_used{0}
+    , m_free{NIL}
+{
+    m_nodes[NIL].color = BLACK;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+static_ordered_set<Key, N, CmpFn>::static_ordered_set(std::initializer_list<Key> keys)
+    : static_ordered_set()
+{
+    for (const Key& key : keys)
+        insert(key);
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+std::pair<typename static_ordered_set<Key, N, CmpFn>::const_iterator, bool>
+static_ordered_set<Key, N, CmpFn>::insert(const Key& key)
+{
+    index_type x = m_root;
+    index_type y = NIL;
+    while (x != NIL) {
+        y = x;
+        if (equal(key, m_nodes[x].key))
+            return std::make_pair(const_iterator{this, x}, false);
+        if (CMP(key, m_nodes[x].key))
+            x = m_nodes[x].left;
+        else
+            x = m_nodes[x].right;
+    }
+    if (full())
+        throw std::length_error("jp::static_ordered_set::insert");
+    index_type z = allocate(key, y);
+    if (y == NIL)
+        m_root = z;
+    else if (CMP(key, m_nodes[y].key))
+        m_nodes[y].left = z;
+    else
+        m_nodes[y].right = z;
+    updateSize(y, NIL, 1);
+    fixup_insert(z);
+    return std::make_pair(const_iterator{this, z}, true);
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator static_ordered_set<Key, N, CmpFn>::erase(const Key& key)
+{
+    index_type z = search(key);
+    if (z == NIL)
+        return end();
+    return erase_node(z);
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::erase_by_order(size_t order)
+{
+    if (order >= size())
+        return false;
+    erase_node(find_by_order(order).m_node);
+    return true;
+}
+
+/**
+ * Unlinks the key at the given order and returns it, throws std::out_of_range if there is no such key.
+ */
+template<typename Key, size_t N, typename CmpFn> constexpr
+Key static_ordered_set<Key, N, CmpFn>::extract_by_order(size_t order)
+{
+    if (order >= size())
+        throw std::out_of_range("jp::static_ordered_set::extract_by_order");
+    index_type z = find_by_order(order).m_node;
+    Key key = std::move(m_nodes[z].key);
+    erase_node(z);
+    return key;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+size_t static_ordered_set<Key, N, CmpFn>::erase_less_than(const Key& key)
+{
+    return erase_prefix(order_of_key(key));
+}
+
+/**
+ * Erases the count smallest keys and returns the number of erased keys. Unlike ordered_set the tree is not split, the
+ * minimum is erased count times in O(count log n), unless the whole set goes in which case it is cleared.
+ */
+template<typename Key, size_t N, typename CmpFn> constexpr
+size_t static_ordered_set<Key, N, CmpFn>::erase_prefix(size_t count)
+{
+    count = std::min(count, size());
+    if (count == size()) {
+        clear();
+        return count;
+    }
+    for (size_t i = 0; i < count; i++)
+        erase_node(min(m_root));
+    return count;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator static_ordered_set<Key, N, CmpFn>::erase_node(index_type z)
+{
+    updateSize(m_nodes[z].parent, NIL, -1);
+    auto it = const_iterator{this, successor(z)};
+    index_type y = z;
+    index_type x = NIL;
+    bool y_original_color = m_nodes[y].color;
+    if (m_nodes[z].left == NIL) {
+        x = m_nodes[z].right;
+        transplant(z, m_nodes[z].right);
+    } else if (m_nodes[z].right == NIL) {
+        x = m_nodes[z].left;
+        transplant(z, m_nodes[z].left);
+    } else {
+        y = min(m_nodes[z].right);
+        y_original_color = m_nodes[y].color;
+        x = m_nodes[y].right;
+        if (m_nodes[y].parent == z) {
+            m_nodes[x].parent = y;
+        } else {
+            updateSize(m_nodes[y].parent, z, -1);
+            transplant(y, m_nodes[y].right);
+            m_nodes[y].right = m_nodes[z].right;
+            m_nodes[m_nodes[y].right].parent = y;
+        }
+        transplant(z, y);
+        m_nodes[y].left = m_nodes[z].left;
+        m_nodes[m_nodes[y].left].parent = y;
+        m_nodes[y].color = m_nodes[z].color;
+        m_nodes[y].size = m_nodes[z].size - 1;
+    }
+    if (y_original_color == BLACK)
+        fixup_erase(x);
+    m_nodes[NIL].parent = NIL;
+    deallocate(z);
+    return it;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+size_t static_ordered_set<Key, N, CmpFn>::order_of_key(const Key& key) const
+{
+    size_t current = m_nodes[m_root].size;
+    index_type x = m_root;
+    while (x != NIL && not_equal(key, m_nodes[x].key)) {
+        if (CMP(key, m_nodes[x].key)) {
+            current -= 1 + m_nodes[m_nodes[x].right].size;
+            x = m_nodes[x].left;
+        } else {
+            x = m_nodes[x].right;
+        }
+    }
+    current -= m_nodes[m_nodes[x].right].size;
+    if (x != NIL)
+        --current;
+    return current;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator
+static_ordered_set<Key, N, CmpFn>::find(const Key& key) const
+{
+    return const_iterator{this, search(key)};
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator
+static_ordered_set<Key, N, CmpFn>::find_by_order(size_t order) const
+{
+    size_t current = m_nodes[m_nodes[m_root].left].size;
+    index_type x = m_root;
+    while (x != NIL && current != order) {
+        if (current > order) {
+            current -= m_nodes[m_nodes[x].left].size;
+            x = m_nodes[x].left;
+            current += m_nodes[m_nodes[x].left].size;
+        } else {
+            x = m_nodes[x].right;
+            current += 1 + m_nodes[m_nodes[x].left].size;
+        }
+    }
+    return const_iterator{this, x};
+}
+
+/**
+ * Returns k - 1 iterators to the elements of ranks n / k, 2n / k, ..., (k - 1)n / k, i.e. the boundaries splitting
+ * the set into k parts of (almost) equal size. Every rank is selected separately in O(log n).
+ */
+template<typename Key, size_t N, typename CmpFn>
+std::vector<typename static_ordered_set<Key, N, CmpFn>::const_iterator>
+static_ordered_set<Key, N, CmpFn>::partition_points(size_t k) const
+{
+    std::vector<const_iterator> points{};
+    if (k < 2)
+        return points;
+    const size_t n = size();
+    points.reserve(k - 1);
+    for (size_t i = 1; i < k; i++)
+        points.push_back(find_by_order(i * n / k));
+    return points;
+}
+
+/**
+ * Splits the set into k disjoint, consecutive [first, last) ranges of (almost) equal size. Ranges are empty when k
+ * exceeds the size of the set.
+ */
+template<typename Key, size_t N, typename CmpFn>
+std::vector<std::pair<typename static_ordered_set<Key, N, CmpFn>::const_iterator,
+                      typename static_ordered_set<Key, N, CmpFn>::const_iterator>>
+static_ordered_set<Key, N, CmpFn>::subranges(size_t k) const
+{
+    std::vector<std::pair<const_iterator, const_iterator>> ranges{};
+    if (k == 0)
+        return ranges;
+    std::vector<const_iterator> points = partition_points(k);
+    ranges.reserve(k);
+    const_iterator first = begin();
+    for (const const_iterator& point : points) {
+        ranges.emplace_back(first, point);
+        first = point;
+    }
+    ranges.emplace_back(first, end());
+    return ranges;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator static_ordered_set<Key, N, CmpFn>::min() const
+{
+    return const_iterator{this, min(m_root)};
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator static_ordered_set<Key, N, CmpFn>::max() const
+{
+    return const_iterator{this, max(m_root)};
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator static_ordered_set<Key, N, CmpFn>::begin() const
+{
+    return min();
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::const_iterator static_ordered_set<Key, N, CmpFn>::end() const
+{
+    return const_iterator{this, NIL};
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+size_t static_ordered_set<Key, N, CmpFn>::size() const
+{
+    return m_nodes[m_root].size;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::empty() const
+{
+    return m_root == NIL;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::full() const
+{
+    return size() == N;
+}
+
+template<typename Key, size_t N, typename CmpFn>
+constexpr size_t static_ordered_set<Key, N, CmpFn>::capacity()
+{
+    return N;
+}
+
+/**
+ * Empties the set in O(1) unless Key has a non-trivial destructor, in which case the keys are reset to Key{} to release
+ * whatever they hold.
+ */
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::clear()
+{
+    if constexpr (!std::is_trivially_destructible_v<Key>)
+        for (index_type i = 1; i <= m_used; i++)
+            m_nodes[i].key = Key{};
+    m_root = NIL;
+    m_used = 0;
+    m_free = NIL;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::index_type
+static_ordered_set<Key, N, CmpFn>::allocate(const Key& key, index_type parent)
+{
+    index_type x = m_free;
+    if (x != NIL)
+        m_free = m_nodes[x].right;
+    else
+        x = ++m_used;
+    m_nodes[x] = node{key, 1, NIL, NIL, parent, RED};
+    return x;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::deallocate(index_type x)
+{
+    if constexpr (!std::is_trivially_destructible_v<Key>)
+        m_nodes[x].key = Key{};
+    m_nodes[x].right = m_free;
+    m_free = x;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::equal(const Key& lhs, const Key& rhs) const
+{
+    return (!CMP(lhs, rhs)) & (!CMP(rhs, lhs));
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+bool static_ordered_set<Key, N, CmpFn>::not_equal(const Key& lhs, const Key& rhs) const
+{
+    return CMP(lhs, rhs) | CMP(rhs, lhs);
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::index_type static_ordered_set<Key, N, CmpFn>::successor(index_type x) const
+{
+    if (m_nodes[x].right != NIL)
+        return min(m_nodes[x].right);
+    while (x != NIL) {
+        index_type p = m_nodes[x].parent;
+        if (x == m_nodes[p].left)
+            return p;
+        x = p;
+    }
+    return NIL;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::index_type
+static_ordered_set<Key, N, CmpFn>::predecessor(index_type x) const
+{
+    if (x == NIL)
+        return max(m_root);
+    if (m_nodes[x].left != NIL)
+        return max(m_nodes[x].left);
+    while (x != NIL) {
+        index_type p = m_nodes[x].parent;
+        if (x == m_nodes[p].right)
+            return p;
+        x = p;
+    }
+    return NIL;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::index_type static_ordered_set<Key, N, CmpFn>::min(index_type x) const
+{
+    if (x != NIL)
+        while (m_nodes[x].left != NIL)
+            x = m_nodes[x].left;
+    return x;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::index_type static_ordered_set<Key, N, CmpFn>::max(index_type x) const
+{
+    if (x != NIL)
+        while (m_nodes[x].right != NIL)
+            x = m_nodes[x].right;
+    return x;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+typename static_ordered_set<Key, N, CmpFn>::index_type static_ordered_set<Key, N, CmpFn>::search(const Key& key) const
+{
+    index_type x = m_root;
+    while (x != NIL && not_equal(key, m_nodes[x].key)) {
+        if (CMP(key, m_nodes[x].key))
+            x = m_nodes[x].left;
+        else
+            x = m_nodes[x].right;
+    }
+    return x;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::rotate_left(index_type x)
+{
+    index_type y = m_nodes[x].right;
+    m_nodes[x].right = m_nodes[y].left;
+    if (m_nodes[y].left != NIL)
+        m_nodes[m_nodes[y].left].parent = x;
+    m_nodes[y].parent = m_nodes[x].parent;
+    if (m_nodes[x].parent == NIL)
+        m_root = y;
+    else if (x == m_nodes[m_nodes[x].parent].left)
+        m_nodes[m_nodes[x].parent].left = y;
+    else
+        m_nodes[m_nodes[x].parent].right = y;
+    m_nodes[y].left = x;
+    m_nodes[x].parent = y;
+    m_nodes[y].size = m_nodes[x].size;
+    m_nodes[x].size = m_nodes[m_nodes[x].left].size + m_nodes[m_nodes[x].right].size + 1;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::rotate_right(index_type x)
+{
+    index_type y = m_nodes[x].left;
+    m_nodes[x].left = m_nodes[y].right;
+    if (m_nodes[y].right != NIL)
+        m_nodes[m_nodes[y].right].parent = x;
+    m_nodes[y].parent = m_nodes[x].parent;
+    if (m_nodes[x].parent == NIL)
+        m_root = y;
+    else if (x == m_nodes[m_nodes[x].parent].left)
+        m_nodes[m_nodes[x].parent].left = y;
+    else
+        m_nodes[m_nodes[x].parent].right = y;
+    m_nodes[y].right = x;
+    m_nodes[x].parent = y;
+    m_nodes[y].size = m_nodes[x].size;
+    m_nodes[x].size = m_nodes[m_nodes[x].left].size + m_nodes[m_nodes[x].right].size + 1;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::transplant(index_type u, index_type v)
+{
+    index_type p = m_nodes[u].parent;
+    if (p == NIL)
+        m_root = v;
+    else if (u == m_nodes[p].left)
+        m_nodes[p].left = v;
+    else
+        m_nodes[p].right = v;
+    m_nodes[v].parent = p;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::updateSize(index_type start, index_type end, int value)
+{
+    while (start != end) {
+        m_nodes[start].size += value;
+        start = m_nodes[start].parent;
+    }
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::fixup_insert(index_type z)
+{
+    while (m_nodes[m_nodes[z].parent].color == RED) {
+        index_type p = m_nodes[z].parent;
+        index_type g = m_nodes[p].parent;
+        if (p == m_nodes[g].left) {
+            index_type y = m_nodes[g].right;
+            if (m_nodes[y].color == RED) {
+                m_nodes[p].color = BLACK;
+                m_nodes[y].color = BLACK;
+                m_nodes[g].color = RED;
+                z = g;
+            } else {
+                if (z == m_nodes[p].right) {
+                    z = p;
+                    rotate_left(z);
+                }
+                m_nodes[m_nodes[z].parent].color = BLACK;
+                m_nodes[g].color = RED;
+                rotate_right(g);
+            }
+        } else {
+            index_type y = m_nodes[g].left;
+            if (m_nodes[y].color == RED) {
+                m_nodes[p].color = BLACK;
+                m_nodes[y].color = BLACK;
+                m_nodes[g].color = RED;
+                z = g;
+            } else {
+                if (z == m_nodes[p].left) {
+                    z = p;
+                    rotate_right(z);
+                }
+                m_nodes[m_nodes[z].parent].color = BLACK;
+                m_nodes[g].color = RED;
+                rotate_left(g);
+            }
+        }
+    }
+    m_nodes[m_root].color = BLACK;
+}
+
+template<typename Key, size_t N, typename CmpFn> constexpr
+void static_ordered_set<Key, N, CmpFn>::fixup_erase(index_type x)
+{
+    while (x != m_root && m_nodes[x].color == BLACK) {
+        index_type p = m_nodes[x].parent;
+        if (x == m_nodes[p].left) {
+            index_type w = m_nodes[p].right;
+            if (m_nodes[w].color == RED) {
+                m_nodes[w].color = BLACK;
+                m_nodes[p].color = RED;
+                rotate_left(p);
+                w = m_nodes[p].right;
+            }
+            if (m_nodes[m_nodes[w].left].color == BLACK && m_nodes[m_nodes[w].right].color == BLACK) {
+                m_nodes[w].color = RED;
+                x = p;
+            } else {
+                if (m_nodes[m_nodes[w].right].color == BLACK) {
+                    m_nodes[m_nodes[w].left].color = BLACK;
+                    m_nodes[w].color = RED;
+                    rotate_right(w);
+                    w = m_nodes[p].right;
+                }
+                m_nodes[w].color = m_nodes[p].color;
+                m_nodes[p].color = BLACK;
+                m_nodes[m_nodes[w].right].color = BLACK;
+                rotate_left(p);
+                x = m_root;
+            }
+        } else {
+            index_type w = m_nodes[p].left;
+            if (m_nodes[w].color == RED) {
+                m_nodes[w].color = BLACK;
+                m_nodes[p].color = RED;
+                rotate_right(p);
+                w = m_nodes[p].left;
+            }
+            if (m_nodes[m_nodes[w].right].color == BLACK && m_nodes[m_nodes[w].left].color == BLACK) {
+                m_nodes[w].color = RED;
+                x = p;
+            } else {
+                if (m_nodes[m_nodes[w].left].color == BLACK) {
+                    m_nodes[m_nodes[w].right].color = BLACK;
+                    m_nodes[w].color = RED;
+                    rotate_left(w);
+                    w = m_nodes[p].left;
+                }
+                m_nodes[w].color = m_nodes[p].color;
+                m_nodes[p].color = BLACK;
+                m_nodes[m_nodes[w].left].color = BLACK;
+                rotate_right(p);
+                x = m_root;
+            }
+        }
+    }
+    m_nodes[x].color = BLACK;
+}
+
+template<typename Key, size_t N, typename CmpFn> inline
+std::ostream& operator<<(std::ostream& out, const static_ordered_set<Key, N, CmpFn>& tree)
+{
+    if (tree.empty()) {
+        out << "(empty_tree)";
+        return out;
+    }
+
+    std::string prefix = " ";
+    tree.print(out, tree.m_root, prefix);
+    out << "(key,size,color)";
+    return out;
+}
+
+template<typename Key, size_t N, typename CmpFn> inline
+void static_ordered_set<Key, N, CmpFn>::print(std::ostream& out, index_type x, std::string& prefix) const
+{
+    auto prefixEnd = prefix.back();
+    auto prefixSize = prefix.size();
+    std::string str = m_nodes[x].str();
+    bool is_right = m_nodes[m_nodes[x].parent].right == x;
+
+    prefix[prefixSize - 1] = is_right ? ' ' : prefixEnd;
+    prefix.resize(prefix.size() + str.size() - 1, ' ');
+    prefix.back() = '|';
+    if (m_nodes[x].right != NIL)
+        print(out, m_nodes[x].right, prefix);
+
+    std::string_view prefixView = prefix;
+    out << prefixView.substr(0, prefix.size() - str.size()) << str << '\n';
+
+    prefix[prefixSize - 1] = is_right ? prefixEnd : ' ';
+    if (m_nodes[x].left != NIL)
+        print(out, m_nodes[x].left, prefix);
+    prefix.resize(prefix.size() - str.size() + 1);
+}
+
+template<typename Key, size_t N, typename CmpFn> inline
+std::string static_ordered_set<Key, N, CmpFn>::node::str() const
+{
+    std::stringstream ss{};
+    ss << '(' << key << ',' << static_cast<size_t>(size) << ',' << (color ? 'b' : 'r') << ')';
+    return ss.str();
+}
+
+} //!jp
@@ -0,0 +1,227 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+namespace jp {
+
+/**
+ * A work-stealing thread pool running the async_* operations of the containers. Every worker has its own deque of
+ * tasks: tasks submitted by a worker go to the back of its deque and the worker takes from the back, so a recursive
+ * split is processed depth first and stays in its cache, while idle workers steal from the front of the other deques,
+ * i.e. the largest pieces of work. Tasks submitted from outside are dealt round robin.
+ *
+ * A task waiting for the result of another one should do so by wait, which runs other tasks in the meantime instead
+ * of blocking the worker, so nested parallelism cannot starve the pool.
+ */
+class thread_pool
+{
+public:
+    explicit thread_pool(size_t threads = std::thread::hardware_concurrency());
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    ~thread_pool();
+
+    template<typename Fn>
+    std::future<std::invoke_result_t<std::decay_t<Fn>>> submit(Fn&& fn);
+    template<typename T>
+    T wait(std::future<T>& future);
+    size_t size() const;
+    static thread_pool& shared();
+
+private:
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void push(std::function<void()> task);
+    bool run_one(size_t self);
+    void work(size_t self);
+    bool is_worker() const;
+
+    std::vector<std::unique_ptr<queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_pending;
+    std::atomic<size_t> m_next;
+    std::mutex m_sleep;
+    std::condition_variable m_wake;
+    bool m_stop;
+
+    static thread_local const thread_pool* t_pool;
+    static thread_local size_t t_index;
+};
+
+
+inline thread_local const thread_pool* thread_pool::t_pool = nullptr;
+inline thread_local size_t thread_pool::t_index = 0;
+
+/**
+ * Starts the given number of workers, at least one.
+ */
+inline thread_pool::thread_pool(size_t threads)
+    : m_queues{}
+    , m_threads{}
+    , m_pending{0}
+    , m_next{0}
+    , m_sleep{}
+    , m_wake{}
+    , m_stop{false}
+{
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; i++)
+        m_queues.push_back(std::make_unique<queue>());
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; i++)
+        m_threads.emplace_back([this, i] { work(i); });
+}
+
+/**
+ * Runs all submitted tasks before stopping the workers.
+ */
+inline thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_sleep};
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+}
+
+template<typename Fn>
+std::future<std::invoke_result_t<std::decay_t<Fn>>> thread_pool::submit(Fn&& fn)
+{
+    using result_type = std::invoke_result_t<std::decay_t<Fn>>;
+    // std::function needs a copyable target, the task is shared instead
+    auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Fn>(fn));
+    std::future<result_type> future = task->get_future();
+    push([task] { (*task)(); });
+    return future;
+}
+
+/**
+ * Returns the result of the future, running other tasks of the pool until it is ready if called by a worker.
+ */
+template<typename T>
+T thread_pool::wait(std::future<T>& future)
+{
+    if (is_worker()) {
+        while (future.wait_for(std::chrono::seconds::zero()) != std::future_status::ready)
+            if (!run_one(t_index))
+                std::this_thread::yield();
+    }
+    return future.get();
+}
+
+inline size_t thread_pool::size() const
+{
+    return m_threads.size();
+}
+
+/**
+ * Returns the pool used by default, with one worker per hardware thread, created on first use.
+ */
+inline thread_pool& thread_pool::shared()
+{
+    static thread_pool instance{};
+    return instance;
+}
+
+inline void thread_pool::push(std::function<void()> task)
+{
+    size_t target = is_worker() ? t_index : m_next.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    {
+        std::lock_guard<std::mutex> lock{m_queues[target]->mutex};
+        m_queues[target]->tasks.push_back(std::move(task));
+    }
+    m_pending.fetch_add(1);
+    // taking the lock orders the increment before the check of a worker about to sleep
+    { std::lock_guard<std::mutex> lock{m_sleep}; }
+    m_wake.notify_one();
+}
+
+/**
+ * Runs the newest task of the own queue or else the oldest task of another one, returns false if there was none.
+ */
+inline bool thread_pool::run_one(size_t self)
+{
+    std::function<void()> task;
+    for (size_t i = 0; i < m_queues.size() && !task; i++) {
+        queue& q = *m_queues[(self + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock{q.mutex};
+        if (q.tasks.empty())
+            continue;
+        if (i == 0) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+    }
+    if (!task)
+        return false;
+    m_pending.fetch_sub(1);
+    task();
+    return true;
+}
+
+inline void thread_pool::work(size_t self)
+{
+    t_pool = this;
+    t_index = self;
+    for (;;) {
+        if (run_one(self))
+            continue;
+        std::unique_lock<std::mutex> lock{m_sleep};
+        m_wake.wait(lock, [this] { return m_stop || m_pending.load() > 0; });
+        if (m_stop && m_pending.load() == 0)
+            return;
+    }
+}
+
+inline bool thread_pool::is_worker() const
+{
+    return t_pool == this;
+}
+
+} //!jp
@@ -0,0 +1,53 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Checks shared by the regression tests. They do not depend on NDEBUG, so the tests also run against release builds.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+inline void check(bool condition, const char* expression, const char* file, int line)
+{
+    if (condition)
+        return;
+    std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+template<typename Exception, typename Function>
+bool throws(Function&& function)
+{
+    try {
+        function();
+    } catch (const Exception&) {
+        return true;
+    }
+    return false;
+}
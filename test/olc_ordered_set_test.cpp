@@ -0,0 +1,129 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Regression tests of olc_ordered_set, every test function covers one fixed defect.
+ */
+
+#include "check.hpp"
+
+#include <jp/olc_ordered_set.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * The set could only be read key by key through std::optional, it had no iterators.
+ */
+static void iteration()
+{
+    jp::olc_ordered_set<int> set;
+    CHECK(set.begin() == set.end());
+    for (int i = 0; i < 1000; i++)
+        set.insert(i);
+    // erasing whole leaves leaves empty ones behind, which the iteration has to step over
+    for (int i = 100; i < 900; i++)
+        set.erase(i);
+    std::vector<int> expected;
+    for (int i = 0; i < 100; i++)
+        expected.push_back(i);
+    for (int i = 900; i < 1000; i++)
+        expected.push_back(i);
+    std::vector<int> seen;
+    for (int key : set)
+        seen.push_back(key);
+    CHECK(seen == expected);
+    CHECK(set.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        CHECK(set.find_by_order(i) == expected[i]);
+        CHECK(set.order_of_key(expected[i]) == i);
+    }
+}
+
+/**
+ * Lookups validate only the leaf and writers lock only the nodes they split. Keys which are never erased must stay
+ * visible to lookups and iterations while other keys are inserted and erased around them, splitting the nodes.
+ */
+static void concurrent_updates()
+{
+    const long KEYS = 30000;
+    jp::olc_ordered_set<long> set;
+    for (long key = 0; key < KEYS; key += 3)
+        set.insert(key);
+    std::atomic<long> size{KEYS / 3};
+    std::atomic<bool> done{false};
+    std::vector<std::thread> writers;
+    for (unsigned t = 0; t < 3; t++) {
+        writers.emplace_back([&set, &size, t] {
+            std::mt19937 random{t};
+            for (int i = 0; i < 100000; i++) {
+                long key = random() % KEYS / 3 * 3 + 1 + t % 2;
+                if (random() % 2 == 0)
+                    size += set.insert(key);
+                else
+                    size -= set.erase(key);
+            }
+        });
+    }
+    bool lost = false;
+    bool disordered = false;
+    std::thread reader([&] {
+        std::mt19937 random{7};
+        for (unsigned i = 1; !done; i++) {
+            lost |= !set.contains(random() % (KEYS / 3) * 3);
+            if (i % 64 != 0)
+                continue;
+            long previous = -1;
+            long stable = 0;
+            for (long key : set) {
+                disordered |= key <= previous;
+                stable += key % 3 == 0;
+                previous = key;
+            }
+            lost |= stable != KEYS / 3;
+        }
+    });
+    for (std::thread& writer : writers)
+        writer.join();
+    done = true;
+    reader.join();
+    CHECK(!lost);
+    CHECK(!disordered);
+    CHECK(static_cast<long>(set.size()) == size);
+    size_t order = 0;
+    for (long key : set)
+        CHECK(set.order_of_key(key) == order++);
+    CHECK(order == set.size());
+}
+
+int main()
+{
+    iteration();
+    concurrent_updates();
+    std::cout << "ok" << std::endl;
+    return 0;
+}
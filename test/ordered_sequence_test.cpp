@@ -0,0 +1,119 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Regression tests of ordered_sequence, every test function covers one fixed defect.
+ */
+
+#include "check.hpp"
+
+#include <jp/ordered_sequence.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Counts the live instances and throws from the copy once the given number of copies is reached.
+ */
+struct fragile
+{
+    static inline int live = 0;
+    static inline int copies_left = -1;
+
+    fragile(int value) : value{value} { live++; }
+    fragile(const fragile& other) : value{other.value}
+    {
+        if (copies_left == 0)
+            throw std::runtime_error("copy");
+        if (copies_left > 0)
+            copies_left--;
+        live++;
+    }
+    ~fragile() { live--; }
+
+    int value;
+};
+
+template<typename Sequence>
+static std::vector<int> values(const Sequence& sequence)
+{
+    std::vector<int> result;
+    for (const fragile& x : sequence)
+        result.push_back(x.value);
+    return result;
+}
+
+/**
+ * A copy throwing in the middle of assign or of copying a sequence leaked the nodes built so far and lost the old
+ * content.
+ */
+static void assign_is_exception_safe()
+{
+    std::vector<fragile> source;
+    for (int i = 0; i < 100; i++)
+        source.emplace_back(i);
+    {
+        jp::ordered_sequence<fragile> sequence;
+        sequence.assign(source.begin(), source.begin() + 3);
+        for (int after : {0, 1, 37, 99}) {
+            fragile::copies_left = after;
+            CHECK(throws<std::runtime_error>([&] { sequence.assign(source.begin(), source.end()); }));
+            fragile::copies_left = -1;
+            CHECK(values(sequence) == std::vector<int>({0, 1, 2}));
+        }
+        jp::ordered_sequence<fragile> full;
+        full.assign(source.begin(), source.end());
+        fragile::copies_left = 50;
+        CHECK(throws<std::runtime_error>([&] { jp::ordered_sequence<fragile> copy{full}; }));
+        fragile::copies_left = 50;
+        CHECK(throws<std::runtime_error>([&] { sequence = full; }));
+        fragile::copies_left = -1;
+        CHECK(values(sequence) == std::vector<int>({0, 1, 2}));
+    }
+    CHECK(fragile::live == static_cast<int>(source.size()));
+}
+
+/**
+ * insert_at, erase_at and split_at checked the index only with an assert.
+ */
+static void indices_checked()
+{
+    jp::ordered_sequence<int> sequence{1, 2, 3};
+    CHECK(throws<std::out_of_range>([&] { sequence.insert_at(4, 0); }));
+    CHECK(throws<std::out_of_range>([&] { sequence.erase_at(3); }));
+    CHECK(throws<std::out_of_range>([&] { sequence.split_at(4); }));
+    sequence.insert_at(3, 4);
+    sequence.erase_at(0);
+    jp::ordered_sequence<int> rest = sequence.split_at(3);
+    CHECK(sequence.size() == 3 && rest.empty());
+}
+
+int main()
+{
+    assign_is_exception_safe();
+    indices_checked();
+    std::cout << "ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Regression tests of ordered_set, every test function covers one fixed defect.
+ */
+
+#include "check.hpp"
+
+#include <jp/ordered_set.hpp>
+
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template<typename Set>
+static std::vector<int> keys(const Set& set)
+{
+    return std::vector<int>(set.begin(), set.end());
+}
+
+/**
+ * The journal moved along with the content still restored the root pointer of the moved-from set.
+ */
+static void rollback_after_move()
+{
+    jp::ordered_set<int> a;
+    for (int i = 0; i < 8; i++)
+        a.insert(i);
+    auto cp = a.checkpoint();
+    for (int i = 8; i < 64; i++)
+        a.insert(i);
+    a.erase(3);
+
+    jp::ordered_set<int> b{std::move(a)};
+    b.rollback(cp);
+    CHECK(keys(b) == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+    b.commit();
+
+    jp::ordered_set<int> c;
+    c.insert(100);
+    cp = b.checkpoint();
+    b.insert(8);
+    b.erase(0);
+    c = std::move(b);
+    c.rollback(cp);
+    CHECK(keys(c) == std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+    CHECK(c.size() == 8);
+    c.insert(9);
+    CHECK(c.order_of_key(9) == 8);
+}
+
+/**
+ * The bulk operations relinked the tree under an open checkpoint, only an assert guarded against it, and async_assign
+ * linked unsorted input into an invalid tree.
+ */
+static void bulk_operations_checked()
+{
+    jp::thread_pool pool{2};
+    jp::ordered_set<int> a;
+    jp::ordered_set<int> b;
+    const std::vector<int> sorted{1, 2, 3, 4};
+    const std::vector<int> unsorted{1, 3, 2, 4};
+    const std::vector<int> repeated{1, 2, 2, 4};
+    a.insert(7);
+    b.insert(8);
+
+    a.checkpoint();
+    CHECK(throws<std::logic_error>([&] { a.async_assign(sorted.begin(), sorted.end(), pool); }));
+    CHECK(throws<std::logic_error>([&] { a.async_merge(b, pool); }));
+    CHECK(throws<std::logic_error>([&] { a.async_erase_if([](int) { return true; }, pool); }));
+    CHECK(throws<std::logic_error>([&] { a.async_clear(pool); }));
+    CHECK(keys(a) == std::vector<int>({7}));
+    a.commit();
+
+    CHECK(throws<std::invalid_argument>([&] { a.async_assign(unsorted.begin(), unsorted.end(), pool).get(); }));
+    CHECK(throws<std::invalid_argument>([&] { a.async_assign(repeated.begin(), repeated.end(), pool).get(); }));
+    CHECK(keys(a) == std::vector<int>({7}));
+    a.async_assign(sorted.begin(), sorted.end(), pool).get();
+    CHECK(keys(a) == sorted);
+}
+
+/**
+ * build_from_stream left the filter sized for the empty set and relinked the tree under an open checkpoint.
+ */
+static void build_from_stream_maintains_filter()
+{
+    jp::ordered_set<int> set;
+    set.enable_filter();
+    std::stringstream in;
+    for (int i = 0; i < 10000; i++)
+        in << 2 * i << ' ';
+    set.build_from_stream(in);
+    CHECK(set.size() == 10000);
+    CHECK(set.filter_statistics().capacity >= set.size());
+    CHECK(set.filter_statistics().keys == set.size());
+    CHECK(set.contains(19998) && !set.contains(19999));
+
+    set.checkpoint();
+    int next = 0;
+    auto source = [&next]() -> std::optional<int> { return next < 10 ? std::optional<int>{next++} : std::nullopt; };
+    CHECK(throws<std::logic_error>([&] { set.build_from_stream(source); }));
+    CHECK(set.size() == 10000);
+}
+
+int main()
+{
+    rollback_after_move();
+    bulk_operations_checked();
+    build_from_stream_maintains_filter();
+    std::cout << "ok" << std::endl;
+    return 0;
+}
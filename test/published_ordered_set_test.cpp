@@ -0,0 +1,133 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Regression tests of published_ordered_set and frozen_ordered_set, every test function covers one fixed defect.
+ */
+
+#include "check.hpp"
+
+#include <jp/published_ordered_set.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/**
+ * The keys were stored a second time in sorted order, together with the rank of every node. The ranks computed from
+ * the Eytzinger index have to agree with the sorted range for every shape of the deepest level.
+ */
+static void frozen_ranks_from_layout()
+{
+    for (int n = 0; n <= 300; n++) {
+        std::vector<int> keys;
+        for (int i = 0; i < n; i++)
+            keys.push_back(2 * i);
+        jp::frozen_ordered_set<int> set{keys.begin(), keys.end()};
+        CHECK(set.size() == static_cast<size_t>(n));
+        CHECK(std::vector<int>(set.begin(), set.end()) == keys);
+        for (int i = 0; i < n; i++) {
+            CHECK(set.order_of_key(2 * i) == static_cast<size_t>(i));
+            CHECK(set.order_of_key(2 * i + 1) == static_cast<size_t>(i + 1));
+            CHECK(*set.find_by_order(i) == 2 * i);
+            CHECK(*set.find(2 * i) == 2 * i);
+            CHECK(set.find(2 * i + 1) == set.end());
+            CHECK(set.contains(2 * i) && !set.contains(2 * i + 1));
+        }
+        CHECK(set.order_of_key(-1) == 0);
+        CHECK(set.lower_bound(2 * n) == set.end());
+        CHECK(set.find_by_order(n) == set.end());
+        if (n != 0)
+            CHECK(*--set.end() == 2 * (n - 1));
+    }
+}
+
+/**
+ * Readers took snapshots through the atomic shared_ptr functions, which lock. A pinned snapshot has to stay intact
+ * while the writer keeps publishing, and readers racing with publications must always see a complete one.
+ */
+static void pinned_snapshots_survive_publications()
+{
+    jp::published_ordered_set<int> set;
+    {
+        jp::published_ordered_set<int>::reader reader{set};
+        const auto& pinned = reader.pin();
+        for (int i = 0; i < 100; i++) {
+            set.insert(i);
+            set.publish();
+        }
+        CHECK(pinned.empty());
+        CHECK(reader.pin().size() == 100);
+    }
+
+    constexpr int KEYS = 2000;
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&] {
+            jp::published_ordered_set<int>::reader reader{set};
+            size_t last = 0;
+            while (last < KEYS) {
+                const auto& snapshot = reader.pin();
+                size_t size = snapshot.size();
+                if (size < last || (size != 0 && *snapshot.find_by_order(size - 1) != static_cast<int>(size - 1)))
+                    failed = true;
+                last = size;
+            }
+        });
+    }
+    for (int i = 100; i < KEYS; i++) {
+        set.insert(i);
+        set.publish();
+    }
+    for (auto& t : readers)
+        t.join();
+    CHECK(!failed);
+}
+
+/**
+ * Claiming a reader slot fails loudly once all are taken and succeeds again after a reader is gone.
+ */
+static void reader_slots_are_bounded()
+{
+    jp::published_ordered_set<int> set{jp::published_ordered_set<int>::clock::duration::zero(), 2};
+    auto first = std::make_unique<jp::published_ordered_set<int>::reader>(set);
+    jp::published_ordered_set<int>::reader second{set};
+    CHECK(throws<std::length_error>([&] { jp::published_ordered_set<int>::reader third{set}; }));
+    first.reset();
+    jp::published_ordered_set<int>::reader third{set};
+    CHECK(third.pin().empty());
+}
+
+int main()
+{
+    frozen_ranks_from_layout();
+    pinned_snapshots_survive_publications();
+    reader_slots_are_bounded();
+    std::cout << "ok" << std::endl;
+    return 0;
+}
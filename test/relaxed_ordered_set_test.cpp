@@ -0,0 +1,109 @@
+/**
+ *  MIT License
+ *
+ *  Copyright (c) 2020 Jakub Precht <github.com/precht>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ */
+
+/**
+ * Regression tests of relaxed_ordered_set, every test function covers one fixed defect.
+ */
+
+#include "check.hpp"
+
+#include <jp/relaxed_ordered_set.hpp>
+
+#include <iostream>
+#include <new>
+#include <random>
+#include <set>
+
+/**
+ * The counts near the root are no longer maintained but summed from the deeper nodes, ranks must stay exact.
+ */
+static void ranks_across_counted_depth()
+{
+    jp::relaxed_ordered_set<int> set;
+    std::set<int> reference;
+    std::mt19937 random{1};
+    for (int i = 0; i < 20000; i++) {
+        int key = static_cast<int>(random() % 4000);
+        if (random() % 3 != 0)
+            CHECK(set.insert(key) == reference.insert(key).second);
+        else
+            CHECK(set.erase(key) == reference.erase(key));
+    }
+    set.rebalance();
+    CHECK(set.size() == reference.size());
+    size_t order = 0;
+    for (int key : reference) {
+        CHECK(set.order_of_key(key) == order);
+        CHECK(set.find_by_order(order) == key);
+        order++;
+    }
+    CHECK(!set.find_by_order(order));
+}
+
+/**
+ * A key whose copy throws once armed, to make the allocation of the rebuilt nodes fail.
+ */
+struct fragile_key
+{
+    static inline bool armed = false;
+
+    fragile_key(int value) : value{value} { }
+    fragile_key(const fragile_key& other) : value{other.value}
+    {
+        if (armed)
+            throw std::bad_alloc{};
+    }
+    bool operator<(const fragile_key& other) const { return value < other.value; }
+
+    int value;
+};
+
+/**
+ * A rebuild failing to allocate left the subtree locked forever.
+ */
+static void failed_rebuild_unlocks()
+{
+    jp::relaxed_ordered_set<fragile_key> set;
+    // ascending keys build a degenerate tree, parts of it stay unbalanced below the depth helpers react to
+    for (int i = 0; i < 1000; i++)
+        set.insert(i);
+    fragile_key::armed = true;
+    CHECK(throws<std::bad_alloc>([&] { set.rebalance(); }));
+    fragile_key::armed = false;
+    CHECK(set.size() == 1000);
+    for (int i = 0; i < 1000; i += 2)
+        CHECK(set.erase(i) == 1);
+    CHECK(set.insert(1000));
+    set.rebalance();
+    CHECK(set.size() == 501);
+    CHECK(set.order_of_key(1000) == 500);
+}
+
+int main()
+{
+    ranks_across_counted_depth();
+    failed_rebuild_unlocks();
+    std::cout << "ok" << std::endl;
+    return 0;
+}